@@ -7,20 +7,118 @@ class GArrayLibrary : public GLibrary
 public:
   GArrayLibrary()
   {
+    RegisterCommand("setarray", [&](Context *context) {
+      uint32_t size = (uint32_t)context->stack.Pop().GetNumber();
+      GValue target = context->stack.Pop();
+      GVariable *variable = target.GetVariable();
+
+      // Only a variable can be made an array
+      if (!variable)
+        return;
+
+      std::string arrName = variable->name;
+
+      // setarray always creates a dense, zero-filled numeric array
+      GArrayVariable array;
+      array.Resize(size);
+
+      context->SetVariable(arrName, GVARTYPE_ARRAY, array);
+      Log::Get().Print(LOGLEVEL_VERBOSE, "setarray %s size %u\n",
+                       arrName.c_str(), size);
+    });
+
+    RegisterCommand("arrayfill", [&](Context *context) {
+      double value = context->stack.Pop().GetNumber();
+      GArrayVariable *array = GetStoredArray(context);
+
+      if (array)
+        array->Fill(value);
+    });
+
+    RegisterCommand("arrayscale", [&](Context *context) {
+      double factor = context->stack.Pop().GetNumber();
+      GArrayVariable *array = GetStoredArray(context);
+
+      if (array)
+        array->Scale(factor);
+    });
+
+    RegisterCommand("arraycopy", [&](Context *context) {
+      GValue source = context->stack.Pop();
+      GArrayVariable *array = GetStoredArray(context);
+      GVariable *sourceArray = source.GetVariable();
+
+      if (array && sourceArray && sourceArray->GetVarType() == GVARTYPE_ARRAY)
+        array->CopyFrom(*(GArrayVariable *)sourceArray);
+    });
+
     RegisterFunction("arraylen", [&](Context *context) {
       GValue value = context->stack.Pop();
       GVariable* array = value.GetVariable();
       if (array && array->GetVarType() == GVARTYPE_ARRAY) {
-        int len = ((GArrayVariable*)array)->values.size();
+        int len = ((GArrayVariable*)array)->size();
 
         context->stack.Push((float)len);
         Log::Get().Print(LOGLEVEL_VERBOSE, "array length = %d\n", len);
       }
     });
+
+    RegisterFunction("arraysum", [&](Context *context) {
+      GValue value = context->stack.Pop();
+      GArrayVariable *array = GetArray(value);
+
+      context->stack.Push(array ? array->Sum() : 0.0);
+    });
+
+    RegisterFunction("arraymin", [&](Context *context) {
+      GValue value = context->stack.Pop();
+      GArrayVariable *array = GetArray(value);
+
+      context->stack.Push(array ? array->Min() : 0.0);
+    });
+
+    RegisterFunction("arraymax", [&](Context *context) {
+      GValue value = context->stack.Pop();
+      GArrayVariable *array = GetArray(value);
+
+      context->stack.Push(array ? array->Max() : 0.0);
+    });
+
+    RegisterFunction("arrayindexof", [&](Context *context) {
+      double needle = context->stack.Pop().GetNumber();
+      GValue value = context->stack.Pop();
+      GArrayVariable *array = GetArray(value);
+
+      context->stack.Push(array ? (double)array->IndexOf(needle) : -1.0);
+    });
   }
 
   ~GArrayLibrary(){};
 
   static std::string GetName() { return "GArrayLibrary"; }
+
+private:
+  static GArrayVariable *GetArray(const GValue &value)
+  {
+    GVariable *array = value.GetVariable();
+
+    if (array && array->GetVarType() == GVARTYPE_ARRAY)
+      return (GArrayVariable *)array;
+
+    return nullptr;
+  }
+
+  // Commands that modify an array need the stored one, not the pushed copy
+  static GArrayVariable *GetStoredArray(Context *context)
+  {
+    GValue target = context->stack.Pop();
+    GVariable *variable = target.GetVariable();
+
+    if (!variable)
+      return nullptr;
+
+    return (GArrayVariable *)context->GetVariable(variable->name,
+                                                  GVARTYPE_ARRAY);
+  }
 };
 };
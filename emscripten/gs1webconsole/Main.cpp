@@ -32,6 +32,11 @@ char *eval_string(char *sourceString)
 
       {"setstring", {true, true}},
       {"addstring", {true, true}},
+
+      {"setarray", {false, false}},
+      {"arrayfill", {false, false}},
+      {"arrayscale", {false, false}},
+      {"arraycopy", {false, false}},
   };
 
   PrototypeMap funcs = {
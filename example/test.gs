@@ -6,3 +6,6 @@ DoThingTest();
 
 test = 4;
 message #v(test);
+
+// Comments after a command name aren't part of its argument
+message /* note */ done;
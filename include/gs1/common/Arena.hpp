@@ -0,0 +1,69 @@
+#ifndef GS1COMMON_ARENA_HPP
+#define GS1COMMON_ARENA_HPP
+
+#include <gs1/common/Util.hpp>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace gs1
+{
+/**
+ * Bump allocator. Objects are placed one after another in large blocks and
+ * are all destroyed together by Reset or when the arena goes away.
+ */
+class Arena
+{
+public:
+  Arena(size_t blockSize = 64 * 1024);
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+  template <typename T, typename... Args> T *New(Args &&... args)
+  {
+    T *object = new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+
+    if (!std::is_trivially_destructible<T>::value)
+      AddDestructor(object, [](void *p) { ((T *)p)->~T(); });
+
+    return object;
+  };
+
+  // Destroys everything, keeping the first block around for reuse
+  void Reset();
+
+  size_t GetBytesUsed() const { return bytesUsed; };
+
+private:
+  struct Block {
+    Block *next;
+    size_t size;
+  };
+
+  struct Destructor {
+    Destructor *next;
+    void (*destroy)(void *);
+    void *object;
+  };
+
+  void AddDestructor(void *object, void (*destroy)(void *));
+  void AddBlock(size_t minSize);
+  void RunDestructors();
+
+  size_t blockSize;
+  size_t bytesUsed;
+  Block *blocks;
+  char *ptr;
+  char *end;
+  Destructor *destructors;
+};
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef GS1COMMON_ARRAYKERNELS_HPP
+#define GS1COMMON_ARRAYKERNELS_HPP
+
+#include <stdint.h>
+
+/**
+ * Bulk operations over dense arrays of doubles.
+ *
+ * These use SSE2 where the target has it and fall back to scalar loops
+ * everywhere else (including emscripten builds).
+ */
+
+namespace gs1
+{
+void ArrayFill(double *dst, uint32_t count, double value);
+
+void ArrayCopy(double *dst, const double *src, uint32_t count);
+
+void ArrayScale(double *dst, uint32_t count, double factor);
+
+double ArraySum(const double *src, uint32_t count);
+
+double ArrayMin(const double *src, uint32_t count);
+
+double ArrayMax(const double *src, uint32_t count);
+
+// Returns the first index holding value, or -1
+int32_t ArrayIndexOf(const double *src, uint32_t count, double value);
+}
+
+#endif
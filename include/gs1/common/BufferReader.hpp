@@ -3,109 +3,74 @@
 
 #include <gs1/common/Util.hpp>
 
-#include "Log.hpp"
+#include <string.h>
 #include <string>
 
 namespace gs1
 {
+/**
+ * Reads what ByteBuffer writes. Every read is bounds-checked and throws
+ * once it would run past the end of the data.
+ */
 class BufferReader
 {
 public:
   BufferReader(const char *data, uint32_t len)
-      : data(data), len(len), readPos(0)
-  {
-    // Check machine endianness
-    char swapTest[2] = {1, 0};
-    if (*(short *)swapTest == 1)
-      isBigEndian = false;
-    else
-      isBigEndian = true;
-  };
+      : data(data), len(len), readPos(0){};
 
-  int8_t Read8() { return data[readPos++]; };
+  int8_t Read8() { return (int8_t)*Take(1); };
 
-  uint8_t ReadU8() { return data[readPos++]; };
-
-  int16_t Read16()
-  {
-    char _value[4] = {data[readPos], data[readPos + 1]};
-    int16_t value = *((int16_t *)&_value);
+  uint8_t ReadU8() { return (uint8_t)*Take(1); };
 
-    if (isBigEndian)
-      value = bswap_16(value);
-
-    readPos += 2;
-
-    return value;
-  };
+  int16_t Read16() { return (int16_t)ReadU16(); };
 
   uint16_t ReadU16()
   {
-    char _value[4] = {data[readPos], data[readPos + 1]};
-    uint16_t value = *((uint16_t *)&_value);
-
-    if (isBigEndian)
-      value = bswap_16(value);
+    uint16_t value;
+    memcpy(&value, Take(2), 2);
 
-    readPos += 2;
+#if GS1_BIG_ENDIAN
+    value = bswap_16(value);
+#endif
 
     return value;
   };
 
-  int32_t Read32()
-  {
-    char _value[4] = {data[readPos], data[readPos + 1], data[readPos + 2],
-                      data[readPos + 3]};
-    int32_t value = *((int32_t *)&_value);
-
-    if (isBigEndian)
-      value = bswap_32(value);
-
-    readPos += 4;
-
-    return value;
-  };
+  int32_t Read32() { return (int32_t)ReadU32(); };
 
   uint32_t ReadU32()
   {
-    char _value[4] = {data[readPos], data[readPos + 1], data[readPos + 2],
-                      data[readPos + 3]};
-    uint32_t value = *((uint32_t *)&_value);
-
-    if (isBigEndian)
-      value = bswap_32(value);
+    uint32_t value;
+    memcpy(&value, Take(4), 4);
 
-    readPos += 4;
+#if GS1_BIG_ENDIAN
+    value = bswap_32(value);
+#endif
 
     return value;
   };
 
   float ReadFloat()
   {
-    char _value[4] = {data[readPos], data[readPos + 1], data[readPos + 2],
-                      data[readPos + 3]};
-    float value = *((float *)&_value);
-
-    readPos += 4;
+    uint32_t bits = ReadU32();
+    float value;
+    memcpy(&value, &bits, 4);
 
     return value;
   }
 
   std::string ReadString()
   {
-    std::string output;
-
     uint32_t length = ReadU32();
 
-    for (uint32_t i = 0; i < length; ++i)
-      output += (char)ReadU8();
-
-    return output;
+    return std::string(Take(length), length);
   }
 
+  void ReadBytes(char *out, uint32_t size) { memcpy(out, Take(size), size); };
+
   bool Skip(uint32_t size)
   {
-    if (readPos + size > len)
+    if (size > len - readPos)
       return false;
 
     readPos += size;
@@ -113,10 +78,25 @@ public:
     return true;
   };
 
-  void Seek(uint32_t pos) { readPos = pos; };
+  void Seek(uint32_t pos) { readPos = pos < len ? pos : len; };
+
+  uint32_t GetPosition() const { return readPos; };
+
+  uint32_t GetRemaining() const { return len - readPos; };
 
 private:
-  bool isBigEndian;
+  // Returns the next size bytes and moves past them
+  const char *Take(uint32_t size)
+  {
+    if (size > len - readPos)
+      throw Exception("read of %u bytes at %u is past the end (%u)", size,
+                      readPos, len);
+
+    const char *out = data + readPos;
+    readPos += size;
+
+    return out;
+  };
 
   const char *data;
 
@@ -125,4 +105,4 @@ private:
 };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -8,11 +8,16 @@
 
 namespace gs1
 {
+/**
+ * Growable little-endian byte buffer. Writes append unless given an offset,
+ * in which case they overwrite bytes that were already written.
+ */
 class ByteBuffer
 {
 public:
   ByteBuffer();
   ByteBuffer(const ByteBuffer &other);
+  ByteBuffer(ByteBuffer &&other) noexcept;
 
   ~ByteBuffer();
 
@@ -28,23 +33,32 @@ public:
 
   void WriteU32(const uint32_t &value, int32_t offset = BYTEBUFFER_OFFSET_NONE);
 
+  void WriteFloat(const float &value, int32_t offset = BYTEBUFFER_OFFSET_NONE);
+
   void WriteString(const std::string &value);
 
   void WriteBytes(const char *bytes, const unsigned int &length);
 
+  // Appends size zeroed bytes, returning where they start
   unsigned int Reserve(const uint32_t &size);
 
-  char *GetBytes();
+  // Grows the storage to hold at least capacity bytes without reallocating
+  void EnsureCapacity(unsigned int capacity);
 
-  unsigned int GetLength();
+  // Drops everything past length, the storage is kept
+  void Truncate(unsigned int length);
 
-  friend void swap(ByteBuffer &first, ByteBuffer &other)
-  {
-    using std::swap;
+  char *GetBytes() { return bytes; };
+  const char *GetBytes() const { return bytes; };
+
+  unsigned int GetLength() const { return len; };
+
+  unsigned int GetCapacity() const { return maxLen; };
 
+  friend void swap(ByteBuffer &first, ByteBuffer &other) noexcept
+  {
     std::swap(first.len, other.len);
     std::swap(first.maxLen, other.maxLen);
-    std::swap(first.isBigEndian, other.isBigEndian);
     std::swap(first.bytes, other.bytes);
   }
 
@@ -56,7 +70,12 @@ public:
   };
 
 private:
-  bool isBigEndian;
+  // Returns where size bytes can be written, growing the buffer when
+  // appending
+  char *Prepare(uint32_t size, int32_t offset);
+
+  void Grow(unsigned int minCapacity);
+
   char *bytes;
   unsigned int len;
   unsigned int maxLen;
@@ -1,10 +1,14 @@
 #ifndef GS1COMMON_CONSTANTTABLE_HPP
 #define GS1COMMON_CONSTANTTABLE_HPP
 
+#include <gs1/common/PackedValue.hpp>
 #include <gs1/common/Util.hpp>
 
-#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include <string.h>
 #include <string>
+#include <unordered_map>
 
 namespace gs1
 {
@@ -29,21 +33,31 @@ public:
 
   ConstantKey GetKey(const T &value)
   {
-    auto itr =
-        std::find_if(constants.begin(), constants.end(),
-                     [&](const typename std::vector<Constant>::value_type &vt) {
-                       return vt.val == value;
-                     });
-
-    if (itr == constants.end()) {
-      // No name was found, add our own
-      constants.push_back(Constant(value));
-
-      return ConstantKey(constants.size() - 1);
-    } else {
-      // Get key for name
-      return ConstantKey(itr - constants.begin());
+    // Constants are indexed by their hash, so each lookup only compares
+    // against the few which share it
+    auto range = index.equal_range(Hash(value));
+
+    for (auto itr = range.first; itr != range.second; ++itr) {
+      if (Equal(constants[itr->second].val, value))
+        return ConstantKey(itr->second);
     }
+
+    // No constant was found, add our own
+    Append(value);
+
+    return ConstantKey(constants.size() - 1);
+  };
+
+  // Adds value at the end even if it's already in the table, for loading a
+  // table as it was written so the indices into it stay the same
+  void Append(const T &value)
+  {
+    if (constants.size() > PACKVALUE_MAX_INDEX)
+      throw Exception("constant table is full (%u entries)",
+                      (uint32_t)constants.size());
+
+    constants.push_back(Constant(value));
+    index.emplace(Hash(value), (int)constants.size() - 1);
   };
 
   const Constant &GetConstant(const ConstantKey &key)
@@ -54,8 +68,58 @@ public:
       return constants[key.index];
   };
 
+  size_t GetSize() const { return constants.size(); };
+
+  // Forgets every constant added after the table had size entries
+  void Truncate(size_t size)
+  {
+    for (size_t i = size; i < constants.size(); i++) {
+      auto range = index.equal_range(Hash(constants[i].val));
+
+      for (auto itr = range.first; itr != range.second; ++itr) {
+        if (itr->second == (int)i) {
+          index.erase(itr);
+          break;
+        }
+      }
+    }
+
+    if (size < constants.size())
+      constants.erase(constants.begin() + size, constants.end());
+  };
+
+  // Empties the table, keeping its storage for reuse
+  void Clear()
+  {
+    constants.clear();
+    index.clear();
+  };
+
   std::vector<Constant> constants;
+
+private:
+  static size_t Hash(const T &value) { return std::hash<T>()(value); };
+  static bool Equal(const T &a, const T &b) { return a == b; };
+
+  // Hash of a constant to its position in constants
+  std::unordered_multimap<size_t, int> index;
 };
+
+// Numbers are told apart by their bits, so -0 and 0 are different constants
+// and a NaN matches itself
+template <> inline size_t ConstantTable<float>::Hash(const float &value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  return std::hash<uint32_t>()(bits);
+}
+
+template <>
+inline bool ConstantTable<float>::Equal(const float &a, const float &b)
+{
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
 }
 
 #endif
@@ -33,6 +33,16 @@ public:
   GValueType GetValueType() const;
   bool GetFlag() const;
   double GetNumber() const;
+
+  // For values known to be numbers. Anything else reads as some number,
+  // the tag isn't checked.
+  double GetNumberUnchecked() const
+  {
+    nanbox_t value = nanbox;
+    value.as_int64 -= NANBOX_DOUBLE_ENCODE_OFFSET;
+
+    return value.as_double;
+  }
   std::string GetString() const;
   GVariable *GetVariable() const;
 
@@ -12,7 +12,9 @@ enum GVarType {
   GVARTYPE_NUMBER,
   GVARTYPE_FLAG,
   GVARTYPE_STRING,
-  GVARTYPE_ARRAY
+  GVARTYPE_ARRAY,
+
+  GVARTYPE_NUM_TYPES
 };
 
 struct GVariable {
@@ -28,8 +30,8 @@ struct GVariable {
 };
 
 struct GNumberVariable : public GVariable {
-  GNumberVariable(){};
-  GNumberVariable(float number) : number(number){};
+  GNumberVariable() : number(0){};
+  GNumberVariable(double number) : number(number){};
 
   ~GNumberVariable(){};
 
@@ -50,11 +52,11 @@ struct GNumberVariable : public GVariable {
 
   GVarType GetVarType() const { return GVARTYPE_NUMBER; };
 
-  float number;
+  double number;
 };
 
 struct GFlagVariable : public GVariable {
-  GFlagVariable(){};
+  GFlagVariable() : flag(false){};
   GFlagVariable(bool flag) : flag(flag){};
 
   ~GFlagVariable(){};
@@ -105,9 +107,13 @@ struct GStringVariable : public GVariable {
   std::string string;
 };
 
+/**
+ * Arrays that only hold numbers are stored densely in "numbers". The first
+ * write of anything else promotes the array to generic GValues in "values".
+ */
 struct GArrayVariable : public GVariable {
-  GArrayVariable(){};
-  GArrayVariable(std::vector<GValue> values) : values(values){};
+  GArrayVariable() : numeric(true){};
+  GArrayVariable(std::vector<GValue> values) : numeric(false), values(values){};
 
   ~GArrayVariable(){};
 
@@ -116,6 +122,8 @@ struct GArrayVariable : public GVariable {
     GArrayVariable *copy = new GArrayVariable();
 
     copy->name = name;
+    copy->numeric = numeric;
+    copy->numbers = numbers;
     copy->values = values;
 
     return copy;
@@ -125,12 +133,39 @@ struct GArrayVariable : public GVariable {
 
   std::string DebugString() const
   {
-    return std::string("GArrayVar: Size: ") + std::to_string(values.size());
+    return std::string(numeric ? "GArrayVar: Numeric Size: "
+                               : "GArrayVar: Size: ") +
+           std::to_string(size());
   };
 
-  std::vector<GValue> values;
+  bool IsNumeric() const { return numeric; };
+
+  uint32_t size() const { return numeric ? numbers.size() : values.size(); }
+
+  void Resize(uint32_t size);
+
+  GValue Get(uint32_t index) const;
+  double GetNumber(uint32_t index) const;
 
-  uint32_t size() { return values.size(); }
+  void Set(uint32_t index, const GValue &value);
+  void SetNumber(uint32_t index, double value);
+
+  // Bulk operations, vectorised for numeric arrays
+  void Fill(double value);
+  void Scale(double factor);
+  void CopyFrom(const GArrayVariable &other);
+
+  double Sum() const;
+  double Min() const;
+  double Max() const;
+  int32_t IndexOf(double value) const;
+
+  // Converts the dense numbers into generic values
+  void Promote();
+
+  bool numeric;
+  std::vector<double> numbers;
+  std::vector<GValue> values;
 };
 }
 
@@ -0,0 +1,137 @@
+#ifndef GS1COMMON_INSTRUCTION_HPP
+#define GS1COMMON_INSTRUCTION_HPP
+
+#include <gs1/common/ByteBuffer.hpp>
+#include <gs1/common/ConstantTable.hpp>
+#include <gs1/common/Operation.hpp>
+#include <gs1/common/PackedValue.hpp>
+#include <gs1/common/Util.hpp>
+
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// Serialised bytecode starts with the magic and version, bytecode without
+// them is read as version 1
+#define BYTECODE_MAGIC 0x42315347 // "GS1B"
+#define BYTECODE_VERSION 2
+
+// Instructions are little-endian 32-bit words, the opcode in the low byte
+// and an operand in the other three. Some are followed by operand words.
+#define INSTRUCTION_SIZE 4
+
+// Packed operands keep their type in the low 4 bits of the operand and the
+// index in the high 20. Larger indices are marked with PACKED_INDEX_LONG and
+// follow in the next word.
+#define PACKED_INDEX_LONG 0xFFFFFu
+
+// Jump operands are signed, counted in words from the jump itself
+#define JUMP_OFFSET_MIN (-(1 << 23))
+#define JUMP_OFFSET_MAX ((1 << 23) - 1)
+
+// OP_PUSHI pushes its operand as a signed integer
+#define IMMEDIATE_MIN (-(1 << 23))
+#define IMMEDIATE_MAX ((1 << 23) - 1)
+
+// Temps are numbered from 0, bytecode can use this many at most
+#define TEMP_COUNT_MAX 4096
+
+namespace gs1
+{
+inline uint32_t ReadInstruction(const char *code)
+{
+  uint32_t word;
+  memcpy(&word, code, INSTRUCTION_SIZE);
+
+#if GS1_BIG_ENDIAN
+  word = bswap_32(word);
+#endif
+
+  return word;
+}
+
+inline uint32_t MakeInstruction(Opcode op, uint32_t operand = 0)
+{
+  return (uint32_t)op | (operand << 8);
+}
+
+inline Opcode GetOpcode(uint32_t word) { return (Opcode)(word & 0xff); }
+
+// Byte offset from a jump to its target
+inline int32_t GetJumpOffset(uint32_t word)
+{
+  return ((int32_t)word >> 8) * INSTRUCTION_SIZE;
+}
+
+// Integer pushed by OP_PUSHI
+inline int32_t GetImmediate(uint32_t word) { return (int32_t)word >> 8; }
+
+// Decodes the packed operand of word, moving code past the extra word of
+// the long form
+inline PackedValue ReadPackedOperand(uint32_t word, const char *&code)
+{
+  uint32_t index = word >> 12;
+
+  if (index == PACKED_INDEX_LONG) {
+    index = ReadInstruction(code);
+    code += INSTRUCTION_SIZE;
+  }
+
+  return PackedValue((PackedValueType)((word >> 8) & 0xf), index);
+}
+
+// Appends an instruction with a packed operand, in its short form if the
+// index fits
+inline void WritePackedInstruction(ByteBuffer &buffer, Opcode op,
+                                   const PackedValue &value)
+{
+  if (value.value < PACKED_INDEX_LONG) {
+    buffer.WriteU32(MakeInstruction(op, value.valueType | (value.value << 4)));
+  } else {
+    buffer.WriteU32(
+        MakeInstruction(op, value.valueType | (PACKED_INDEX_LONG << 4)));
+    buffer.WriteU32(value.value);
+  }
+}
+
+bool IsJump(Opcode op);
+
+// How many values an instruction takes off the stack and how many it
+// leaves, false for opcodes the VM has no handler for. Array literals and
+// calls also pop what their operands say.
+bool GetStackUse(Opcode op, int64_t &pops, int64_t &pushes);
+
+// GetStackUse for the whole instruction at code, which has to fit, with
+// what array literals and calls pop from their operands. Also false for
+// array literals whose size isn't in numbers.
+bool GetInstructionStackUse(const char *code,
+                            const ConstantTable<float> &numbers,
+                            int64_t &pops, int64_t &pushes);
+
+// The variant of an arithmetic or comparison opcode for operands known to
+// be numbers, or OP_NUM_OPS if it has none
+Opcode GetNumberOpcode(Opcode op);
+
+// Size of the instruction at code with its operand words, or 0 if it
+// doesn't fit in len bytes
+unsigned int GetInstructionSize(const char *code, unsigned int len);
+
+// Values left on the stack after running code from an empty stack, given
+// the number constants array literals take their sizes from. Instructions
+// use the stack as GetStackUse says.
+uint32_t ComputeStackEffect(const char *code, unsigned int len,
+                            const ConstantTable<float> &numbers);
+
+// Deepest the stack gets in any one call running code, following every path
+// from the start and from each of functions, which start on an empty stack.
+// Calls through OP_JAL get a frame of their own. False, with the instruction
+// in errorPos, if code can't be followed there, the stack underflows there
+// or paths reach it with different depths.
+bool ComputeMaxStackDepth(const char *code, unsigned int len,
+                          const ConstantTable<float> &numbers,
+                          const std::map<std::string, uint32_t> &functions,
+                          uint32_t &maxDepth, uint32_t &errorPos);
+}
+
+#endif
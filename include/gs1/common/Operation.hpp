@@ -8,6 +8,9 @@ namespace gs1
 // Legend:
 // A(x) - Argument value by index into bytecode
 // S(x) - Stack value by reverse offset index from the top
+//
+// See Instruction.hpp for how operands are encoded. Version 1 bytecode is
+// read by these values, so new opcodes go at the end.
 
 enum Opcode {
 
@@ -39,7 +42,7 @@ enum Opcode {
   OP_CMD_CALL, //  Pushes # of args, followed by args
 
   OP_JMP, //  JUMP to N(0, 4) by byte offset unconditionally
-  OP_JAL, //  JUMP as per prior semantic and pass last location to jump stack
+  OP_JAL, //  JUMP as per prior semantic and push a call frame, # of args next
   OP_RET, //  Return to location on top of on jump stack
 
   OP_EQ,  //  PUSH (S(1) == S(0))
@@ -59,6 +62,36 @@ enum Opcode {
 
   OP_DBG_OUT, //  Debug output
 
+  OP_POP, //  Discards S(0)
+
+  // Read by number. OP_PUSH_NUM pushes a variable's number, the rest take
+  // operands which are known to be numbers and don't check them.
+  OP_PUSH_NUM, //  PUSH number of N(0, sizeof(PackedValue))
+
+  OP_ADD_NN, //  PUSH (S(1) + S(0))
+  OP_SUB_NN, //  PUSH (S(1) - S(0))
+  OP_MUL_NN, //  PUSH (S(1) * S(0))
+  OP_DIV_NN, //  PUSH (S(1) / S(0))
+  OP_MOD_NN, //  PUSH (S(1) % S(0))
+  OP_POW_NN, //  PUSH (S(1) ^ S(0))
+
+  OP_EQ_NN,  //  PUSH (S(1) == S(0))
+  OP_LT_NN,  //  PUSH (S(1) < S(0))
+  OP_GT_NN,  //  PUSH (S(1) > S(0))
+  OP_LTE_NN, //  PUSH (S(1) <= S(0))
+  OP_GTE_NN, //  PUSH (S(1) >= S(0))
+
+  OP_PUSH0, //  PUSH 0
+  OP_PUSH1, //  PUSH 1
+  OP_PUSHI, //  PUSH N(0, 3) as a signed integer
+
+  OP_FORLOOP, //  Increments a number variable and jumps by N(0, 3) while
+              //  it's less than a constant, variable and constant next
+
+  // Temps hold numbers the optimiser keeps for reuse, by index N(0, 3)
+  OP_STORE_TEMP, //  Copies S(0) into the temp, leaving it on the stack
+  OP_PUSH_TEMP,  //  PUSH the temp
+
   OP_NUM_OPS //  This is to get the number of operations
 
   // @formatter:on
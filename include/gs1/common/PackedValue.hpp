@@ -3,11 +3,18 @@
 
 namespace gs1
 {
+// Largest constant index an operand can hold
+#define PACKVALUE_MAX_INDEX ((1u << 28) - 1)
+
 enum PackedValueType {
   PACKVALUE_CONST_NUMBER,
   PACKVALUE_CONST_STRING,
   PACKVALUE_CONST_ARRAY,
-  PACKVALUE_NAMED
+  PACKVALUE_NAMED,
+
+  // A variable which is only tested, numbers and flags are pushed as they
+  // are instead of in a named temporary an assignment could target
+  PACKVALUE_NAMED_VALUE
 };
 
 #ifdef _MSC_VER
@@ -20,8 +27,10 @@ struct PackedValue {
 
   // The type of value, see enum PackedValueType
   unsigned int valueType : 4;
-  unsigned int value : 16;
-  unsigned int unused : 12;
+
+  // Index into the constant table for the type, takes up the rest of the
+  // word so large scripts don't run out of indices
+  unsigned int value : 28;
 }
 #ifndef _MSC_VER
 __attribute__((packed));
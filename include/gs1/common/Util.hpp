@@ -6,6 +6,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -19,10 +20,18 @@
   (((uint64_t)bswap_32((uint32_t)((value)&0xffffffff)) << 32) |                \
    (uint64_t)bswap_32((uint32_t)((value) >> 32)))
 
+// Serialised data is always little-endian, so only big-endian hosts swap
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GS1_BIG_ENDIAN 1
+#else
+#define GS1_BIG_ENDIAN 0
+#endif
+
 namespace gs1
 {
 using std::deque;
 using std::string;
+using std::string_view;
 using std::vector;
 using std::function;
 using std::shared_ptr;
@@ -42,11 +51,10 @@ private:
 
 struct Pos {
   Pos() : offset(-1) {}
-  Pos(size_t offset) : offset(offset) {}
-  Pos(size_t offset, uint32_t line) : offset((int)offset), line(line) {}
+  Pos(size_t offset) : offset((int)offset) {}
 
+  // Lines aren't tracked here, see ISource::GetLine
   int offset;
-  uint32_t line;
 };
 
 struct Range {
@@ -2,39 +2,34 @@
 #define GS1PARSE_BYTECODEBODY_HPP
 
 #include <gs1/common/ByteBuffer.hpp>
+#include <gs1/common/Instruction.hpp>
 #include <gs1/common/Operation.hpp>
 #include <gs1/common/PackedValue.hpp>
 
+#include <map>
+#include <vector>
+
 namespace gs1
 {
+// A jump whose offset is filled in once its target is known
 struct Reservation {
-  Reservation(ByteBuffer *byteBuffer, unsigned int offset)
-      : byteBuffer(byteBuffer), offset(offset)
+  Reservation(ByteBuffer *byteBuffer, unsigned int offset, Opcode op = OP_JMP)
+      : byteBuffer(byteBuffer), offset(offset), op(op)
   {
   }
 
   ~Reservation(){};
 
-  Reservation &Emit(Opcode op)
-  {
-    byteBuffer->Write8(op, offset++);
-    return *this;
-  };
-
+  // Sets how far to jump, in bytes from the jump
   Reservation &Emit(int constant)
   {
-    byteBuffer->Write32(constant, offset);
+    int32_t words = constant / INSTRUCTION_SIZE;
 
-    offset += 4;
+    if (words < JUMP_OFFSET_MIN || words > JUMP_OFFSET_MAX)
+      throw Exception("jump of %d bytes is out of range", constant);
 
-    return *this;
-  };
-
-  Reservation &Emit(unsigned int constant)
-  {
-    byteBuffer->WriteU32(constant, offset);
-
-    offset += 4;
+    byteBuffer->WriteU32(MakeInstruction(op, (uint32_t)words & 0xffffff),
+                         offset);
 
     return *this;
   };
@@ -44,7 +39,20 @@ struct Reservation {
 private:
   ByteBuffer *byteBuffer;
   unsigned int offset;
-  unsigned int remaining;
+  Opcode op;
+};
+
+// What an expression's code is known to leave on the stack
+enum ExprType {
+  // Anything, checked when it's used
+  EXPRTYPE_ANY,
+
+  // A number which isn't wrapped in a variable
+  EXPRTYPE_NUMBER,
+
+  // A variable pushed on its own by one OP_PUSH, which can be pushed as a
+  // number instead
+  EXPRTYPE_VARIABLE
 };
 
 class BytecodeBody
@@ -56,24 +64,100 @@ public:
 
   void Emit(Opcode op);
 
+  // Emits an instruction taking a packed operand, in its short form if the
+  // index fits
+  void Emit(Opcode op, const PackedValue &value);
+
+  // Pushes a number, integers are encoded in the instruction and anything
+  // else is tabled in numbers
+  void EmitNumber(float number, ConstantTable<float> &numbers);
+
+  // Raw words
   void Emit(int constant);
 
   void Emit(unsigned int constant);
 
-  void Emit(const PackedValue &value);
+  void EmitCall(Opcode op, const PackedValue &name, unsigned int argCount);
+
+  // Emits an arithmetic or comparison operator, whose operands were emitted
+  // from leftStart and rightStart. The operator reads them as numbers, so
+  // variables are pushed as numbers, and it's specialised if both operands
+  // are numbers. Returns what the operator leaves on the stack.
+  ExprType EmitNumberOp(Opcode op, ExprType left, unsigned int leftStart,
+                        ExprType right, unsigned int rightStart);
 
-  Reservation BeginFunction(std::string name);
+  // Pops whatever the code emitted since start leaves on the stack, for
+  // expressions used as statements
+  void EmitDiscard(unsigned int start, const ConstantTable<float> &numbers);
+
+  // Emits a jump to be filled in through the returned reservation
+  Reservation EmitJump(Opcode op);
+
+  // Emits a jump to an already emitted position
+  void EmitJump(Opcode op, unsigned int target);
+
+  // Ends a for loop whose condition starts at conditionStart, body at
+  // bodyStart and step at stepStart. Loops counting a variable up by one to
+  // a constant, "for (i = a; i < n; i++)", have the step and condition fused
+  // into an OP_FORLOOP, others jump back to the condition.
+  void EmitForLoopEnd(unsigned int conditionStart, unsigned int bodyStart,
+                      unsigned int stepStart, ConstantTable<float> &numbers);
+
+  Reservation BeginFunction();
 
   void EndFunction(Reservation reservation);
 
-  Reservation Reserve(unsigned int numBytes);
+  // Turns calls by name to functions the script defines into jumps and links
+  // straight to them, once the whole script has been emitted. Other calls
+  // are left to be looked up in libraries.
+  void LinkFunctions(const ConstantTable<std::string> &strings,
+                     const std::map<std::string, uint32_t> &functions);
+
+  // Copies already emitted bytes in [start, end) to the end of the body
+  void EmitCopy(unsigned int start, unsigned int end);
+
+  // Overwrites the opcode at position
+  void Patch(unsigned int position, Opcode op);
+
+  // Marks a variable pushed on its own at start as only read, for conditions
+  // which test it without assigning to it
+  void PatchRead(ExprType type, unsigned int start);
+
+  // Drops everything emitted past position
+  void Truncate(unsigned int position);
+
+  // Break and continue jumps are kept until their loop knows where they go,
+  // they're ignored outside of a loop
+  void BeginLoop();
+
+  void EmitBreak();
+
+  void EmitContinue();
+
+  // Continues jump to continuePosition, breaks to the current position
+  void EndLoop(unsigned int continuePosition);
 
   unsigned int GetCurrentPosition();
 
+  const char *GetBytes() const { return byteBuffer.GetBytes(); };
+
   ByteBuffer GetByteBuffer();
 
+  // Exchanges the emitted bytes with the contents of buffer, handing them
+  // over without a copy
+  void SwapBuffer(ByteBuffer &buffer);
+
+  // Forgets everything emitted, keeping the storage for reuse
+  void Clear();
+
 private:
+  struct LoopJumps {
+    std::vector<Reservation> breaks;
+    std::vector<Reservation> continues;
+  };
+
   ByteBuffer byteBuffer;
+  std::vector<LoopJumps> loops;
 };
 }
 
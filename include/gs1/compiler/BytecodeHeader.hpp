@@ -5,6 +5,7 @@
 
 #include <gs1/common/ByteBuffer.hpp>
 #include <gs1/common/ConstantTable.hpp>
+#include <gs1/common/Instruction.hpp>
 #include <gs1/common/Operation.hpp>
 #include <gs1/common/PackedValue.hpp>
 
@@ -19,9 +20,16 @@ public:
 
   std::shared_ptr<ConstantTable<std::string>> constStringTable;
   std::shared_ptr<ConstantTable<float>> constNumberTable;
+
+  // Where each script function starts in the body
   std::map<std::string, uint32_t> functionOffsetTable;
 
-  ByteBuffer GetByteBuffer();
+  // Appends the header followed by body to buffer, in the latest format
+  void Write(ByteBuffer &buffer, const char *body, unsigned int bodyLen);
+
+  ByteBuffer GetByteBuffer(const char *body, unsigned int bodyLen);
+
+  void Clear();
 
 private:
 };
@@ -58,12 +58,25 @@ public:
 
   void Visit(ExprCall *node);
 
+  // Appends the header and body to buffer
+  void WriteBytecode(ByteBuffer &buffer);
+
   ByteBuffer GetBytecode();
 
+  BytecodeHeader &GetHeader() { return header; };
+
+  BytecodeBody &GetBody() { return body; };
+
 private:
   BytecodeHeader header;
   BytecodeBody body;
 
+  // Compiles a statement, popping the value of an expression statement
+  void AcceptStmt(SyntaxNode *node);
+
+  // Compiles a condition, which is only read
+  void AcceptCondition(Expr *node);
+
   void PrintEnterNode(SyntaxNode *node, const char *name);
 
   void Print(const char *fmt, ...);
@@ -0,0 +1,111 @@
+#ifndef GS1COMPILER_COMPILERSESSION_HPP
+#define GS1COMPILER_COMPILERSESSION_HPP
+
+#include <gs1/common/Arena.hpp>
+#include <gs1/compiler/CompileVisitor.hpp>
+#include <gs1/compiler/StreamCompiler.hpp>
+
+#include <memory>
+
+namespace gs1
+{
+enum CompileMode {
+  // Compiles while parsing, no syntax tree is built
+  COMPILEMODE_STREAM,
+
+  // Parses into a syntax tree first, then compiles the tree
+  COMPILEMODE_TREE
+};
+
+// A diagnostic with its line resolved, so it stays useful after the source
+// is gone
+struct CompileDiag {
+  Diag diag;
+  uint32_t line;
+};
+
+/**
+ * Compiles any number of scripts against one set of prototypes. Buffers
+ * are cleared and reused between compiles instead of being reallocated,
+ * and diagnostics are collected rather than logged.
+ */
+class CompilerSession
+{
+public:
+  CompilerSession(PrototypeMap commands, PrototypeMap functions,
+                  CompileMode mode = COMPILEMODE_STREAM);
+
+  CompilerSession(const CompilerSession &) = delete;
+  CompilerSession &operator=(const CompilerSession &) = delete;
+
+  // Each returns false if any errors were reported. The output and
+  // diagnostics are kept until the next compile. Scripts which compile
+  // without errors have their jumps cleaned up by a FlowSimplifier.
+  bool Compile(ISource &source);
+  bool CompileString(string_view text);
+  bool CompileFile(const string &path);
+
+  // Compiles one expression whose value is left on the stack, always in
+  // stream mode
+  bool CompileExpression(string_view text);
+
+  // Serialised output, only written out the first time it's asked for
+  ByteBuffer &GetBytecode();
+
+  // Hands the constant tables and body over without serialising them,
+  // swapping in the (empty) ones passed in. Nothing is left to serialise
+  // afterwards.
+  void TakeOutput(BytecodeHeader &header, ByteBuffer &body);
+
+  const vector<CompileDiag> &GetDiags() const { return diags; };
+
+  bool HasErrors() const { return errorCount != 0; };
+
+  void SetMode(CompileMode mode) { this->mode = mode; };
+
+  // Runs the Optimizer over scripts which compile without errors, off by
+  // default. Expressions aren't optimised.
+  void SetOptimize(bool optimize) { this->optimize = optimize; };
+
+  // When optimising, script functions of up to maxSize words are inlined
+  // into their calls until the body has grown by maxGrowth words. 0 for
+  // maxSize turns inlining off.
+  void SetInlining(unsigned int maxSize, unsigned int maxGrowth)
+  {
+    inlineSize = maxSize;
+    inlineGrowth = maxGrowth;
+  };
+
+private:
+  // Forgets the output and diagnostics of the last compile
+  void Begin(ISource &source);
+
+  void AddDiag(const Diag &d);
+
+  BytecodeHeader &GetOutputHeader();
+  BytecodeBody &GetOutputBody();
+
+  PrototypeMap commands;
+  PrototypeMap functions;
+  CompileMode mode;
+  bool optimize;
+  unsigned int inlineSize;
+  unsigned int inlineGrowth;
+
+  DiagBuilder diag;
+  StreamCompiler compiler;
+  Arena arena;
+  ByteBuffer output;
+  bool outputWritten;
+
+  // Tree mode keeps its visitor around until the next compile, as it holds
+  // the output
+  std::unique_ptr<CompileVisitor> visitor;
+
+  ISource *source;
+  vector<CompileDiag> diags;
+  uint32_t errorCount;
+};
+}
+
+#endif
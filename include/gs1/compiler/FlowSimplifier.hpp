@@ -0,0 +1,70 @@
+#ifndef GS1COMPILER_FLOWSIMPLIFIER_HPP
+#define GS1COMPILER_FLOWSIMPLIFIER_HPP
+
+#include <gs1/compiler/BytecodeBody.hpp>
+#include <gs1/compiler/BytecodeHeader.hpp>
+
+#include <vector>
+
+namespace gs1
+{
+/**
+ * Cleans up the jumps code generation leaves behind, over a finished body:
+ *
+ * - jumps to unconditional jumps go straight to where the chain ends, and
+ *   jumps to a return or stop are replaced by it
+ * - code no path from the start or a function reaches is dropped
+ * - jumps to the instruction after them are dropped, conditional ones pop
+ *   their condition instead
+ *
+ * These feed each other so they're repeated until nothing changes, then
+ * the body is written back out with every offset recomputed.
+ */
+class FlowSimplifier
+{
+public:
+  FlowSimplifier(BytecodeHeader &header, BytecodeBody &body);
+
+  // Rewrites the body and function offsets, bodies it can't follow are left
+  // as they are
+  void Simplify();
+
+private:
+  struct Instruction {
+    uint32_t pos;
+    unsigned int size;
+    uint32_t word;
+    Opcode op;
+
+    // Instruction jumped to, instructions.size() for the end of the body and
+    // -1 for none
+    int target;
+
+    bool removed;
+
+    // Replaced by op on its own, with no operands
+    bool rewritten;
+  };
+
+  bool Decode();
+
+  bool ThreadJumps();
+  bool RemoveUnreachable();
+  bool RemoveNoOpJumps();
+
+  void Encode();
+
+  // Index of the instruction at pos, -1 if none starts there
+  int FindInstruction(uint32_t pos);
+
+  // First instruction from i which is kept, instructions.size() if none
+  int GetNext(int i);
+
+  BytecodeHeader &header;
+  BytecodeBody &body;
+
+  std::vector<Instruction> instructions;
+};
+}
+
+#endif
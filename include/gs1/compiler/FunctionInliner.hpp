@@ -0,0 +1,97 @@
+#ifndef GS1COMPILER_FUNCTIONINLINER_HPP
+#define GS1COMPILER_FUNCTIONINLINER_HPP
+
+#include <gs1/compiler/BytecodeBody.hpp>
+#include <gs1/compiler/BytecodeHeader.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gs1
+{
+// Inlining a CompilerSession does unless told otherwise, in words
+#define INLINE_SIZE_DEFAULT 16
+#define INLINE_GROWTH_DEFAULT 1024
+
+/**
+ * Copies the bodies of small script functions over the OP_JAL calls to
+ * them, saving the link, jump and return of each call. The copy pops the
+ * call's arguments, returns jump to its end and it pushes the zero the call
+ * would have, unless that's popped straight away.
+ *
+ * Functions are only inlined if they can't end up calling themselves, their
+ * jumps all stay inside them and every return leaves the stack as it was
+ * found. The functions stay where they are, for calls left as they are and
+ * calls from outside the script.
+ */
+class FunctionInliner
+{
+public:
+  // Functions of up to maxSize words are inlined, until the body has grown
+  // by maxGrowth words
+  FunctionInliner(BytecodeHeader &header, BytecodeBody &body,
+                  unsigned int maxSize, unsigned int maxGrowth);
+
+  // Rewrites the body and function offsets, bodies it can't follow are left
+  // as they are
+  void Inline();
+
+private:
+  struct Instruction {
+    uint32_t pos;
+    unsigned int size;
+    uint32_t word;
+    Opcode op;
+
+    // Instruction jumped to, instructions.size() for the end of the body and
+    // -1 for none
+    int target;
+
+    // Function whose body replaces this call, -1 for none
+    int inlined;
+
+    // Left out, for pops of calls whose copy doesn't push a result
+    bool removed;
+  };
+
+  struct Function {
+    std::string name;
+
+    // First instruction and the return closing the body
+    int first;
+    int last;
+
+    // Functions it calls, by first instruction
+    std::vector<int> callees;
+
+    bool inlinable;
+  };
+
+  bool Decode();
+  void FindFunctions();
+  bool CheckFunction(const Function &function);
+  bool IsRecursive(const Function &function);
+  void ChooseCalls();
+
+  void Encode();
+
+  // Index of the instruction at pos, -1 if none starts there
+  int FindInstruction(uint32_t pos);
+
+  // Words in a function's body, leaving out the return closing it
+  unsigned int GetSize(const Function &function);
+
+  // The function starting at instruction first, nullptr if none does
+  Function *GetFunction(int first);
+
+  BytecodeHeader &header;
+  BytecodeBody &body;
+  unsigned int maxSize;
+  unsigned int maxGrowth;
+
+  std::vector<Instruction> instructions;
+  std::vector<Function> functions;
+};
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef GS1COMPILER_OPTIMIZER_HPP
+#define GS1COMPILER_OPTIMIZER_HPP
+
+#include <gs1/compiler/BytecodeBody.hpp>
+#include <gs1/compiler/BytecodeHeader.hpp>
+
+#include <set>
+#include <vector>
+
+namespace gs1
+{
+/**
+ * Optional tier run over a finished body. The stack code is lifted into SSA
+ * form, a value for each push and a phi for each stack slot where control
+ * flow meets, which is optimised and written back out as bytecode:
+ *
+ * - number stores overwritten later in the same block, before anything
+ *   could read them, are dropped
+ * - number loads and arithmetic which can't change inside a loop are
+ *   computed once in front of it and kept in a temp
+ * - number loads and arithmetic repeated in a block are computed once and
+ *   reused through a temp
+ * - copies, left by the above and by phis whose inputs are all one value,
+ *   are propagated, so stores through them are still known to be to one
+ *   variable
+ *
+ * Variables are told apart by name alone. Calls can read and write any of
+ * them, so nothing is kept in a temp across a call and loops which call
+ * anything aren't touched.
+ */
+class Optimizer
+{
+public:
+  Optimizer(BytecodeHeader &header, BytecodeBody &body);
+
+  // Rewrites the body and function offsets, bodies it can't follow are left
+  // as they are
+  void Optimize();
+
+private:
+  // How an instruction touches variables
+  enum Access { ACCESS_NONE, ACCESS_NAME, ACCESS_ANY };
+
+  struct Instruction {
+    uint32_t pos;
+    unsigned int size;
+    uint32_t word;
+    Opcode op;
+
+    // Instruction jumped to, instructions.size() for the end of the body and
+    // -1 for none
+    int target;
+
+    // Operand of pushes and calls
+    PackedValue operand = PackedValue(PACKVALUE_NAMED);
+
+    int block;
+
+    // Values popped, deepest first, and the value pushed or -1
+    std::vector<int> args;
+    int result;
+
+    // Rewrites made when the body is written back out
+    bool removed;
+    int pushTemp;
+    int storeTemp;
+    std::vector<int> hoistBefore;
+    std::vector<int> hoistAfter;
+  };
+
+  struct Block {
+    int first;
+    int last;
+    std::vector<int> preds;
+    std::vector<int> succs;
+
+    // Stack depth on entry, -1 while the block isn't known to be reached
+    int depth;
+
+    // Values on the stack on entry and exit, deepest first
+    std::vector<int> entryStack;
+    std::vector<int> exitStack;
+
+    // Entered from outside the body, at its start or as a function
+    bool entry;
+
+    // Immediate dominator and reverse postorder index
+    int idom;
+    int order;
+  };
+
+  struct Value {
+    // Defining instruction, -1 for phis
+    int instr;
+    int block;
+
+    // Values a phi merges, by predecessor
+    std::vector<int> inputs;
+
+    // Value this one is a copy of, -1 if it isn't one
+    int copyOf;
+
+    // First instruction of the code computing a number from loads,
+    // constants and arithmetic alone, ending at instr. -1 if the value
+    // isn't computed that way.
+    int rangeStart;
+
+    // Instruction popping the value, -1 if it's left for a phi
+    int user;
+  };
+
+  // Code copied in front of a loop, leaving a number in a temp
+  struct Hoist {
+    int start;
+    int end;
+    int temp;
+  };
+
+  bool Decode();
+  bool BuildBlocks();
+  bool BuildValues();
+  void ComputeDominators();
+
+  void PropagateCopies();
+  void EliminateDeadStores();
+  void HoistInvariants();
+  void EliminateCommonSubexpressions();
+
+  void Encode();
+
+  // Index of the instruction at pos, -1 if none starts there
+  int FindInstruction(uint32_t pos);
+
+  // Follows copies to the value they're of
+  int Resolve(int value);
+
+  // Whether a dominates b
+  bool Dominates(int a, int b);
+
+  // Name index of the variable a value was pushed as, -1 if it isn't known
+  int GetVariableName(int value);
+
+  // Whether a value is known to be a number
+  bool IsNumber(int value);
+
+  Access GetRead(int instr, uint32_t &name);
+  Access GetWrite(int instr, uint32_t &name);
+
+  // Whether a value's code only reads variables which aren't in written
+  bool IsInvariant(int value, const std::set<uint32_t> &written);
+
+  // Whether any instruction in [start, end] is already rewritten
+  bool IsRewritten(int start, int end);
+
+  BytecodeHeader &header;
+  BytecodeBody &body;
+
+  std::vector<Instruction> instructions;
+  std::vector<Block> blocks;
+  std::vector<Value> values;
+  std::vector<Hoist> hoists;
+
+  // Blocks in reverse postorder, from the entries
+  std::vector<int> order;
+
+  // Temps below this are kept by hoisted code for the whole of a loop,
+  // those from it are reused block by block
+  int hoistTemps;
+};
+}
+
+#endif
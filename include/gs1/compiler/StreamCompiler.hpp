@@ -0,0 +1,137 @@
+#ifndef GS1COMPILER_STREAMCOMPILER_HPP
+#define GS1COMPILER_STREAMCOMPILER_HPP
+
+#include <gs1/compiler/BytecodeBody.hpp>
+#include <gs1/compiler/BytecodeHeader.hpp>
+#include <gs1/parse/Parser.hpp>
+
+namespace gs1
+{
+/**
+ * Single pass compiler. Follows the same grammar as Parser but emits
+ * bytecode as it goes instead of building a syntax tree, producing exactly
+ * what CompileVisitor would for the same source.
+ */
+class StreamCompiler
+{
+public:
+  StreamCompiler(DiagBuilder &diag, const PrototypeMap &commands,
+                 const PrototypeMap &functions);
+
+  // Compiles everything the lexer produces, replacing the output of any
+  // earlier compile while keeping its buffers
+  void Compile(Lexer &lexer);
+
+  // Compiles a single expression, leaving its value on the stack
+  void CompileExpression(Lexer &lexer);
+
+  // Appends the header and body to buffer
+  void WriteBytecode(ByteBuffer &buffer);
+
+  ByteBuffer GetBytecode();
+
+  BytecodeHeader &GetHeader() { return header; };
+
+  BytecodeBody &GetBody() { return body; };
+
+private:
+  // How the enclosing node treats the value of an expression, which decides
+  // whether increments and decrements push their result
+  enum ValueUse { VALUE_USED, VALUE_DISCARDED, VALUE_DEFERRED };
+
+  // What the tree would have built for an expression, where its code
+  // starts and what it leaves on the stack
+  struct ExprResult {
+    ExprResult() : valid(false), kind(NodeExpr), start(0), type(EXPRTYPE_ANY)
+    {
+    }
+    ExprResult(NodeKind kind, unsigned int start,
+               ExprType type = EXPRTYPE_ANY)
+        : valid(true), kind(kind), start(start), type(type)
+    {
+    }
+
+    bool valid;
+    NodeKind kind;
+    unsigned int start;
+    ExprType type;
+  };
+
+  // Increment or decrement waiting to know if its value is used
+  struct PendingIncDec {
+    unsigned int position;
+    Opcode pushOp;
+  };
+
+  // Enough state to parse a stretch of source again
+  struct SourceMark {
+    Token token;
+    uint32_t offset;
+    uint32_t lastEnd;
+  };
+
+  // Clears the output of the last compile and reads the first token
+  void Begin(Lexer &lexer);
+
+  void EatTerminal();
+  void EatTerminal(TokenType type);
+
+  SourceMark Mark();
+  void Restore(const SourceMark &mark);
+
+  // --------------------------------------------------
+  // Statements
+  // --------------------------------------------------
+
+  bool ParseStmt(bool optional = false);
+  void ParseStmtBlock();
+  void ParseStmtIf();
+  void ParseStmtFor();
+  void ParseStmtWhile();
+  void ParseStmtBreak();
+  void ParseStmtContinue();
+  void ParseStmtReturn();
+  void ParseStmtCommand(const vector<bool> &prototype);
+  void ParseStmtFunctionDecl();
+
+  // --------------------------------------------------
+  // Expressions
+  // --------------------------------------------------
+
+  ExprResult ParseExpr(bool optional, int precedence, ValueUse use);
+  ExprResult ParseExprId();
+  ExprResult ParseExprNumberLiteral();
+  ExprResult ParseExprStringLiteral();
+  ExprResult ParseExprList();
+  ExprResult ParseExprRange();
+  ExprResult ParseExprPrefixUnaryOp();
+  ExprResult ParseExprBinaryOp(ExprResult left, int precedence,
+                               size_t pendingMark);
+  ExprResult ParseExprTernaryOp(ExprResult left, int precedence);
+  ExprResult ParseExprIndex(unsigned int start);
+  ExprResult ParseExprCall(const string &name, unsigned int start);
+  ExprResult ParseExprCallBuiltin(const string &name, unsigned int start,
+                                  const vector<bool> &prototype);
+
+  void EmitId(const string &name);
+  void EmitIncDec(TokenType op);
+  void ResolvePending(size_t pendingMark, bool used);
+
+  BytecodeHeader header;
+  BytecodeBody body;
+
+  Lexer *lexer;
+  DiagBuilder &realDiag;
+  DiagBuilder silentDiag;
+  DiagBuilder *diag;
+  const PrototypeMap &commands;
+  const PrototypeMap &functions;
+
+  Token token;
+  uint32_t lastEnd;
+  int depth;
+  vector<PendingIncDec> pending;
+};
+}
+
+#endif
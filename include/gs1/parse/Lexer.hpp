@@ -12,12 +12,31 @@ class Lexer
 public:
   Lexer(DiagBuilder &diag, ISource &source);
 
+  // When trivia isn't kept, whitespace, newlines and comments are consumed
+  // here and never become tokens
+  void SetKeepTrivia(bool keep);
+
+  // Lexes the next token as a raw string argument, should be called before
+  // that token is looked at
   void FlagNextAsString(bool inCall, bool lastArg);
 
   void Advance();
   Token Current();
   Token Lookahead(size_t n = 1);
 
+  // Whether the next token is whitespace or a comment, checked from the
+  // source without lexing anything past it
+  bool PeekTrailingTrivia();
+
+  string_view GetText(const Token &token) const;
+
+  // Where the next token will be lexed from, only meaningful while no tokens
+  // are buffered
+  uint32_t GetOffset() const;
+
+  // Drops buffered tokens and continues lexing from offset
+  void Seek(uint32_t offset);
+
 private:
   bool IsAlpha(uint32_t c);
   bool IsAlphaNum(uint32_t c);
@@ -26,9 +45,16 @@ private:
   bool IsDecDigit(uint32_t c);
   bool IsHexDigit(uint32_t c);
 
-  void NextChar();
+  uint32_t Peek(size_t n = 0) const;
+
   void FetchToken();
   void PushToken(TokenType type);
+  void ClearTokens();
+
+  void SkipTrivia();
+  void SkipTrailingTrivia();
+  void SkipLineComment();
+  void SkipBlockComment();
 
   void HandleEOF();
   void HandleWhitespace();
@@ -42,16 +68,22 @@ private:
 
   ISource &source;
   DiagBuilder &diag;
-  Pos start;
+  bool keepTrivia;
   bool stringNext;
   bool stringInCall;
   bool stringLastArg;
-  uint32_t ch;
-  uint32_t pk;
-  deque<Token> tokens;
 
-  static unordered_map<string, TokenType> keywords;
-  static unordered_map<string, TokenType> symbols;
+  // The source buffer is scanned in place
+  const char *beg;
+  const char *end;
+  const char *ptr;
+  const char *start;
+
+  // Ring buffer of lexed tokens which haven't been consumed yet
+  static const uint32_t maxTokens = 8;
+  Token tokens[maxTokens];
+  uint32_t tokenHead;
+  uint32_t tokenCount;
 };
 }
 
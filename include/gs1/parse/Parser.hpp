@@ -11,9 +11,14 @@ typedef unordered_map<string, vector<bool>> PrototypeMap;
 class Parser
 {
 public:
-  Parser(DiagBuilder &diag, Lexer &lexer, const PrototypeMap &commands,
-         const PrototypeMap &functions);
-  shared_ptr<SyntaxNode> Parse();
+  // Without keepTrivia terminals have no leading or trailing trivia, which
+  // is all the compiler needs
+  Parser(DiagBuilder &diag, Lexer &lexer, Arena &arena,
+         const PrototypeMap &commands, const PrototypeMap &functions,
+         bool keepTrivia = true);
+
+  // The tree lives in the arena and is freed along with it
+  SyntaxNode *Parse();
 
 private:
   void EatTerminal(SyntaxTerminal **ref = nullptr);
@@ -59,6 +64,7 @@ private:
 
   Lexer &lexer;
   DiagBuilder &diag;
+  Arena &arena;
   const TokenType &token;
   SyntaxTerminal terminal;
   vector<SyntaxNode *> stack;
@@ -0,0 +1,33 @@
+#ifndef GS1PARSE_SCANKERNELS_HPP
+#define GS1PARSE_SCANKERNELS_HPP
+
+/**
+ * Kernels the lexer uses to find the end of long character runs.
+ *
+ * Each returns the first position in [p, end) which stops the run, or end.
+ * AVX2 or SSE2 versions are picked at runtime when the CPU has them, with
+ * scalar loops everywhere else (including emscripten builds).
+ */
+
+namespace gs1
+{
+// First character which isn't a space or a tab
+const char *SkipWhitespace(const char *p, const char *end);
+
+// First '\n' or '\r'
+const char *FindLineBreak(const char *p, const char *end);
+
+// First '*' which is followed by '/'
+const char *FindBlockCommentEnd(const char *p, const char *end);
+
+// First character which can't continue an identifier
+const char *SkipIdChars(const char *p, const char *end);
+
+// First '(', ')', ',' or ';'
+const char *FindStringArgStop(const char *p, const char *end);
+
+// Name of the kernel set in use ("avx2", "sse2" or "scalar")
+const char *GetScanKernelsName();
+}
+
+#endif
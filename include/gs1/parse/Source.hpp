@@ -5,44 +5,45 @@
 
 namespace gs1
 {
+/**
+ * A source is a contiguous [begin, end) buffer of script text. The lexer
+ * scans it directly, line numbers are only resolved (through a newline
+ * index built on first use) when a diagnostic needs them.
+ */
 class ISource
 {
 public:
   virtual ~ISource() {}
 
-  virtual void Reset(Pos p) = 0;
+  const char *GetBegin() const { return beg; }
+  const char *GetEnd() const { return end; }
+  size_t GetLength() const { return end - beg; }
 
-  virtual Pos GetPos() const = 0;
-  virtual string GetRangeContents(Range r) const = 0;
+  string GetRangeContents(Range r) const;
+  string_view GetView(size_t offset, size_t length) const;
+
+  // Zero based line containing offset
+  uint32_t GetLine(size_t offset) const;
+
+protected:
+  ISource() : beg(nullptr), end(nullptr) {}
+  ISource(const ISource &) = delete;
+  ISource &operator=(const ISource &) = delete;
 
-  virtual void Advance() = 0;
-  virtual uint32_t Current() = 0;
-  virtual uint32_t Lookahead(size_t n = 1) = 0;
+  const char *beg;
+  const char *end;
 
-  virtual bool GetFinished() = 0;
+private:
+  // Offsets of every '\n', filled the first time GetLine is called
+  mutable vector<uint32_t> newlines;
+  mutable bool newlinesIndexed = false;
 };
 
 class MemorySource : public ISource
 {
 public:
   MemorySource(const char *beg, int size = -1);
-
-  void Reset(Pos p);
-
-  Pos GetPos() const;
-  string GetRangeContents(Range r) const;
-
-  void Advance();
-  uint32_t Current();
-  uint32_t Lookahead(size_t n = 1);
-
-  bool GetFinished();
-
-private:
-  const char *beg;
-  const char *ptr;
-  const char *end;
-  uint32_t currentLine;
+  MemorySource(string_view text);
 };
 
 class FileSource : public ISource
@@ -50,21 +51,24 @@ class FileSource : public ISource
 public:
   FileSource(string filename);
 
-  void Reset(Pos p);
-
-  Pos GetPos() const;
-  string GetRangeContents(Range r) const;
-
-  void Advance();
-  uint32_t Current();
-  uint32_t Lookahead(size_t n = 1);
+private:
+  vector<char> buffer;
+};
 
-  bool GetFinished();
+/**
+ * Maps the script file into memory instead of copying it, falls back to
+ * reading it where mmap isn't available.
+ */
+class MappedFileSource : public ISource
+{
+public:
+  MappedFileSource(string filename);
+  ~MappedFileSource();
 
 private:
-  size_t offset;
+  void *mapping;
+  size_t mappingLength;
   vector<char> buffer;
-  uint32_t currentLine;
 };
 }
 
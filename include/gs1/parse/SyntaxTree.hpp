@@ -1,6 +1,7 @@
 #ifndef GS1PARSE_SYNTAXTREE_HPP
 #define GS1PARSE_SYNTAXTREE_HPP
 
+#include <gs1/common/Arena.hpp>
 #include <gs1/parse/SyntaxTreeVisitor.hpp>
 #include <gs1/parse/Token.hpp>
 
@@ -11,6 +12,38 @@ struct SyntaxTerminal;
 struct Stmt;
 struct Expr;
 
+// Lets passes test a node's concrete type with an integer compare
+enum NodeKind {
+  NodeSyntaxNode,
+
+  NodeStmt,
+  NodeStmtEmpty,
+  NodeStmtBlock,
+  NodeStmtIf,
+  NodeStmtFor,
+  NodeStmtWhile,
+  NodeStmtBreak,
+  NodeStmtContinue,
+  NodeStmtReturn,
+  NodeStmtCommand,
+  NodeStmtFunctionDecl,
+
+  NodeExpr,
+  NodeExprId,
+  NodeExprNumberLiteral,
+  NodeExprStringLiteral,
+  NodeExprList,
+  NodeExprRange,
+  NodeExprUnaryOp,
+  NodeExprBinaryOp,
+  NodeExprTernaryOp,
+  NodeExprIndex,
+  NodeExprIndexDotLookup,
+  NodeExprCall,
+};
+
+const char *GetNodeKindName(NodeKind kind);
+
 // --------------------------------------------------
 // Core syntax tree structure
 // --------------------------------------------------
@@ -27,16 +60,18 @@ struct SyntaxNodeOrTerminal {
 };
 
 struct SyntaxNode : public SyntaxNodeOrTerminal {
+  SyntaxNode(NodeKind kind = NodeSyntaxNode) : kind(kind) {}
+
   virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   virtual Range GetRange() const;
   virtual Range GetFullRange() const;
 
-  virtual std::string GetBaseType() const { return "SyntaxNode"; };
+  bool IsExpr() const { return kind >= NodeExpr; }
+  bool IsLoop() const { return kind == NodeStmtFor || kind == NodeStmtWhile; }
 
-  virtual std::string GetType() const { return "SyntaxNode"; };
-
-  vector<shared_ptr<SyntaxNodeOrTerminal>> children;
+  NodeKind kind;
+  vector<SyntaxNodeOrTerminal *> children;
 };
 
 struct SyntaxTerminal : public SyntaxNodeOrTerminal {
@@ -55,31 +90,29 @@ struct SyntaxTerminal : public SyntaxNodeOrTerminal {
 // --------------------------------------------------
 
 struct Stmt : public SyntaxNode {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
-
-  virtual std::string GetBaseType() const { return "Stmt"; };
+  Stmt(NodeKind kind = NodeStmt) : SyntaxNode(kind) {}
 
-  virtual std::string GetType() const { return "Stmt"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct StmtEmpty : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtEmpty() : Stmt(NodeStmtEmpty) {}
 
-  virtual std::string GetType() const { return "StmtEmpty"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct StmtBlock : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtBlock() : Stmt(NodeStmtBlock) {}
 
-  virtual std::string GetType() const { return "StmtBlock"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   vector<Stmt *> statements;
 };
 
 struct StmtIf : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtIf() : Stmt(NodeStmtIf) {}
 
-  virtual std::string GetType() const { return "StmtIf"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *cond;
   Stmt *thenBody;
@@ -87,14 +120,13 @@ struct StmtIf : public Stmt {
 };
 
 struct StmtLoop : public Stmt {
-  unsigned int breakPosition;
-  unsigned int continuePosition;
+  StmtLoop(NodeKind kind) : Stmt(kind) {}
 };
 
 struct StmtFor : public StmtLoop {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtFor() : StmtLoop(NodeStmtFor) {}
 
-  virtual std::string GetType() const { return "StmtFor"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *init;
   Expr *cond;
@@ -103,45 +135,45 @@ struct StmtFor : public StmtLoop {
 };
 
 struct StmtWhile : public StmtLoop {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtWhile() : StmtLoop(NodeStmtWhile) {}
 
-  virtual std::string GetType() const { return "StmtWhile"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *cond;
   Stmt *body;
 };
 
 struct StmtBreak : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtBreak() : Stmt(NodeStmtBreak) {}
 
-  virtual std::string GetType() const { return "StmtBreak"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct StmtContinue : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtContinue() : Stmt(NodeStmtContinue) {}
 
-  virtual std::string GetType() const { return "StmtContinue"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct StmtReturn : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtReturn() : Stmt(NodeStmtReturn) {}
 
-  virtual std::string GetType() const { return "StmtReturn"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct StmtCommand : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtCommand() : Stmt(NodeStmtCommand) {}
 
-  virtual std::string GetType() const { return "StmtCommand"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *name;
   vector<Expr *> args;
 };
 
 struct StmtFunctionDecl : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  StmtFunctionDecl() : Stmt(NodeStmtFunctionDecl) {}
 
-  virtual std::string GetType() const { return "StmtFunctionDecl"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *name;
   Stmt *body;
@@ -152,58 +184,56 @@ struct StmtFunctionDecl : public Stmt {
 // --------------------------------------------------
 
 struct Expr : public Stmt {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  Expr(NodeKind kind = NodeExpr) : Stmt(kind) {}
 
-  virtual std::string GetBaseType() const { return "Expr"; };
-
-  virtual std::string GetType() const { return "Expr"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 };
 
 struct ExprId : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprId() : Expr(NodeExprId) {}
 
-  virtual std::string GetType() const { return "ExprId"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *name;
 };
 
 struct ExprNumberLiteral : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprNumberLiteral() : Expr(NodeExprNumberLiteral) {}
 
-  virtual std::string GetType() const { return "ExprNumberLiteral"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *literal;
 };
 
 struct ExprStringLiteral : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprStringLiteral() : Expr(NodeExprStringLiteral) {}
 
-  virtual std::string GetType() const { return "ExprStringLiteral"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *literal;
 };
 
 struct ExprList : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprList() : Expr(NodeExprList) {}
 
-  virtual std::string GetType() const { return "ExprList"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   vector<Expr *> elements;
 };
 
 struct ExprRange : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprRange() : Expr(NodeExprRange) {}
 
-  virtual std::string GetType() const { return "ExprRange"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *lower;
   SyntaxTerminal *upper;
 };
 
 struct ExprUnaryOp : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprUnaryOp() : Expr(NodeExprUnaryOp) {}
 
-  virtual std::string GetType() const { return "ExprUnaryOp"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   bool prefix;
   SyntaxTerminal *op;
@@ -211,9 +241,9 @@ struct ExprUnaryOp : public Expr {
 };
 
 struct ExprBinaryOp : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprBinaryOp() : Expr(NodeExprBinaryOp) {}
 
-  virtual std::string GetType() const { return "ExprBinaryOp"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *op;
   Expr *left;
@@ -221,9 +251,9 @@ struct ExprBinaryOp : public Expr {
 };
 
 struct ExprTernaryOp : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprTernaryOp() : Expr(NodeExprTernaryOp) {}
 
-  virtual std::string GetType() const { return "ExprTernaryOp"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *cond;
   Expr *thenValue;
@@ -231,26 +261,26 @@ struct ExprTernaryOp : public Expr {
 };
 
 struct ExprIndex : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprIndex() : Expr(NodeExprIndex) {}
 
-  virtual std::string GetType() const { return "ExprIndex"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *left;
   Expr *index;
 };
 
 struct ExprIndexDotLookup : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprIndexDotLookup() : Expr(NodeExprIndexDotLookup) {}
 
-  virtual std::string GetType() const { return "ExprIndexDotLookup"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   SyntaxTerminal *id;
 };
 
 struct ExprCall : public Expr {
-  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
+  ExprCall() : Expr(NodeExprCall) {}
 
-  virtual std::string GetType() const { return "ExprCall"; };
+  virtual void Accept(SyntaxTreeVisitor *v) { v->Visit(this); }
 
   Expr *left;
   vector<Expr *> args;
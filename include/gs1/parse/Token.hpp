@@ -2,6 +2,7 @@
 #define GS1PARSE_TOKEN_HPP
 
 #include <gs1/common/Util.hpp>
+#include <gs1/parse/Source.hpp>
 
 namespace gs1
 {
@@ -70,12 +71,19 @@ enum TokenType {
   TokOpDecrement,
 };
 
+/**
+ * A token is a small POD record, its text is a view into the source buffer
+ * and its line is resolved through the source when needed.
+ */
 struct Token {
   Token();
-  Token(Range range, string text, TokenType type);
+  Token(uint32_t offset, uint32_t length, TokenType type);
 
-  Range range;
-  string text;
+  Range GetRange() const;
+  string_view GetText(const ISource &source) const;
+
+  uint32_t offset;
+  uint32_t length;
   TokenType type;
 };
 
@@ -1,37 +1,84 @@
 #ifndef GS1VM_BYTECODE_HPP
 #define GS1VM_BYTECODE_HPP
 
+#include <gs1/common/ByteBuffer.hpp>
 #include <gs1/common/ConstantTable.hpp>
+#include <gs1/compiler/BytecodeHeader.hpp>
 
 #include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace gs1
 {
+class BufferReader;
+
+/**
+ * Bytecode ready to run: decoded constant tables and the body in a single
+ * buffer owned by this object. Version 1 bytecode is converted to the
+ * current instruction format as it's loaded.
+ */
 class Bytecode
 {
   friend class Context;
   friend class Device;
+  friend class Verifier;
 
 public:
+  // Decodes serialised bytecode, only the body is copied
   Bytecode(const char *data, int len);
+
+  // Takes the compiler's tables and body as they are, body is left empty
+  Bytecode(const BytecodeHeader &header, ByteBuffer &body);
+
   virtual ~Bytecode();
 
   virtual const char *GetBody();
   virtual unsigned int GetBodyLen();
 
-  virtual const char *GetData();
-  virtual unsigned int GetLen();
+  // Writes the bytecode out in the format Device::LoadBytecode reads
+  ByteBuffer Serialize();
+
+  // Where a script function starts in the body, false if there's no such
+  // function
+  bool GetFunctionOffset(const std::string &name, uint32_t &offset) const;
+
+  // Deepest the stack gets in one call, as the header gives it, checked by
+  // the verifier
+  uint32_t GetMaxStackDepth() const { return maxStackDepth; };
+
+  // How many temps the body uses, known once it's verified
+  uint32_t GetTempCount() const { return tempCount; };
+
+  // Whether the bytecode passed the verifier, Device::LoadBytecode runs it
+  bool IsVerified() const { return verified; };
 
 private:
-  char *body;
+  void LoadV1(BufferReader &reader, const char *data, uint32_t len);
+  void LoadV2(BufferReader &reader, const char *data, uint32_t len);
+
+  // Fills numbers from the number constants
+  void DecodeNumbers();
+
+  std::shared_ptr<ConstantTable<std::string>> stringConstants;
+  std::shared_ptr<ConstantTable<float>> numberConstants;
+
+  ByteBuffer bodyBuffer;
+  const char *body;
   unsigned int bodyLen;
 
-  char *data;
-  unsigned int len;
+  std::map<std::string, uint32_t> functionOffsets;
+  uint32_t maxStackDepth;
+  uint32_t tempCount;
+  bool verified;
+
+  // Version 1 didn't record argument counts, so it can't be verified
+  uint16_t version;
 
-  ConstantTable<std::string> stringConstants;
-  ConstantTable<float> numberConstants;
+  // Number constants as they're pushed, by the same index
+  std::vector<double> numbers;
 };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -11,11 +11,17 @@
 #include <gs1/vm/Stack.hpp>
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+// How deep script functions can call each other before it's taken as
+// runaway recursion
+#define MAX_CALL_DEPTH 1024
+
 namespace gs1
 {
 class Device;
+struct PrototypeSet;
 
 enum UnpackType {
   UNPACK_NUMBER,
@@ -99,9 +105,16 @@ public:
   void LinkVarStore(std::shared_ptr<GVarStore> varstore, std::string prefix);
   void LinkLibrary(std::shared_ptr<GLibrary> library);
 
+  // Commands and functions expressions given to Eval are compiled against
+  void SetPrototypes(std::shared_ptr<const PrototypeSet> prototypes);
+
   GValue UnpackValue(const PackedValue &value,
                      const UnpackType type = UNPACK_ANY);
 
+  // A named value's number, as reading the value UnpackValue gives as a
+  // number would, without wrapping it in a variable
+  double UnpackNumber(const PackedValue &value);
+
   GValue GetVariableValue(const std::string &name, const GVarType &type);
   GVariable *GetVariable(const std::string &name, const GVarType &type);
   void SetVariable(const std::string &name, const GVarType &type,
@@ -110,28 +123,78 @@ public:
   std::string InterpolateString(std::string string);
 
   void CallCommand(const std::string &name);
-  void CallFunction(const std::string &name);
+  // False if no linked library has the function
+  bool CallFunction(const std::string &name);
 
-  void BranchAndLink(const uint32_t &offset);
+  // Calls the script function at offset, dropping its arguments
+  void BranchAndLink(const uint32_t &offset, uint32_t argCount = 0);
+
+  // Returns from a script function, or halts outside of one
   void Return();
 
-  void Eval(const std::string &code, const Stack &stack);
+  // Runs a single expression against this context's variables and returns
+  // its value as a number. The compiled snippet is cached by the device.
+  // Throws if the expression doesn't compile.
+  GValue Eval(const std::string &expression);
+
   void Run(GVarStore *eventFlags = nullptr);
 
+  // Runs only the named script function of the linked bytecode, with args
+  // pushed as a script call would, and returns the call's value. Throws if
+  // no linked bytecode has the function.
+  GValue CallScriptFunction(const std::string &name,
+                            const std::vector<GValue> &args = {},
+                            GVarStore *eventFlags = nullptr);
+
   void Halt();
 
   // Stack used for operations
   Stack stack;
 
 private:
+  // Finds the varstore holding a variable, or nullptr
+  GVarStore *FindVarStore(const std::string &name, const GVarType &type);
+
+  // A variable's number, NaN if it's of another type and 0 if it's missing
+  double ReadNumber(const std::string &name);
+
+  // Adds one to the number variable named by a string constant, as ++
+  // would, and returns whether it's then less than a number constant
+  bool StepCounter(uint32_t nameIndex, uint32_t boundIndex);
+
+  // Wraps a variable in a named value which can be assigned to
+  GValue GetNamedValue(const std::string &name, const GVarType &type,
+                       GVarStore *varStore);
+
+  // Pushes zeroes or pops until the stack holds size values, for
+  // natives which don't take and leave what the bytecode expects. The top
+  // value can be kept, in place of those popped under it.
+  void SettleStack(int size, bool keepTop = false);
+
+  // Makes room for the temps of currentBytecode, and for its stack on top of
+  // what's already there
+  void Reserve();
+
+  // Dispatch loops for Run, only bytecode which hasn't been verified is
+  // checked as it goes
+  void RunVerified(const char *endPos);
+  void RunChecked(const char *startPos, const char *endPos);
+
   // The bytecode currently being ran
   std::shared_ptr<Bytecode> currentBytecode;
 
-  // Stack used for branching and linking
+  // Frames of the script functions being run
   JumpStack jumpStack;
 
+  // Numbers kept by OP_STORE_TEMP, shared by every function as the
+  // optimiser never keeps one across a call
+  std::vector<double> temps;
+
   const char *instructionPointer;
 
+  // The instruction being run, handlers read their operands out of it
+  uint32_t instruction;
+
   Device *device;
 
   bool halted;
@@ -144,7 +207,17 @@ private:
   std::vector<ContextLinkedVarstore> linkedVarstores;
   std::vector<ContextLinkedLibrary> linkedLibraries;
 
-  GStringFormatter *stringFormatter;
+  std::shared_ptr<const PrototypeSet> prototypes;
+
+  // Where CallScriptFunction found functions, kept until bytecode is linked
+  struct ScriptFunction {
+    std::shared_ptr<Bytecode> bytecode;
+    uint32_t offset;
+  };
+
+  std::unordered_map<std::string, ScriptFunction> scriptFunctions;
+
+  std::unique_ptr<GStringFormatter> stringFormatter;
 
   GVarStore *eventFlags;
 };
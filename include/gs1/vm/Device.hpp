@@ -3,8 +3,10 @@
 
 #include <gs1/common/ByteBuffer.hpp>
 #include <gs1/common/Log.hpp>
+#include <gs1/compiler/CompilerSession.hpp>
 #include <gs1/parse/Parser.hpp>
 #include <gs1/vm/Context.hpp>
+#include <gs1/vm/SnippetCache.hpp>
 
 namespace gs1
 {
@@ -30,17 +32,41 @@ public:
     return libraries[name];
   };
 
+  // Bytecode is verified as it's loaded, an Exception is thrown if it fails
   std::shared_ptr<Bytecode> LoadBytecode(const char *data, unsigned int len);
 
+  // Takes the output of the session's last compile as is, nothing gets
+  // serialised or copied
+  std::shared_ptr<Bytecode> LoadBytecode(CompilerSession &session);
+
+  // Compiled bytecode for an expression given to Context::Eval, from the
+  // snippet cache when it's been compiled before
+  std::shared_ptr<Bytecode>
+  LoadSnippet(const std::string &expression,
+              const std::shared_ptr<const PrototypeSet> &prototypes);
+
+  // How many compiled snippets are kept, SNIPPET_CACHE_SIZE by default
+  void SetSnippetCacheSize(size_t size);
+
   std::shared_ptr<GVarStore> CreateVarStore();
 
+  // Both modes produce the same bytecode. These set up a new session each
+  // call and log diagnostics, use a CompilerSession directly to compile many
+  // scripts.
   ByteBuffer CompileSourceFromString(std::string str, PrototypeMap cmds,
-                                     PrototypeMap funcs);
+                                     PrototypeMap funcs,
+                                     CompileMode mode = COMPILEMODE_STREAM);
   ByteBuffer CompileSourceFromFile(std::string path, PrototypeMap cmds,
-                                   PrototypeMap funcs);
+                                   PrototypeMap funcs,
+                                   CompileMode mode = COMPILEMODE_STREAM);
 
 private:
+  ByteBuffer CompileSource(ISource &source, const PrototypeMap &cmds,
+                           const PrototypeMap &funcs, CompileMode mode);
+
   std::unordered_map<std::string, std::shared_ptr<GLibrary>> libraries;
+
+  SnippetCache snippets;
 };
 };
 
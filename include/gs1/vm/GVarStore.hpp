@@ -8,22 +8,63 @@
 #include <cmath>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace gs1
 {
 class GValue;
 class ContextLinkedBytecode;
 
+/**
+ * A single variable in a type bank.
+ *
+ * Numbers and flags are stored unboxed in "value". A GVariable is only
+ * materialised for them once a host asks for one through GetVariable, from
+ * then on the materialised variable is authoritative and kept in sync.
+ *
+ * Strings and arrays always live in "variable".
+ */
+struct GVarSlot {
+  GVarSlot() : variable(nullptr){};
+
+  GValue value;
+  GVariable *variable;
+};
+
 struct TypeBank {
   TypeBank(){};
 
   ~TypeBank()
   {
-    for (auto &var : variables)
-      delete var.second;
+    for (auto &slot : slots)
+      delete slot.variable;
+  };
+
+  GVarSlot *Find(const std::string &name)
+  {
+    auto itr = slotIndices.find(name);
+
+    if (itr == slotIndices.end())
+      return nullptr;
+
+    return &slots[itr->second];
+  };
+
+  GVarSlot &FindOrCreate(const std::string &name)
+  {
+    auto itr = slotIndices.find(name);
+
+    if (itr != slotIndices.end())
+      return slots[itr->second];
+
+    slotIndices[name] = slots.size();
+    slots.emplace_back();
+
+    return slots.back();
   };
 
-  std::unordered_map<std::string, GVariable *> variables;
+  std::vector<GVarSlot> slots;
+  std::unordered_map<std::string, uint32_t> slotIndices;
 };
 
 class GVarStore
@@ -41,8 +82,8 @@ public:
                 const GValue &value);
 
 private:
-  std::unordered_map<int, TypeBank *> typeBanks;
+  TypeBank typeBanks[GVARTYPE_NUM_TYPES];
 };
 };
 
-#endif
\ No newline at end of file
+#endif
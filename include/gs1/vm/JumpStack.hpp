@@ -1,43 +1,49 @@
 #ifndef GS1VM_JUMP_STACK_HPP
 #define GS1VM_JUMP_STACK_HPP
 
-/**
- * TODO:
- * This whole thing should be optimized. It's going to be used very
- * frequently and the extra copies done here are going to be costly.
- *
- * We should allocate a fixed region of memory on the heap. Use that
- * instead, just keep track of the endpoint and shift it, no need to
- * clear or copy variables unnessecarily like std::stack does.
- */
-
-#include <stack>
+#include <stdint.h>
+#include <vector>
 
 namespace gs1
 {
 class Context;
 
+// Where a script function call returns to, and how high the operand stack
+// was when it was made
+struct CallFrame {
+  CallFrame(uint32_t returnOffset, int stackBase)
+      : returnOffset(returnOffset), stackBase(stackBase)
+  {
+  }
+
+  uint32_t returnOffset;
+  int stackBase;
+};
+
 class JumpStack
 {
 public:
   JumpStack(){};
   ~JumpStack(){};
 
-  void Push(uint32_t offset) { stack.push(offset); };
+  void Push(const CallFrame &frame) { frames.push_back(frame); };
 
-  uint32_t Pop()
+  CallFrame Pop()
   {
-    uint32_t value = stack.top();
-    stack.pop();
+    CallFrame frame = frames.back();
+    frames.pop_back();
 
-    return value;
+    return frame;
   };
 
-  int Size() { return stack.size(); };
+  int Size() { return frames.size(); };
+
+  // Drops every frame, keeping the storage
+  void Clear() { frames.clear(); };
 
 private:
-  std::stack<uint32_t> stack;
+  std::vector<CallFrame> frames;
 };
 };
 
-#endif
\ No newline at end of file
+#endif
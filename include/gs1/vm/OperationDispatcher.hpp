@@ -16,8 +16,12 @@ public:
   OperationDispatcher();
   ~OperationDispatcher();
 
+  // Throws if there's no handler for op
   void Dispatch(Context *context, Bytecode &bytecode, const Opcode &op);
 
+  // For verified bytecode, which only holds opcodes with handlers
+  void DispatchVerified(Context *context, const Opcode &op);
+
 private:
 };
 };
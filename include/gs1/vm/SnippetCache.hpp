@@ -0,0 +1,70 @@
+#ifndef GS1VM_SNIPPETCACHE_HPP
+#define GS1VM_SNIPPETCACHE_HPP
+
+#include <gs1/parse/Parser.hpp>
+#include <gs1/vm/Bytecode.hpp>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// How many compiled snippets are kept by default
+#define SNIPPET_CACHE_SIZE 256
+
+namespace gs1
+{
+// Prototypes snippets are compiled against. Contexts which share one share
+// their compiled snippets too.
+struct PrototypeSet {
+  PrototypeMap commands;
+  PrototypeMap functions;
+};
+
+/**
+ * Compiled bytecode for the expressions Context::Eval is given, by their
+ * text and prototype set. Only the most recently used snippets are kept.
+ */
+class SnippetCache
+{
+public:
+  SnippetCache(size_t capacity = SNIPPET_CACHE_SIZE);
+
+  // Compiles and verifies the snippet unless it's cached. Throws if it
+  // doesn't compile, failures are cached too and thrown again without
+  // compiling the snippet again.
+  std::shared_ptr<Bytecode>
+  Get(const std::string &expression,
+      const std::shared_ptr<const PrototypeSet> &prototypes);
+
+  // Drops the least recently used snippets past the new capacity
+  void SetCapacity(size_t capacity);
+
+  size_t GetSize() const { return entries.size(); };
+
+private:
+  struct Entry {
+    std::string key;
+
+    // Null for snippets which didn't compile, error says why
+    std::shared_ptr<Bytecode> bytecode;
+    std::string error;
+
+    // Keeps the set alive, so its address can't be reused in another key
+    std::shared_ptr<const PrototypeSet> prototypes;
+  };
+
+  // Throws if the snippet doesn't compile or verify
+  std::shared_ptr<Bytecode> Compile(const std::string &expression,
+                                    const PrototypeSet &prototypes);
+
+  void Trim();
+
+  size_t capacity;
+
+  // Most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+}
+
+#endif
@@ -1,19 +1,9 @@
 #ifndef GS1VM_STACK_HPP
 #define GS1VM_STACK_HPP
 
-/**
- * TODO:
- * This whole thing should be optimized. It's going to be used very
- * frequently and the extra copies done here are going to be costly.
- *
- * We should allocate a fixed region of memory on the heap. Use that
- * instead, just keep track of the endpoint and shift it, no need to
- * clear or copy variables unnessecarily like std::stack does.
- */
-
 #include <gs1/common/GValue.hpp>
 
-#include <stack>
+#include <vector>
 
 namespace gs1
 {
@@ -25,21 +15,38 @@ public:
   Stack(){};
   ~Stack(){};
 
-  void Push(GValue value) { stack.push(value); };
+  void Push(GValue value) { stack.push_back(value); };
 
   GValue Pop()
   {
-    GValue value = stack.top();
-    stack.pop();
+    GValue value = stack.back();
+    stack.pop_back();
 
     return value;
   };
 
+  // Pops a value known to be a number, without checking it is one
+  double PopNumber()
+  {
+    double number = stack.back().GetNumberUnchecked();
+    stack.pop_back();
+
+    return number;
+  };
+
+  // Reads the top value as a number without popping or checking it
+  double PeekNumber() { return stack.back().GetNumberUnchecked(); };
+
   int Size() { return stack.size(); };
 
+  // Makes room for size values, pushes up to it don't reallocate
+  void Reserve(size_t size) { stack.reserve(size); };
+
 private:
-  std::stack<GValue> stack;
+  // Values are copied when the vector grows, variables along with them, so
+  // it's reserved up front
+  std::vector<GValue> stack;
 };
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,48 @@
+#ifndef GS1VM_VERIFIER_HPP
+#define GS1VM_VERIFIER_HPP
+
+#include <gs1/vm/Bytecode.hpp>
+
+#include <vector>
+
+namespace gs1
+{
+/**
+ * Checks bytecode before it's run: every opcode has a handler, operands
+ * index into their constant tables, jumps land on instructions and the
+ * stack never underflows, has the same depth wherever paths meet and gets
+ * as deep as the bytecode says. Bytecode which passes is run without checks
+ * per instruction. Operands of the number opcodes aren't typed, anything
+ * else just reads as some number, and temps read before they're stored
+ * read as 0.
+ */
+class Verifier
+{
+public:
+  Verifier(Bytecode &bytecode);
+
+  // Throws an Exception for the first problem found, marks the bytecode
+  // verified otherwise
+  void Verify();
+
+private:
+  // Walks the body in order, checking each instruction on its own
+  void CheckInstructions();
+
+  // Follows every path through the body, checking the stack depth and
+  // that the bytecode gives the deepest it gets
+  void CheckStack();
+
+  void CheckPacked(uint32_t pos, const PackedValue &value);
+  void CheckTarget(uint32_t pos, int64_t target);
+
+  Bytecode &bytecode;
+  const char *code;
+  uint32_t len;
+
+  // Per word of the body, whether an instruction starts there
+  std::vector<bool> boundaries;
+};
+}
+
+#endif
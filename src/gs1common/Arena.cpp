@@ -0,0 +1,92 @@
+#include <gs1/common/Arena.hpp>
+
+#include <cstdlib>
+
+using namespace gs1;
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize), bytesUsed(0), blocks(nullptr), ptr(nullptr),
+      end(nullptr), destructors(nullptr)
+{
+}
+
+Arena::~Arena()
+{
+  RunDestructors();
+
+  while (blocks != nullptr) {
+    Block *next = blocks->next;
+    free(blocks);
+    blocks = next;
+  }
+}
+
+void *Arena::Allocate(size_t size, size_t alignment)
+{
+  uintptr_t aligned = ((uintptr_t)ptr + alignment - 1) & ~(alignment - 1);
+
+  if (ptr == nullptr || aligned + size > (uintptr_t)end) {
+    AddBlock(size + alignment);
+    aligned = ((uintptr_t)ptr + alignment - 1) & ~(alignment - 1);
+  }
+
+  ptr = (char *)(aligned + size);
+  bytesUsed += size;
+
+  return (void *)aligned;
+}
+
+void Arena::Reset()
+{
+  RunDestructors();
+
+  if (blocks == nullptr)
+    return;
+
+  // The oldest block is the only one guaranteed to be of the default size
+  while (blocks->next != nullptr) {
+    Block *next = blocks->next;
+    free(blocks);
+    blocks = next;
+  }
+
+  ptr = (char *)(blocks + 1);
+  end = ptr + blocks->size;
+  bytesUsed = 0;
+}
+
+void Arena::AddDestructor(void *object, void (*destroy)(void *))
+{
+  auto destructor = (Destructor *)Allocate(sizeof(Destructor),
+                                           alignof(Destructor));
+  destructor->next = destructors;
+  destructor->destroy = destroy;
+  destructor->object = object;
+  destructors = destructor;
+}
+
+void Arena::AddBlock(size_t minSize)
+{
+  size_t size = minSize > blockSize ? minSize : blockSize;
+  auto block = (Block *)malloc(sizeof(Block) + size);
+
+  if (block == nullptr)
+    throw Exception("arena couldn't allocate %u bytes", (uint32_t)size);
+
+  block->next = blocks;
+  block->size = size;
+  blocks = block;
+
+  ptr = (char *)(block + 1);
+  end = ptr + size;
+}
+
+void Arena::RunDestructors()
+{
+  // Newest first, the reverse of construction
+  while (destructors != nullptr) {
+    Destructor *next = destructors->next;
+    destructors->destroy(destructors->object);
+    destructors = next;
+  }
+}
@@ -0,0 +1,169 @@
+#include <gs1/common/ArrayKernels.hpp>
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GS1_ARRAYKERNELS_SSE2
+#endif
+
+using namespace gs1;
+
+void gs1::ArrayFill(double *dst, uint32_t count, double value)
+{
+  uint32_t i = 0;
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  __m128d fill = _mm_set1_pd(value);
+
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_pd(dst + i, fill);
+    _mm_storeu_pd(dst + i + 2, fill);
+  }
+#endif
+
+  for (; i < count; ++i)
+    dst[i] = value;
+}
+
+void gs1::ArrayCopy(double *dst, const double *src, uint32_t count)
+{
+  memmove(dst, src, count * sizeof(double));
+}
+
+void gs1::ArrayScale(double *dst, uint32_t count, double factor)
+{
+  uint32_t i = 0;
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  __m128d scale = _mm_set1_pd(factor);
+
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(dst + i), scale));
+    _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_loadu_pd(dst + i + 2), scale));
+  }
+#endif
+
+  for (; i < count; ++i)
+    dst[i] *= factor;
+}
+
+double gs1::ArraySum(const double *src, uint32_t count)
+{
+  uint32_t i = 0;
+  double sum = 0.0;
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  // Two accumulators to hide the latency of the adds
+  __m128d sumA = _mm_setzero_pd();
+  __m128d sumB = _mm_setzero_pd();
+
+  for (; i + 4 <= count; i += 4) {
+    sumA = _mm_add_pd(sumA, _mm_loadu_pd(src + i));
+    sumB = _mm_add_pd(sumB, _mm_loadu_pd(src + i + 2));
+  }
+
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(sumA, sumB));
+  sum = lanes[0] + lanes[1];
+#endif
+
+  for (; i < count; ++i)
+    sum += src[i];
+
+  return sum;
+}
+
+double gs1::ArrayMin(const double *src, uint32_t count)
+{
+  if (count == 0)
+    return 0.0;
+
+  uint32_t i = 1;
+  double min = src[0];
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  if (count >= 4) {
+    __m128d minA = _mm_loadu_pd(src);
+    __m128d minB = _mm_loadu_pd(src + 2);
+
+    for (i = 4; i + 4 <= count; i += 4) {
+      minA = _mm_min_pd(minA, _mm_loadu_pd(src + i));
+      minB = _mm_min_pd(minB, _mm_loadu_pd(src + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_min_pd(minA, minB));
+    min = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+  }
+#endif
+
+  for (; i < count; ++i) {
+    if (src[i] < min)
+      min = src[i];
+  }
+
+  return min;
+}
+
+double gs1::ArrayMax(const double *src, uint32_t count)
+{
+  if (count == 0)
+    return 0.0;
+
+  uint32_t i = 1;
+  double max = src[0];
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  if (count >= 4) {
+    __m128d maxA = _mm_loadu_pd(src);
+    __m128d maxB = _mm_loadu_pd(src + 2);
+
+    for (i = 4; i + 4 <= count; i += 4) {
+      maxA = _mm_max_pd(maxA, _mm_loadu_pd(src + i));
+      maxB = _mm_max_pd(maxB, _mm_loadu_pd(src + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_max_pd(maxA, maxB));
+    max = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+  }
+#endif
+
+  for (; i < count; ++i) {
+    if (src[i] > max)
+      max = src[i];
+  }
+
+  return max;
+}
+
+int32_t gs1::ArrayIndexOf(const double *src, uint32_t count, double value)
+{
+  uint32_t i = 0;
+
+#ifdef GS1_ARRAYKERNELS_SSE2
+  __m128d needle = _mm_set1_pd(value);
+
+  for (; i + 4 <= count; i += 4) {
+    int maskA = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(src + i), needle));
+    int maskB =
+        _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(src + i + 2), needle));
+
+    if (maskA | maskB) {
+      if (maskA)
+        return i + ((maskA & 1) ? 0 : 1);
+
+      return i + 2 + ((maskB & 1) ? 0 : 1);
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    if (src[i] == value)
+      return i;
+  }
+
+  return -1;
+}
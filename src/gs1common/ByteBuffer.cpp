@@ -4,170 +4,155 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_LEN_INITIAL 4096
+// Nothing is allocated until the first write
+#define MAX_LEN_INITIAL 64
 
 using namespace gs1;
 
-/**
- * This is a byte-buffer that enforces little-endian
- */
+ByteBuffer::ByteBuffer() : bytes(nullptr), len(0), maxLen(0) {}
 
-ByteBuffer::ByteBuffer() : len(0), maxLen(MAX_LEN_INITIAL)
+ByteBuffer::ByteBuffer(const ByteBuffer &other)
+    : bytes(nullptr), len(0), maxLen(0)
 {
-  bytes = (char *)malloc(maxLen * sizeof(char));
-
-  // Check machine endianness
-  char swapTest[2] = {1, 0};
-  if (*(short *)swapTest == 1)
-    isBigEndian = false;
-  else
-    isBigEndian = true;
+  // Only what's been written is copied, not the spare capacity
+  if (other.len > 0) {
+    Grow(other.len);
+    memcpy(bytes, other.bytes, other.len);
+    len = other.len;
+  }
 }
 
-ByteBuffer::ByteBuffer(const ByteBuffer &other)
-    : len(other.len), maxLen(other.maxLen)
+ByteBuffer::ByteBuffer(ByteBuffer &&other) noexcept
+    : bytes(other.bytes), len(other.len), maxLen(other.maxLen)
 {
-  bytes = (char *)malloc(maxLen * sizeof(char));
-
-  memcpy(bytes, other.bytes, len);
+  other.bytes = nullptr;
+  other.len = 0;
+  other.maxLen = 0;
 }
 
 ByteBuffer::~ByteBuffer() { free(bytes); }
 
-void ByteBuffer::Write8(const int8_t &value, int32_t offset)
+char *ByteBuffer::Prepare(uint32_t size, int32_t offset)
 {
   if (offset < 0) {
-    if (len < maxLen)
-      bytes[len++] = value;
-    else {
-      maxLen *= 2;
+    if (maxLen - len < size)
+      Grow(len + size);
 
-      bytes = (char *)realloc(bytes, maxLen * sizeof(char));
+    char *out = bytes + len;
+    len += size;
 
-      Write8(value);
-    }
-  } else {
-    bytes[offset] = value;
+    return out;
   }
+
+  if ((uint32_t)offset > len || len - offset < size)
+    throw Exception("write of %u bytes at %d is past the end (%u)", size,
+                    offset, len);
+
+  return bytes + offset;
 }
 
-void ByteBuffer::WriteU8(const uint8_t &value, int32_t offset)
+void ByteBuffer::Grow(unsigned int minCapacity)
 {
-  if (offset < 0) {
-    if (len < maxLen)
-      bytes[len++] = value;
-    else {
-      maxLen *= 2;
+  unsigned int capacity = maxLen < MAX_LEN_INITIAL ? MAX_LEN_INITIAL : maxLen;
 
-      bytes = (char *)realloc(bytes, maxLen * sizeof(char));
-
-      WriteU8(value);
+  while (capacity < minCapacity) {
+    if (capacity > UINT32_MAX / 2) {
+      capacity = minCapacity;
+      break;
     }
-  } else {
-    bytes[offset] = value;
+
+    capacity *= 2;
   }
+
+  char *grown = (char *)realloc(bytes, capacity);
+
+  if (grown == nullptr)
+    throw Exception("byte buffer couldn't allocate %u bytes", capacity);
+
+  bytes = grown;
+  maxLen = capacity;
 }
 
-void ByteBuffer::Write16(const int16_t &value, int32_t offset)
+void ByteBuffer::Write8(const int8_t &value, int32_t offset)
 {
-  if (isBigEndian) {
-#ifdef _MSC_VER
-    int16_t swap = _byteswap_ushort(value);
-#else
-    int16_t swap = bswap_16(value);
-#endif
+  *Prepare(1, offset) = (char)value;
+}
 
-    Write8(((char *)&swap)[0], offset);
-    Write8(((char *)&swap)[1], offset + 1);
-  } else {
-    Write8(((char *)&value)[0], offset);
-    Write8(((char *)&value)[1], offset + 1);
-  }
+void ByteBuffer::WriteU8(const uint8_t &value, int32_t offset)
+{
+  *Prepare(1, offset) = (char)value;
+}
+
+void ByteBuffer::Write16(const int16_t &value, int32_t offset)
+{
+  WriteU16((uint16_t)value, offset);
 }
 
 void ByteBuffer::WriteU16(const uint16_t &value, int32_t offset)
 {
-  if (isBigEndian) {
-#ifdef _MSC_VER
-    int16_t swap = _byteswap_ushort(value);
+#if GS1_BIG_ENDIAN
+  uint16_t out = bswap_16(value);
 #else
-    int16_t swap = bswap_16(value);
+  uint16_t out = value;
 #endif
 
-    WriteU8(((unsigned char *)&swap)[0], offset);
-    WriteU8(((unsigned char *)&swap)[1], offset + 1);
-  } else {
-    WriteU8(((unsigned char *)&value)[0], offset);
-    WriteU8(((unsigned char *)&value)[1], offset + 1);
-  }
+  memcpy(Prepare(2, offset), &out, 2);
 }
 
 void ByteBuffer::Write32(const int32_t &value, int32_t offset)
 {
-  if (isBigEndian) {
-#ifdef _MSC_VER
-    int16_t swap = _byteswap_ulong(value);
-#else
-    int16_t swap = bswap_32(value);
-#endif
-
-    Write8(((char *)&swap)[0], offset);
-    Write8(((char *)&swap)[1], offset + 1);
-    Write8(((char *)&swap)[2], offset + 2);
-    Write8(((char *)&swap)[3], offset + 3);
-  } else {
-    Write8(((char *)&value)[0], offset);
-    Write8(((char *)&value)[1], offset + 1);
-    Write8(((char *)&value)[2], offset + 2);
-    Write8(((char *)&value)[3], offset + 3);
-  }
+  WriteU32((uint32_t)value, offset);
 }
 
 void ByteBuffer::WriteU32(const uint32_t &value, int32_t offset)
 {
-  if (isBigEndian) {
-#ifdef _MSC_VER
-    int16_t swap = _byteswap_ulong(value);
+#if GS1_BIG_ENDIAN
+  uint32_t out = bswap_32(value);
 #else
-    int16_t swap = bswap_32(value);
+  uint32_t out = value;
 #endif
 
-    WriteU8(((unsigned char *)&swap)[0], offset);
-    WriteU8(((unsigned char *)&swap)[1], offset + 1);
-    WriteU8(((unsigned char *)&swap)[2], offset + 2);
-    WriteU8(((unsigned char *)&swap)[3], offset + 3);
-  } else {
-    WriteU8(((unsigned char *)&value)[0], offset);
-    WriteU8(((unsigned char *)&value)[1], offset + 1);
-    WriteU8(((unsigned char *)&value)[2], offset + 2);
-    WriteU8(((unsigned char *)&value)[3], offset + 3);
-  }
+  memcpy(Prepare(4, offset), &out, 4);
+}
+
+void ByteBuffer::WriteFloat(const float &value, int32_t offset)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+
+  WriteU32(bits, offset);
 }
 
 void ByteBuffer::WriteString(const std::string &value)
 {
   WriteU32(value.length());
-
-  for (int i = 0; i < value.length(); ++i)
-    WriteU8(value[i]);
+  WriteBytes(value.data(), value.length());
 }
 
 void ByteBuffer::WriteBytes(const char *bytes, const unsigned int &length)
 {
-  for (int i = 0; i < length; ++i)
-    WriteU8(bytes[i]);
+  if (length > 0)
+    memcpy(Prepare(length, BYTEBUFFER_OFFSET_NONE), bytes, length);
 }
 
 unsigned int ByteBuffer::Reserve(const uint32_t &size)
 {
   unsigned int offset = len;
 
-  for (unsigned int i = 0; i < size; i++)
-    WriteU8(0);
+  if (size > 0)
+    memset(Prepare(size, BYTEBUFFER_OFFSET_NONE), 0, size);
 
   return offset;
 }
 
-char *ByteBuffer::GetBytes() { return bytes; }
+void ByteBuffer::EnsureCapacity(unsigned int capacity)
+{
+  if (capacity > maxLen)
+    Grow(capacity);
+}
 
-unsigned int ByteBuffer::GetLength() { return len; }
\ No newline at end of file
+void ByteBuffer::Truncate(unsigned int length)
+{
+  if (length < len)
+    len = length;
+}
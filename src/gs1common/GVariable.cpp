@@ -0,0 +1,190 @@
+#include <gs1/common/ArrayKernels.hpp>
+#include <gs1/common/GVariable.hpp>
+
+using namespace gs1;
+
+static bool IsNumberValue(const GValue &value)
+{
+  if (value.GetValueType() == GVALUETYPE_NUMBER)
+    return true;
+
+  GVariable *variable = value.GetVariable();
+
+  return variable != nullptr && variable->GetVarType() == GVARTYPE_NUMBER;
+}
+
+void GArrayVariable::Resize(uint32_t size)
+{
+  if (numeric)
+    numbers.resize(size, 0.0);
+  else
+    values.resize(size, GValue(0.0));
+}
+
+GValue GArrayVariable::Get(uint32_t index) const
+{
+  if (index >= size())
+    return GValue(0.0);
+
+  if (numeric)
+    return GValue(numbers[index]);
+
+  return values[index];
+}
+
+double GArrayVariable::GetNumber(uint32_t index) const
+{
+  if (index >= size())
+    return 0.0;
+
+  if (numeric)
+    return numbers[index];
+
+  return values[index].GetNumber();
+}
+
+void GArrayVariable::Set(uint32_t index, const GValue &value)
+{
+  if (index >= size())
+    return;
+
+  if (numeric) {
+    if (IsNumberValue(value)) {
+      numbers[index] = value.GetNumber();
+      return;
+    }
+
+    Promote();
+  }
+
+  values[index] = value;
+}
+
+void GArrayVariable::SetNumber(uint32_t index, double value)
+{
+  if (index >= size())
+    return;
+
+  if (numeric)
+    numbers[index] = value;
+  else
+    values[index] = GValue(value);
+}
+
+void GArrayVariable::Fill(double value)
+{
+  // Every element becomes a number, so generic arrays turn dense again
+  if (!numeric) {
+    numbers.resize(values.size());
+    values.clear();
+    numeric = true;
+  }
+
+  ArrayFill(numbers.data(), numbers.size(), value);
+}
+
+void GArrayVariable::Scale(double factor)
+{
+  if (!numeric) {
+    numbers.resize(values.size());
+
+    for (size_t i = 0; i < values.size(); ++i)
+      numbers[i] = values[i].GetNumber();
+
+    values.clear();
+    numeric = true;
+  }
+
+  ArrayScale(numbers.data(), numbers.size(), factor);
+}
+
+void GArrayVariable::CopyFrom(const GArrayVariable &other)
+{
+  uint32_t count = size() < other.size() ? size() : other.size();
+
+  if (numeric && other.numeric) {
+    ArrayCopy(numbers.data(), other.numbers.data(), count);
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i)
+    Set(i, other.Get(i));
+}
+
+double GArrayVariable::Sum() const
+{
+  if (numeric)
+    return ArraySum(numbers.data(), numbers.size());
+
+  double sum = 0.0;
+
+  for (auto &value : values)
+    sum += value.GetNumber();
+
+  return sum;
+}
+
+double GArrayVariable::Min() const
+{
+  if (numeric)
+    return ArrayMin(numbers.data(), numbers.size());
+
+  if (values.empty())
+    return 0.0;
+
+  double min = values[0].GetNumber();
+
+  for (auto &value : values) {
+    if (value.GetNumber() < min)
+      min = value.GetNumber();
+  }
+
+  return min;
+}
+
+double GArrayVariable::Max() const
+{
+  if (numeric)
+    return ArrayMax(numbers.data(), numbers.size());
+
+  if (values.empty())
+    return 0.0;
+
+  double max = values[0].GetNumber();
+
+  for (auto &value : values) {
+    if (value.GetNumber() > max)
+      max = value.GetNumber();
+  }
+
+  return max;
+}
+
+int32_t GArrayVariable::IndexOf(double value) const
+{
+  if (numeric)
+    return ArrayIndexOf(numbers.data(), numbers.size(), value);
+
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i].GetNumber() == value)
+      return i;
+  }
+
+  return -1;
+}
+
+void GArrayVariable::Promote()
+{
+  if (!numeric)
+    return;
+
+  values.clear();
+  values.reserve(numbers.size());
+
+  for (auto number : numbers)
+    values.push_back(GValue(number));
+
+  numbers.clear();
+  numbers.shrink_to_fit();
+  numeric = false;
+}
@@ -0,0 +1,378 @@
+#include <gs1/common/Instruction.hpp>
+
+#include <vector>
+
+using namespace gs1;
+
+bool gs1::GetStackUse(Opcode op, int64_t &pops, int64_t &pushes)
+{
+  pops = 0;
+  pushes = 0;
+
+  switch (op) {
+  case OP_ASSIGN:
+    pops = 2;
+    return true;
+
+  case OP_ARR_SET:
+    pops = 3;
+    return true;
+
+  case OP_ARR_GET:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_POW:
+  case OP_EQ:
+  case OP_LT:
+  case OP_GT:
+  case OP_LTE:
+  case OP_GTE:
+  case OP_ADD_NN:
+  case OP_SUB_NN:
+  case OP_MUL_NN:
+  case OP_DIV_NN:
+  case OP_MOD_NN:
+  case OP_POW_NN:
+  case OP_EQ_NN:
+  case OP_LT_NN:
+  case OP_GT_NN:
+  case OP_LTE_NN:
+  case OP_GTE_NN:
+    pops = 2;
+    pushes = 1;
+    return true;
+
+  case OP_INCPUSH:
+  case OP_DECPUSH:
+  case OP_NOT:
+  case OP_STORE_TEMP:
+    pops = 1;
+    pushes = 1;
+    return true;
+
+  case OP_PUSH_NUM:
+  case OP_PUSH0:
+  case OP_PUSH1:
+  case OP_PUSHI:
+  case OP_PUSH_TEMP:
+    pushes = 1;
+    return true;
+
+  case OP_INC:
+  case OP_DEC:
+  case OP_JEZ:
+  case OP_JNZ:
+  case OP_POP:
+    pops = 1;
+    return true;
+
+  case OP_PUSH:
+  case OP_CALL:
+  case OP_JAL:
+    pushes = 1;
+    return true;
+
+  case OP_CMD_CALL:
+  case OP_JMP:
+  case OP_FORLOOP:
+  case OP_RET:
+  case OP_STOP:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+bool gs1::GetInstructionStackUse(const char *code,
+                                 const ConstantTable<float> &numbers,
+                                 int64_t &pops, int64_t &pushes)
+{
+  uint32_t word = ReadInstruction(code);
+  const char *operands = code + INSTRUCTION_SIZE;
+  Opcode op = GetOpcode(word);
+
+  if (!GetStackUse(op, pops, pushes))
+    return false;
+
+  switch (op) {
+  case OP_PUSH: {
+    PackedValue value = ReadPackedOperand(word, operands);
+
+    // Array literals take their elements off the stack
+    if (value.valueType == PACKVALUE_CONST_ARRAY) {
+      if (value.value >= numbers.constants.size())
+        return false;
+
+      pops = (int64_t)numbers.constants[value.value].val;
+    }
+    break;
+  }
+
+  case OP_CALL:
+  case OP_CMD_CALL:
+    ReadPackedOperand(word, operands);
+    [[fallthrough]];
+
+  case OP_JAL:
+    // Calls pop their arguments, the count follows the name
+    pops = ReadInstruction(operands);
+    break;
+
+  default:
+    break;
+  }
+
+  return true;
+}
+
+bool gs1::IsJump(Opcode op)
+{
+  return op == OP_JMP || op == OP_JAL || op == OP_JEZ || op == OP_JNZ ||
+         op == OP_FORLOOP;
+}
+
+Opcode gs1::GetNumberOpcode(Opcode op)
+{
+  switch (op) {
+  case OP_ADD:
+    return OP_ADD_NN;
+  case OP_SUB:
+    return OP_SUB_NN;
+  case OP_MUL:
+    return OP_MUL_NN;
+  case OP_DIV:
+    return OP_DIV_NN;
+  case OP_MOD:
+    return OP_MOD_NN;
+  case OP_POW:
+    return OP_POW_NN;
+  case OP_EQ:
+    return OP_EQ_NN;
+  case OP_LT:
+    return OP_LT_NN;
+  case OP_GT:
+    return OP_GT_NN;
+  case OP_LTE:
+    return OP_LTE_NN;
+  case OP_GTE:
+    return OP_GTE_NN;
+  default:
+    return OP_NUM_OPS;
+  }
+}
+
+unsigned int gs1::GetInstructionSize(const char *code, unsigned int len)
+{
+  if (len < INSTRUCTION_SIZE)
+    return 0;
+
+  uint32_t word = ReadInstruction(code);
+  unsigned int size = INSTRUCTION_SIZE;
+
+  switch (GetOpcode(word)) {
+  case OP_JAL:
+    // Argument count
+    size += INSTRUCTION_SIZE;
+    break;
+
+  case OP_FORLOOP:
+    // Variable name and bound
+    size += 2 * INSTRUCTION_SIZE;
+    break;
+
+  case OP_CALL:
+  case OP_CMD_CALL:
+    // Argument count
+    size += INSTRUCTION_SIZE;
+    [[fallthrough]];
+
+  case OP_PUSH:
+  case OP_PUSH_NUM:
+    if ((word >> 12) == PACKED_INDEX_LONG)
+      size += INSTRUCTION_SIZE;
+    break;
+
+  default:
+    break;
+  }
+
+  return size <= len ? size : 0;
+}
+
+uint32_t gs1::ComputeStackEffect(const char *code, unsigned int len,
+                                 const ConstantTable<float> &numbers)
+{
+  // The code is walked once, in order. Forward jumps leave their depth for
+  // where they land, code only jumps backwards to loop heads it has already
+  // been through.
+  std::vector<int64_t> landingDepth(len / INSTRUCTION_SIZE + 1, -1);
+  int64_t depth = 0;
+  bool fallsThrough = true;
+
+  unsigned int pos = 0;
+  unsigned int size;
+
+  while ((size = GetInstructionSize(code + pos, len - pos)) != 0) {
+    int64_t landing = landingDepth[pos / INSTRUCTION_SIZE];
+
+    // Code after an unconditional jump is only reached by jumping to it
+    if (!fallsThrough)
+      depth = landing > 0 ? landing : 0;
+    else if (landing > depth)
+      depth = landing;
+
+    fallsThrough = true;
+
+    uint32_t word = ReadInstruction(code + pos);
+    Opcode op = GetOpcode(word);
+    int64_t pops, pushes;
+
+    // Anything it can't count is left to the verifier
+    GetInstructionStackUse(code + pos, numbers, pops, pushes);
+
+    depth += pushes - pops;
+
+    if (depth < 0)
+      depth = 0;
+
+    switch (op) {
+    case OP_JMP:
+    case OP_JEZ:
+    case OP_JNZ:
+    case OP_FORLOOP: {
+      int64_t target = (int64_t)pos + GetJumpOffset(word);
+
+      if (target > pos && target <= len) {
+        int64_t &targetDepth = landingDepth[target / INSTRUCTION_SIZE];
+
+        if (depth > targetDepth)
+          targetDepth = depth;
+      }
+
+      fallsThrough = op != OP_JMP;
+      break;
+    }
+
+    case OP_RET:
+    case OP_STOP:
+      fallsThrough = false;
+      break;
+
+    default:
+      break;
+    }
+
+    pos += size;
+  }
+
+  int64_t landing = landingDepth[pos / INSTRUCTION_SIZE];
+
+  if (!fallsThrough)
+    return landing > 0 ? landing : 0;
+
+  return landing > depth ? landing : depth;
+}
+
+bool gs1::ComputeMaxStackDepth(const char *code, unsigned int len,
+                               const ConstantTable<float> &numbers,
+                               const std::map<std::string, uint32_t> &functions,
+                               uint32_t &maxDepth, uint32_t &errorPos)
+{
+  // Depth each word of the body is reached with, -1 until it is
+  std::vector<int64_t> depths(len / INSTRUCTION_SIZE + 1, -1);
+  std::vector<uint32_t> pending;
+
+  maxDepth = 0;
+
+  // Sets the depth at pos, running off the end stops the script whatever is
+  // left on the stack
+  auto reach = [&](int64_t pos, int64_t depth) {
+    if (pos == len)
+      return true;
+
+    if (pos < 0 || pos > len || pos % INSTRUCTION_SIZE != 0)
+      return false;
+
+    int64_t &known = depths[pos / INSTRUCTION_SIZE];
+
+    if (known == -1) {
+      known = depth;
+      pending.push_back(pos);
+    }
+
+    return known == depth;
+  };
+
+  errorPos = 0;
+
+  if (!reach(0, 0))
+    return false;
+
+  for (auto &function : functions) {
+    errorPos = function.second;
+
+    if (!reach(function.second, 0))
+      return false;
+  }
+
+  while (!pending.empty()) {
+    uint32_t pos = pending.back();
+    pending.pop_back();
+
+    errorPos = pos;
+
+    unsigned int size = GetInstructionSize(code + pos, len - pos);
+    int64_t depth = depths[pos / INSTRUCTION_SIZE];
+    int64_t pops, pushes;
+
+    if (size == 0 ||
+        !GetInstructionStackUse(code + pos, numbers, pops, pushes) ||
+        depth < pops)
+      return false;
+
+    depth += pushes - pops;
+
+    // Pops come before pushes, so the depth after is the deepest it gets
+    if (depth > maxDepth)
+      maxDepth = (uint32_t)depth;
+
+    uint32_t word = ReadInstruction(code + pos);
+    int64_t target = (int64_t)pos + GetJumpOffset(word);
+    bool reached;
+
+    switch (GetOpcode(word)) {
+    case OP_JMP:
+      reached = reach(target, depth);
+      break;
+
+    case OP_JEZ:
+    case OP_JNZ:
+    case OP_FORLOOP:
+      reached = reach(target, depth) && reach(pos + size, depth);
+      break;
+
+    case OP_JAL:
+      // The function gets a frame of its own, and returns past the call
+      reached = reach(target, 0) && reach(pos + size, depth);
+      break;
+
+    case OP_RET:
+    case OP_STOP:
+      reached = true;
+      break;
+
+    default:
+      reached = reach(pos + size, depth);
+      break;
+    }
+
+    if (!reached)
+      return false;
+  }
+
+  return true;
+}
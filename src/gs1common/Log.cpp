@@ -22,6 +22,10 @@ void Log::SetLogCallback(std::function<void(LogLevel, char *)> callbackFunc)
 
 void Log::Print(LogLevel level, const char *fmt, ...)
 {
+  // Nothing to format for
+  if (!callback)
+    return;
+
   va_list args;
   va_list args2;
 
@@ -36,6 +40,5 @@ void Log::Print(LogLevel level, const char *fmt, ...)
   std::vsprintf(buff, fmt, args2);
   va_end(args2);
 
-  if (callback)
-    callback(level, buff);
+  callback(level, buff);
 }
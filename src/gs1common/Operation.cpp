@@ -96,6 +96,63 @@ std::string gs1::OpcodeToString(Opcode opcode)
   case OP_DBG_OUT:
     return "OP_DBG_OUT";
 
+  case OP_POP:
+    return "OP_POP";
+
+  case OP_PUSH_NUM:
+    return "OP_PUSH_NUM";
+
+  case OP_ADD_NN:
+    return "OP_ADD_NN";
+
+  case OP_SUB_NN:
+    return "OP_SUB_NN";
+
+  case OP_MUL_NN:
+    return "OP_MUL_NN";
+
+  case OP_DIV_NN:
+    return "OP_DIV_NN";
+
+  case OP_MOD_NN:
+    return "OP_MOD_NN";
+
+  case OP_POW_NN:
+    return "OP_POW_NN";
+
+  case OP_EQ_NN:
+    return "OP_EQ_NN";
+
+  case OP_LT_NN:
+    return "OP_LT_NN";
+
+  case OP_GT_NN:
+    return "OP_GT_NN";
+
+  case OP_LTE_NN:
+    return "OP_LTE_NN";
+
+  case OP_GTE_NN:
+    return "OP_GTE_NN";
+
+  case OP_PUSH0:
+    return "OP_PUSH0";
+
+  case OP_PUSH1:
+    return "OP_PUSH1";
+
+  case OP_PUSHI:
+    return "OP_PUSHI";
+
+  case OP_FORLOOP:
+    return "OP_FORLOOP";
+
+  case OP_STORE_TEMP:
+    return "OP_STORE_TEMP";
+
+  case OP_PUSH_TEMP:
+    return "OP_PUSH_TEMP";
+
   default:
     return "";
   }
@@ -3,6 +3,7 @@
 #include <gs1/compiler/BytecodeBody.hpp>
 
 #include <gs1/common/Log.hpp>
+#include <cmath>
 #include <stdio.h>
 
 using namespace gs1;
@@ -16,7 +17,61 @@ void BytecodeBody::Emit(Opcode op)
   Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT OPER: %s\n",
                    byteBuffer.GetLength(), OpcodeToString(op).c_str());
 
-  byteBuffer.WriteU8(op);
+  byteBuffer.WriteU32(MakeInstruction(op));
+}
+
+void BytecodeBody::Emit(Opcode op, const PackedValue &value)
+{
+  std::string typeString;
+
+  switch (value.valueType) {
+  case PACKVALUE_CONST_NUMBER:
+    typeString = "PACKVALUE_CONST_NUMBER";
+    break;
+
+  case PACKVALUE_CONST_STRING:
+    typeString = "PACKVALUE_CONST_STRING";
+    break;
+
+  case PACKVALUE_CONST_ARRAY:
+    typeString = "PACKVALUE_CONST_ARRAY";
+    break;
+
+  case PACKVALUE_NAMED:
+    typeString = "PACKVALUE_NAMED";
+    break;
+
+  case PACKVALUE_NAMED_VALUE:
+    typeString = "PACKVALUE_NAMED_VALUE";
+    break;
+  }
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT %s %s : %d\n",
+                   byteBuffer.GetLength(), OpcodeToString(op).c_str(),
+                   typeString.c_str(), value.value);
+
+  WritePackedInstruction(byteBuffer, op, value);
+}
+
+void BytecodeBody::EmitNumber(float number, ConstantTable<float> &numbers)
+{
+  if (number == 0.0f && !std::signbit(number)) {
+    Emit(OP_PUSH0);
+  } else if (number == 1.0f) {
+    Emit(OP_PUSH1);
+  } else if (number == std::floor(number) && number >= IMMEDIATE_MIN &&
+             number <= IMMEDIATE_MAX) {
+    int32_t immediate = (int32_t)number;
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT OP_PUSHI : %d\n",
+                     byteBuffer.GetLength(), immediate);
+
+    byteBuffer.WriteU32(
+        MakeInstruction(OP_PUSHI, (uint32_t)immediate & 0xffffff));
+  } else {
+    Emit(OP_PUSH,
+         PackedValue(PACKVALUE_CONST_NUMBER, numbers.GetKey(number).index));
+  }
 }
 
 void BytecodeBody::Emit(int constant)
@@ -35,32 +90,162 @@ void BytecodeBody::Emit(unsigned int constant)
   byteBuffer.WriteU32(constant);
 }
 
-void BytecodeBody::Emit(const PackedValue &value)
+void BytecodeBody::EmitCall(Opcode op, const PackedValue &name,
+                            unsigned int argCount)
 {
-  std::string typeString;
+  Emit(op, name);
+  Emit(argCount);
+}
 
-  switch (value.valueType) {
-  case PACKVALUE_CONST_NUMBER:
-    typeString = "PACKVALUE_CONST_NUMBER";
-    break;
+ExprType BytecodeBody::EmitNumberOp(Opcode op, ExprType left,
+                                    unsigned int leftStart, ExprType right,
+                                    unsigned int rightStart)
+{
+  // The generic operators take variables by their number too, so reading
+  // them as numbers up front doesn't change what they see
+  if (left == EXPRTYPE_VARIABLE)
+    Patch(leftStart, OP_PUSH_NUM);
 
-  case PACKVALUE_CONST_STRING:
-    typeString = "PACKVALUE_CONST_STRING";
-    break;
+  if (right == EXPRTYPE_VARIABLE)
+    Patch(rightStart, OP_PUSH_NUM);
 
-  case PACKVALUE_CONST_ARRAY:
-    typeString = "PACKVALUE_CONST_ARRAY";
-    break;
+  if (left != EXPRTYPE_ANY && right != EXPRTYPE_ANY)
+    Emit(GetNumberOpcode(op));
+  else
+    Emit(op);
 
-  case PACKVALUE_NAMED:
-    typeString = "PACKVALUE_NAMED";
-    break;
+  // Comparisons leave flags
+  switch (op) {
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_POW:
+    return EXPRTYPE_NUMBER;
+
+  default:
+    return EXPRTYPE_ANY;
+  }
+}
+
+void BytecodeBody::EmitDiscard(unsigned int start,
+                               const ConstantTable<float> &numbers)
+{
+  uint32_t count = ComputeStackEffect(byteBuffer.GetBytes() + start,
+                                      byteBuffer.GetLength() - start, numbers);
+
+  for (uint32_t i = 0; i < count; ++i)
+    Emit(OP_POP);
+}
+
+Reservation BytecodeBody::EmitJump(Opcode op)
+{
+  unsigned int position = byteBuffer.GetLength();
+  Emit(op);
+
+  return Reservation(&byteBuffer, position, op);
+}
+
+void BytecodeBody::EmitJump(Opcode op, unsigned int target)
+{
+  Reservation jump = EmitJump(op);
+  jump.Emit((int)target - (int)jump.GetPosition());
+}
+
+void BytecodeBody::EmitForLoopEnd(unsigned int conditionStart,
+                                  unsigned int bodyStart,
+                                  unsigned int stepStart,
+                                  ConstantTable<float> &numbers)
+{
+  const char *code = byteBuffer.GetBytes();
+  unsigned int end = byteBuffer.GetLength();
+
+  // Reads the instruction at pos and moves past it, false if it runs past
+  // limit
+  auto next = [&](unsigned int &pos, unsigned int limit, uint32_t &word,
+                  PackedValue &value) {
+    if (pos >= limit)
+      return false;
+
+    unsigned int size = GetInstructionSize(code + pos, limit - pos);
+
+    if (size == 0)
+      return false;
+
+    word = ReadInstruction(code + pos);
+
+    if (GetOpcode(word) == OP_PUSH || GetOpcode(word) == OP_PUSH_NUM) {
+      const char *operands = code + pos + INSTRUCTION_SIZE;
+      value = ReadPackedOperand(word, operands);
+    }
+
+    pos += size;
+    return true;
+  };
+
+  uint32_t word;
+  PackedValue counter(PACKVALUE_NAMED), value(PACKVALUE_NAMED);
+  float bound;
+  unsigned int pos = conditionStart;
+  unsigned int conditionEnd = bodyStart - INSTRUCTION_SIZE;
+
+  // The condition is "counter < constant" followed by its OP_JEZ
+  bool fused =
+      bodyStart > conditionStart &&
+      GetOpcode(ReadInstruction(code + conditionEnd)) == OP_JEZ &&
+      next(pos, conditionEnd, word, counter) &&
+      GetOpcode(word) == OP_PUSH_NUM &&
+      counter.valueType == PACKVALUE_NAMED &&
+      next(pos, conditionEnd, word, value);
+
+  if (fused) {
+    switch (GetOpcode(word)) {
+    case OP_PUSH0:
+      bound = 0;
+      break;
+
+    case OP_PUSH1:
+      bound = 1;
+      break;
+
+    case OP_PUSHI:
+      bound = (float)GetImmediate(word);
+      break;
+
+    case OP_PUSH:
+      fused = value.valueType == PACKVALUE_CONST_NUMBER;
+
+      if (fused)
+        bound = numbers.constants[value.value].val;
+      break;
+
+    default:
+      fused = false;
+      break;
+    }
   }
 
-  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT %s : %d\n",
-                   byteBuffer.GetLength(), typeString.c_str(), value.value);
+  fused = fused && next(pos, conditionEnd, word, value) &&
+          GetOpcode(word) == OP_LT_NN && pos == conditionEnd;
+
+  // The step is "counter++" on its own
+  pos = stepStart;
+  fused = fused && next(pos, end, word, value) && GetOpcode(word) == OP_PUSH &&
+          value.valueType == PACKVALUE_NAMED && value.value == counter.value &&
+          next(pos, end, word, value) && GetOpcode(word) == OP_INC &&
+          pos == end;
+
+  if (!fused) {
+    EmitJump(OP_JMP, conditionStart);
+    return;
+  }
 
-  byteBuffer.WriteBytes((char *)&value, sizeof(PackedValue));
+  // The counter's name and the bound's constant follow the jump
+  Truncate(stepStart);
+  EmitJump(OP_FORLOOP, bodyStart);
+  Emit((unsigned int)counter.value);
+  Emit((unsigned int)numbers.GetKey(bound).index);
 }
 
 unsigned int BytecodeBody::GetCurrentPosition()
@@ -68,13 +253,10 @@ unsigned int BytecodeBody::GetCurrentPosition()
   return byteBuffer.GetLength();
 }
 
-Reservation BytecodeBody::BeginFunction(std::string name)
+Reservation BytecodeBody::BeginFunction()
 {
   // Emit a jump over the function body
-  Emit(OP_JMP);
-  Reservation offsetReservation = Reserve(4);
-
-  return offsetReservation;
+  return EmitJump(OP_JMP);
 }
 
 void BytecodeBody::EndFunction(Reservation reservation)
@@ -86,11 +268,128 @@ void BytecodeBody::EndFunction(Reservation reservation)
   reservation.Emit(GetCurrentPosition() - reservation.GetPosition());
 }
 
-Reservation BytecodeBody::Reserve(unsigned int numBytes)
+void BytecodeBody::LinkFunctions(
+    const ConstantTable<std::string> &strings,
+    const std::map<std::string, uint32_t> &functions)
+{
+  if (functions.empty())
+    return;
+
+  unsigned int pos = 0;
+  unsigned int size;
+
+  while ((size = GetInstructionSize(byteBuffer.GetBytes() + pos,
+                                    byteBuffer.GetLength() - pos)) != 0) {
+    const char *operands = byteBuffer.GetBytes() + pos + INSTRUCTION_SIZE;
+    uint32_t word = ReadInstruction(byteBuffer.GetBytes() + pos);
+
+    if (GetOpcode(word) == OP_CALL) {
+      PackedValue name = ReadPackedOperand(word, operands);
+      auto itr = functions.find(strings.constants[name.value].val);
+
+      if (itr != functions.end()) {
+        Log::Get().Print(LOGLEVEL_VERBOSE, "%5d LINK CALL %s TO %d\n", pos,
+                         itr->first.c_str(), itr->second);
+
+        // The argument count moves up to follow the jump, a long name leaves
+        // a word over which is skipped
+        uint32_t argCount = ReadInstruction(operands);
+
+        Reservation(&byteBuffer, pos, OP_JAL).Emit((int)itr->second - (int)pos);
+        byteBuffer.WriteU32(argCount, pos + INSTRUCTION_SIZE);
+
+        if (size > 2 * INSTRUCTION_SIZE) {
+          Reservation(&byteBuffer, pos + 2 * INSTRUCTION_SIZE, OP_JMP)
+              .Emit(INSTRUCTION_SIZE);
+        }
+      }
+    }
+
+    pos += size;
+  }
+}
+
+void BytecodeBody::EmitCopy(unsigned int start, unsigned int end)
+{
+  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT COPY %d TO %d\n",
+                   byteBuffer.GetLength(), start, end);
+
+  // Writing may move the buffer, so copy out of it first
+  std::string bytes(byteBuffer.GetBytes() + start, end - start);
+  byteBuffer.WriteBytes(bytes.data(), bytes.size());
+}
+
+void BytecodeBody::Patch(unsigned int position, Opcode op)
+{
+  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d PATCH OPER: %s\n", position,
+                   OpcodeToString(op).c_str());
+
+  byteBuffer.WriteU8(op, position);
+}
+
+void BytecodeBody::PatchRead(ExprType type, unsigned int start)
+{
+  if (type != EXPRTYPE_VARIABLE)
+    return;
+
+  const char *code = byteBuffer.GetBytes() + start;
+  const char *operands = code + INSTRUCTION_SIZE;
+  uint32_t word = ReadInstruction(code);
+
+  if (GetOpcode(word) != OP_PUSH ||
+      ReadPackedOperand(word, operands).valueType != PACKVALUE_NAMED)
+    return;
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d PATCH READ\n", start);
+
+  // Only the type changes, a long index stays in the word after
+  uint32_t index = word >> 12;
+  byteBuffer.WriteU32(
+      MakeInstruction(OP_PUSH, PACKVALUE_NAMED_VALUE | (index << 4)), start);
+}
+
+void BytecodeBody::Truncate(unsigned int position)
+{
+  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d TRUNCATE\n", position);
+
+  byteBuffer.Truncate(position);
+}
+
+void BytecodeBody::BeginLoop() { loops.emplace_back(); }
+
+void BytecodeBody::EmitBreak()
+{
+  if (loops.empty())
+    return;
+
+  loops.back().breaks.push_back(EmitJump(OP_JMP));
+}
+
+void BytecodeBody::EmitContinue()
+{
+  if (loops.empty())
+    return;
+
+  loops.back().continues.push_back(EmitJump(OP_JMP));
+}
+
+void BytecodeBody::EndLoop(unsigned int continuePosition)
 {
-  Log::Get().Print(LOGLEVEL_VERBOSE, "%5d EMIT RESERVED %d\n",
-                   byteBuffer.GetLength(), numBytes);
-  return Reservation(&byteBuffer, byteBuffer.Reserve(numBytes));
+  for (auto &reservation : loops.back().continues)
+    reservation.Emit(continuePosition - reservation.GetPosition());
+
+  for (auto &reservation : loops.back().breaks)
+    reservation.Emit(GetCurrentPosition() - reservation.GetPosition());
+
+  loops.pop_back();
 }
 
 ByteBuffer BytecodeBody::GetByteBuffer() { return byteBuffer; }
+
+void BytecodeBody::SwapBuffer(ByteBuffer &buffer) { swap(byteBuffer, buffer); }
+
+void BytecodeBody::Clear()
+{
+  byteBuffer.Truncate(0);
+  loops.clear();
+}
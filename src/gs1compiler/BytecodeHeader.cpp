@@ -10,11 +10,28 @@ BytecodeHeader::BytecodeHeader()
 
 BytecodeHeader::~BytecodeHeader() {}
 
-ByteBuffer BytecodeHeader::GetByteBuffer()
+void BytecodeHeader::Write(ByteBuffer &buffer, const char *body,
+                           unsigned int bodyLen)
 {
-  ByteBuffer buffer;
+  unsigned int start = buffer.GetLength();
+
+  buffer.WriteU32(BYTECODE_MAGIC);
+  buffer.WriteU16(BYTECODE_VERSION);
+
+  // Flags, none yet
+  buffer.WriteU16(0);
 
   auto bodyOffsetReservation = buffer.Reserve(4);
+  buffer.WriteU32(bodyLen);
+
+  // Max stack depth, left at 0 for a body the verifier rejects anyway
+  uint32_t maxDepth, errorPos;
+
+  if (!ComputeMaxStackDepth(body, bodyLen, *constNumberTable,
+                            functionOffsetTable, maxDepth, errorPos))
+    maxDepth = 0;
+
+  buffer.WriteU32(maxDepth);
 
   // Write string constants
   buffer.WriteU32(constStringTable->constants.size());
@@ -26,11 +43,38 @@ ByteBuffer BytecodeHeader::GetByteBuffer()
   buffer.WriteU32(constNumberTable->constants.size());
 
   for (auto &key : constNumberTable->constants)
-    buffer.WriteU32(*reinterpret_cast<uint32_t *>(&key.val));
-
-  buffer.WriteU32(buffer.GetLength(), bodyOffsetReservation);
+    buffer.WriteFloat(key.val);
 
   // Write function names and offsets
+  buffer.WriteU32(functionOffsetTable.size());
+
+  for (auto &function : functionOffsetTable) {
+    buffer.WriteString(function.first);
+    buffer.WriteU32(function.second);
+  }
+
+  // The body is kept word aligned
+  buffer.Reserve((INSTRUCTION_SIZE - (buffer.GetLength() - start) %
+                                         INSTRUCTION_SIZE) %
+                 INSTRUCTION_SIZE);
+
+  buffer.WriteU32(buffer.GetLength() - start, bodyOffsetReservation);
+  buffer.EnsureCapacity(buffer.GetLength() + bodyLen);
+  buffer.WriteBytes(body, bodyLen);
+}
+
+ByteBuffer BytecodeHeader::GetByteBuffer(const char *body,
+                                         unsigned int bodyLen)
+{
+  ByteBuffer buffer;
+  Write(buffer, body, bodyLen);
 
   return buffer;
-}
\ No newline at end of file
+}
+
+void BytecodeHeader::Clear()
+{
+  constStringTable->Clear();
+  constNumberTable->Clear();
+  functionOffsetTable.clear();
+}
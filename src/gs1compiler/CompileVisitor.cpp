@@ -7,6 +7,53 @@
 
 using namespace gs1;
 
+// What an expression's code leaves on the stack, so operators on it can be
+// specialised for numbers
+static ExprType InferType(Expr *node)
+{
+  if (node == nullptr)
+    return EXPRTYPE_ANY;
+
+  switch (node->kind) {
+  case NodeExprId:
+    return EXPRTYPE_VARIABLE;
+
+  case NodeExprNumberLiteral:
+    return EXPRTYPE_NUMBER;
+
+  case NodeExprUnaryOp:
+    // Increments and decrements push the number, nothing else is emitted
+    switch (((ExprUnaryOp *)node)->op->token.type) {
+    case TokOpIncrement:
+    case TokOpDecrement:
+      return EXPRTYPE_NUMBER;
+
+    default:
+      return EXPRTYPE_ANY;
+    }
+
+  case NodeExprBinaryOp:
+    // Arithmetic pushes numbers, "and" and "or" push a constant 1 or 0
+    switch (((ExprBinaryOp *)node)->op->token.type) {
+    case TokOpAnd:
+    case TokOpOr:
+    case TokOpAdd:
+    case TokOpSub:
+    case TokOpMul:
+    case TokOpDiv:
+    case TokOpMod:
+    case TokOpPow:
+      return EXPRTYPE_NUMBER;
+
+    default:
+      return EXPRTYPE_ANY;
+    }
+
+  default:
+    return EXPRTYPE_ANY;
+  }
+}
+
 CompileVisitor::CompileVisitor(ISource &source, bool printTerminals)
     : level(0), printTerminals(printTerminals), source(source)
 {
@@ -18,7 +65,7 @@ void CompileVisitor::Visit(SyntaxTerminal *node)
     Log::Get().Print(LOGLEVEL_VERBOSE, "%*s", level, "");
     Log::Get().Print(LOGLEVEL_VERBOSE, "* %s(%s)\n",
                      GetTokenTypeName(node->token.type),
-                     node->token.text.c_str());
+                     string(node->token.GetText(source)).c_str());
   }
 }
 
@@ -39,7 +86,13 @@ void CompileVisitor::Visit(StmtBlock *node)
 {
   PrintEnterNode(node, "StmtBlock");
 
-  SyntaxTreeVisitor::Visit(node);
+  for (auto stmt : node->statements)
+    AcceptStmt(stmt);
+
+  // At the end of the script every function is known, calls to them can go
+  // straight there
+  if (node->parent == nullptr)
+    body.LinkFunctions(*header.constStringTable, header.functionOffsetTable);
 
   PrintLeaveNode();
 }
@@ -49,23 +102,19 @@ void CompileVisitor::Visit(StmtIf *node)
   PrintEnterNode(node, "StmtIf");
 
   // Write the condition
-  node->cond->Accept(this);
+  AcceptCondition(node->cond);
 
   // Jump past the body if the condition is false
-  body.Emit(OP_JEZ);
-
-  // Reserve our offset for how far to jump
-  Reservation offsetReservation = body.Reserve(4);
+  Reservation offsetReservation = body.EmitJump(OP_JEZ);
 
   // Write "then" body
-  node->thenBody->Accept(this);
+  AcceptStmt(node->thenBody);
 
   // If there's an else body, we need to jump past it now,
   // as we're still enclosed in the "then" body
   if (node->elseBody != nullptr) {
     // We don't know how far to jump yet
-    body.Emit(OP_JMP);
-    Reservation elseOffsetReservation = body.Reserve(4);
+    Reservation elseOffsetReservation = body.EmitJump(OP_JMP);
 
     // Write the offset to jump past the if-body (and into the else body)
     offsetReservation.Emit(body.GetCurrentPosition() -
@@ -75,7 +124,7 @@ void CompileVisitor::Visit(StmtIf *node)
                      body.GetCurrentPosition());
 
     // Write the else body
-    node->elseBody->Accept(this);
+    AcceptStmt(node->elseBody);
 
     // Fill the reservation for our jump to skip the else
     elseOffsetReservation.Emit(body.GetCurrentPosition() -
@@ -100,39 +149,51 @@ void CompileVisitor::Visit(StmtFor *node)
   PrintEnterNode(node, "StmtFor");
 
   // Emit initialization
-  node->init->Accept(this);
+  if (node->init != nullptr)
+    AcceptStmt(node->init);
 
   uint32_t stepConditionPosition = body.GetCurrentPosition();
 
-  // Emit condition
-  node->cond->Accept(this);
+  // Emit condition, without one the loop only ends through a break
+  bool hasCondition = node->cond != nullptr;
+
+  if (hasCondition)
+    AcceptCondition(node->cond);
 
   // Jump out if step condition fails
-  body.Emit(OP_JEZ);
-  Reservation failReservation = body.Reserve(4);
+  Reservation failReservation(nullptr, 0);
+
+  if (hasCondition) {
+    failReservation = body.EmitJump(OP_JEZ);
+  }
 
   // Emit body
-  node->body->Accept(this);
+  uint32_t bodyPosition = body.GetCurrentPosition();
+  body.BeginLoop();
+  AcceptStmt(node->body);
+
+  // "continue" runs the step before checking the condition again
+  uint32_t stepPosition = body.GetCurrentPosition();
 
   // Emit step
-  node->step->Accept(this);
+  if (node->step != nullptr)
+    AcceptStmt(node->step);
 
   // Jump back to step condition
-  body.Emit(OP_JMP);
-  body.Emit(stepConditionPosition - body.GetCurrentPosition());
+  body.EmitForLoopEnd(stepConditionPosition, bodyPosition, stepPosition,
+                      *header.constNumberTable);
   Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
                    body.GetCurrentPosition(), stepConditionPosition);
 
-  failReservation.Emit(body.GetCurrentPosition() -
-                       failReservation.GetPosition());
-  Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
-                   failReservation.GetPosition(), body.GetCurrentPosition());
-
-  // Set "break" location
-  node->breakPosition = body.GetCurrentPosition();
+  if (hasCondition) {
+    failReservation.Emit(body.GetCurrentPosition() -
+                         failReservation.GetPosition());
+    Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
+                     failReservation.GetPosition(), body.GetCurrentPosition());
+  }
 
-  // Set "continue" location
-  node->continuePosition = stepConditionPosition;
+  // Patch "break" and "continue" jumps
+  body.EndLoop(stepPosition);
 
   PrintLeaveNode();
 }
@@ -144,18 +205,17 @@ void CompileVisitor::Visit(StmtWhile *node)
   uint32_t conditionPosition = body.GetCurrentPosition();
 
   // Emit condition
-  node->cond->Accept(this);
+  AcceptCondition(node->cond);
 
   // Jump out if step condition fails
-  body.Emit(OP_JEZ);
-  Reservation failReservation = body.Reserve(4);
+  Reservation failReservation = body.EmitJump(OP_JEZ);
 
   // Emit body
-  node->body->Accept(this);
+  body.BeginLoop();
+  AcceptStmt(node->body);
 
   // Jump back to condition check
-  body.Emit(OP_JMP);
-  body.Emit(conditionPosition - body.GetCurrentPosition());
+  body.EmitJump(OP_JMP, conditionPosition);
   Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
                    body.GetCurrentPosition(), conditionPosition);
 
@@ -164,11 +224,8 @@ void CompileVisitor::Visit(StmtWhile *node)
   Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
                    failReservation.GetPosition(), body.GetCurrentPosition());
 
-  // Set "break" location
-  node->breakPosition = body.GetCurrentPosition();
-
-  // Set "continue" location
-  node->continuePosition = conditionPosition;
+  // Patch "break" and "continue" jumps
+  body.EndLoop(conditionPosition);
 
   PrintLeaveNode();
 }
@@ -177,25 +234,8 @@ void CompileVisitor::Visit(StmtBreak *node)
 {
   PrintEnterNode(node, "StmtBreak");
 
-  // Iterate up tree until we find the parent loop
-  SyntaxNode *parent = node->parent;
-  while (parent != nullptr) {
-    if (parent->GetType() == "StmtWhile" || parent->GetType() == "StmtFor") {
-      // Emit jump out of bytecode to continue location
-
-      unsigned int breakPosition = ((StmtLoop *)parent)->continuePosition;
-
-      body.Emit(OP_JMP);
-      body.Emit(body.GetCurrentPosition() - breakPosition);
-      Log::Get().Print(LOGLEVEL_VERBOSE,
-                       "BREAK: PRINTING OFFSET JUMP %d TO: %d\n",
-                       body.GetCurrentPosition(), breakPosition);
-
-      break;
-    }
-
-    parent = parent->parent;
-  }
+  // Jump out of the innermost loop, patched once the loop ends
+  body.EmitBreak();
 
   PrintLeaveNode();
 }
@@ -204,25 +244,8 @@ void CompileVisitor::Visit(StmtContinue *node)
 {
   PrintEnterNode(node, "StmtContinue");
 
-  // Iterate up tree until we find the parent loop
-  SyntaxNode *parent = node->parent;
-  while (parent != nullptr) {
-    if (parent->GetType() == "StmtWhile" || parent->GetType() == "StmtFor") {
-      // Emit jump out of bytecode to continue location
-
-      unsigned int continuePosition = ((StmtLoop *)parent)->continuePosition;
-
-      body.Emit(OP_JMP);
-      body.Emit(body.GetCurrentPosition() - continuePosition);
-      Log::Get().Print(LOGLEVEL_VERBOSE,
-                       "CONTINUE: PRINTING OFFSET JUMP %d TO: %d\n",
-                       body.GetCurrentPosition(), continuePosition);
-
-      break;
-    }
-
-    parent = parent->parent;
-  }
+  // Jump to the next iteration of the innermost loop
+  body.EmitContinue();
 
   PrintLeaveNode();
 }
@@ -242,15 +265,15 @@ void CompileVisitor::Visit(StmtCommand *node)
   PrintEnterNode(node, "StmtCommand");
 
   // Table command name
-  std::string &commandName = node->name->token.text;
+  std::string commandName(node->name->token.GetText(source));
   ConstantKey nameKey = header.constStringTable->GetKey(commandName);
 
   // Emit arguments
   SyntaxTreeVisitor::Visit(node);
 
-  // Emit call and command name
-  body.Emit(OP_CMD_CALL);
-  body.Emit(PackedValue(PACKVALUE_CONST_STRING, nameKey.index));
+  // Emit call, command name and argument count
+  body.EmitCall(OP_CMD_CALL, PackedValue(PACKVALUE_CONST_STRING, nameKey.index),
+                node->args.size());
 
   PrintLeaveNode();
 }
@@ -260,14 +283,16 @@ void CompileVisitor::Visit(StmtFunctionDecl *node)
   PrintEnterNode(node, "StmtFunctionDecl");
 
   // Table function decl name
-  std::string &funcName = node->name->token.text;
+  std::string funcName(node->name->token.GetText(source));
   header.constStringTable->GetKey(funcName);
 
   Print("Function Decl found: %s", funcName.c_str());
 
-  auto reservation = body.BeginFunction(funcName);
+  auto reservation = body.BeginFunction();
+  header.functionOffsetTable[funcName] = body.GetCurrentPosition();
 
-  SyntaxTreeVisitor::Visit(node);
+  if (node->body != nullptr)
+    AcceptStmt(node->body);
 
   body.EndFunction(reservation);
 
@@ -283,12 +308,11 @@ void CompileVisitor::Visit(ExprId *node)
   PrintEnterNode(node, "ExprId");
 
   // Table id name
-  std::string &idName = node->name->token.text;
+  std::string idName(node->name->token.GetText(source));
   ConstantKey key = header.constStringTable->GetKey(idName);
 
   // Push string literal onto stack
-  body.Emit(OP_PUSH);
-  body.Emit(PackedValue(PACKVALUE_NAMED, key.index));
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_NAMED, key.index));
 
   SyntaxTreeVisitor::Visit(node);
 
@@ -299,13 +323,10 @@ void CompileVisitor::Visit(ExprNumberLiteral *node)
 {
   PrintEnterNode(node, "ExprNumberLiteral");
 
-  // Table number literal
-  float num = std::stof(node->literal->token.text);
-  ConstantKey key = header.constNumberTable->GetKey(num);
+  float num = std::stof(string(node->literal->token.GetText(source)));
 
   // Push number literal onto stack
-  body.Emit(OP_PUSH);
-  body.Emit(PackedValue(PACKVALUE_CONST_NUMBER, key.index));
+  body.EmitNumber(num, *header.constNumberTable);
 
   SyntaxTreeVisitor::Visit(node);
 
@@ -317,12 +338,11 @@ void CompileVisitor::Visit(ExprStringLiteral *node)
   PrintEnterNode(node, "ExprStringLiteral");
 
   // Table string literal
-  std::string str = node->literal->token.text;
+  std::string str(node->literal->token.GetText(source));
   ConstantKey key = header.constStringTable->GetKey(str);
 
   // Push string literal onto stack
-  body.Emit(OP_PUSH);
-  body.Emit(PackedValue(PACKVALUE_CONST_STRING, key.index));
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_CONST_STRING, key.index));
 
   SyntaxTreeVisitor::Visit(node);
 
@@ -340,8 +360,7 @@ void CompileVisitor::Visit(ExprList *node)
   ConstantKey key = header.constNumberTable->GetKey(size);
 
   // Push size of array onto stack
-  body.Emit(OP_PUSH);
-  body.Emit(PackedValue(PACKVALUE_CONST_ARRAY, key.index));
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_CONST_ARRAY, key.index));
 
   PrintLeaveNode();
 }
@@ -371,12 +390,12 @@ void CompileVisitor::Visit(ExprUnaryOp *node)
   bool needsPushedResult = false;
 
   while (!needsPushedResult) {
-    if (parent->GetType() == "ExprTernaryOp") {
+    if (parent->kind == NodeExprTernaryOp) {
       parent = parent->parent;
       continue;
     }
 
-    if (parent->GetBaseType() == "Expr")
+    if (parent->IsExpr())
       needsPushedResult = true;
     else
       break;
@@ -421,29 +440,24 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
   // Special logic for short-circuit logical ops
   if (node->op->token.type == TokOpAnd || node->op->token.type == TokOpOr) {
     // Emit left-side condition
-    node->left->Accept(this);
+    AcceptCondition(node->left);
 
     if (node->op->token.type == TokOpAnd) {
       // If "and", evaluate this condition and early-out if false
       // Write a jump at the end of the left-hand condition
-      body.Emit(OP_JEZ);
-      Reservation leftFailReservation = body.Reserve(4);
+      Reservation leftFailReservation = body.EmitJump(OP_JEZ);
 
       // Write the other condition
-      node->right->Accept(this);
+      AcceptCondition(node->right);
 
       // Write a jump at the end of the right-hand condition
-      body.Emit(OP_JEZ);
-      Reservation rightFailReservation = body.Reserve(4);
+      Reservation rightFailReservation = body.EmitJump(OP_JEZ);
 
       // Push a 1, this is the success block
-      body.Emit(OP_PUSH);
-      body.Emit(PackedValue(PACKVALUE_CONST_NUMBER,
-                            header.constNumberTable->GetKey(1.0f).index));
+      body.Emit(OP_PUSH1);
 
       // Evaluated to true, jump to exit
-      body.Emit(OP_JMP);
-      Reservation successReservation = body.Reserve(4);
+      Reservation successReservation = body.EmitJump(OP_JMP);
 
       // This is where we jump if it's false
       leftFailReservation.Emit(body.GetCurrentPosition() -
@@ -459,9 +473,7 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
                        body.GetCurrentPosition());
 
       // Push a zero, this is the failure block
-      body.Emit(OP_PUSH);
-      body.Emit(PackedValue(PACKVALUE_CONST_NUMBER,
-                            header.constNumberTable->GetKey(0.0f).index));
+      body.Emit(OP_PUSH0);
 
       successReservation.Emit(body.GetCurrentPosition() -
                               successReservation.GetPosition());
@@ -472,33 +484,41 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
       // If "or", evaluate this condition and early-IN (short-circuit) if true
       // Write a jump at the end of the left-hand condition
       // If it's false, we just pass through to the right-hand condition
-      body.Emit(OP_JNZ);
-      Reservation leftJumpReservation = body.Reserve(4);
+      Reservation leftSuccessReservation = body.EmitJump(OP_JNZ);
 
       // Write the other condition
-      node->right->Accept(this);
+      AcceptCondition(node->right);
 
       // Write a jump at the end of the right-hand condition
-      // This jump will pass through if true.
-      body.Emit(OP_JEZ);
-      Reservation rightJumpReservation = body.Reserve(4);
+      Reservation rightSuccessReservation = body.EmitJump(OP_JNZ);
+
+      // Push a zero, this is the failure block
+      body.Emit(OP_PUSH0);
 
-      // Fill the early-in reservation
-      leftJumpReservation.Emit(body.GetCurrentPosition() -
-                               leftJumpReservation.GetPosition());
+      // Evaluated to false, jump to exit
+      Reservation failReservation = body.EmitJump(OP_JMP);
+
+      // This is where we jump if either condition is true
+      leftSuccessReservation.Emit(body.GetCurrentPosition() -
+                                  leftSuccessReservation.GetPosition());
       Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
-                       leftJumpReservation.GetPosition(),
+                       leftSuccessReservation.GetPosition(),
                        body.GetCurrentPosition());
 
-      // This is where we jump to if the right-hand pass-through failed
-      rightJumpReservation.Emit(body.GetCurrentPosition() -
-                                rightJumpReservation.GetPosition());
-      Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET JUMP %d TO: %d\n",
-                       rightJumpReservation.GetPosition(),
+      rightSuccessReservation.Emit(body.GetCurrentPosition() -
+                                   rightSuccessReservation.GetPosition());
+      Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET SJUMP %d TO: %d\n",
+                       rightSuccessReservation.GetPosition(),
                        body.GetCurrentPosition());
 
-      // Push a zero, this is the failure block
-      body.Emit(0);
+      // Push a 1, this is the success block
+      body.Emit(OP_PUSH1);
+
+      failReservation.Emit(body.GetCurrentPosition() -
+                           failReservation.GetPosition());
+      Log::Get().Print(LOGLEVEL_VERBOSE, "PRINTING OFFSET FJUMP %d TO: %d\n",
+                       failReservation.GetPosition(),
+                       body.GetCurrentPosition());
     }
 
     return;
@@ -507,7 +527,7 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
   // Assign needs special handling for array assignments
   if (node->op->token.type == TokOpAssign) {
     // Check if lhand has an array
-    if (node->left->GetType() == "ExprIndex") {
+    if (node->left->kind == NodeExprIndex) {
       // Pushes ID
       ((ExprIndex *)node->left)->left->Accept(this);
 
@@ -523,7 +543,8 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
     }
   }
 
-  // Emit extra left operand for OpAssign
+  // Emit extra left operand for OpAssign, the second push is the one
+  // operated on
   switch (node->op->token.type) {
   case TokOpAddAssign:
   case TokOpSubAssign:
@@ -539,60 +560,86 @@ void CompileVisitor::Visit(ExprBinaryOp *node)
   }
 
   // Emit operands
-  SyntaxTreeVisitor::Visit(node);
+  unsigned int leftStart = body.GetCurrentPosition();
+  node->left->Accept(this);
+  node->op->Accept(this);
+
+  unsigned int rightStart = body.GetCurrentPosition();
+  if (node->right != nullptr)
+    node->right->Accept(this);
 
   // Emit operator
+  Opcode op = OP_NUM_OPS;
+
   switch (node->op->token.type) {
   case TokOpAssign:
     body.Emit(OP_ASSIGN);
     break;
 
   case TokOpEquals:
-    body.Emit(OP_EQ);
+  case TokOpNotEquals:
+    op = OP_EQ;
     break;
 
   case TokOpLessThan:
-    body.Emit(OP_LT);
+    op = OP_LT;
     break;
 
   case TokOpGreaterThan:
-    body.Emit(OP_GT);
+    op = OP_GT;
+    break;
+
+  case TokOpLessThanOrEqual:
+    op = OP_LTE;
+    break;
+
+  case TokOpGreaterThanOrEqual:
+    op = OP_GTE;
     break;
 
   case TokOpAdd:
   case TokOpAddAssign:
-    body.Emit(OP_ADD);
+    op = OP_ADD;
     break;
 
   case TokOpSub:
   case TokOpSubAssign:
-    body.Emit(OP_SUB);
+    op = OP_SUB;
     break;
 
   case TokOpMul:
   case TokOpMulAssign:
-    body.Emit(OP_MUL);
+    op = OP_MUL;
     break;
 
   case TokOpDiv:
   case TokOpDivAssign:
-    body.Emit(OP_DIV);
+    op = OP_DIV;
     break;
 
   case TokOpMod:
   case TokOpModAssign:
-    body.Emit(OP_MOD);
+    op = OP_MOD;
     break;
 
   case TokOpPow:
   case TokOpPowAssign:
-    body.Emit(OP_POW);
+    op = OP_POW;
     break;
 
   default:
     break;
   }
 
+  if (op != OP_NUM_OPS) {
+    body.EmitNumberOp(op, InferType(node->left), leftStart,
+                      InferType(node->right), rightStart);
+  }
+
+  // There's no opcode for '!=', the equality is inverted
+  if (node->op->token.type == TokOpNotEquals)
+    body.Emit(OP_NOT);
+
   // Emit OpAssign
   switch (node->op->token.type) {
   case TokOpAddAssign:
@@ -615,21 +662,16 @@ void CompileVisitor::Visit(ExprTernaryOp *node)
   PrintEnterNode(node, "ExprTernaryOp");
 
   // Write the condition
-  node->cond->Accept(this);
+  AcceptCondition(node->cond);
 
   // Jump past the left statement if the condition is false
-  body.Emit(OP_JEZ);
-
-  // Reserve our offset for how far to jump
-  Reservation failReservation = body.Reserve(4);
+  Reservation failReservation = body.EmitJump(OP_JEZ);
 
   // Write "then" body
   node->thenValue->Accept(this);
 
   // Write jump to end
-  body.Emit(OP_JMP);
-
-  Reservation successReservation = body.Reserve(4);
+  Reservation successReservation = body.EmitJump(OP_JMP);
 
   // Fill "fail" reservation
   failReservation.Emit(body.GetCurrentPosition() -
@@ -677,34 +719,56 @@ void CompileVisitor::Visit(ExprCall *node)
 {
   PrintEnterNode(node, "ExprCall");
 
-  std::string &commandName = ((ExprId *)node->left)->name->token.text;
+  std::string commandName(((ExprId *)node->left)->name->token.GetText(source));
   ConstantKey nameKey = header.constStringTable->GetKey(commandName);
 
   // Visit argument nodes
   for (auto &arg : node->args)
     arg->Accept(this);
 
-  // Emit call and function name
-  body.Emit(OP_CALL);
-  body.Emit(PackedValue(PACKVALUE_CONST_STRING, nameKey.index));
+  // Emit call, function name and argument count
+  body.EmitCall(OP_CALL, PackedValue(PACKVALUE_CONST_STRING, nameKey.index),
+                node->args.size());
 
   PrintLeaveNode();
 }
 
-ByteBuffer CompileVisitor::GetBytecode()
+void CompileVisitor::WriteBytecode(ByteBuffer &buffer)
 {
-  ByteBuffer headerBuffer = header.GetByteBuffer();
-  ByteBuffer bodyBuffer = body.GetByteBuffer();
+  header.Write(buffer, body.GetBytes(), body.GetCurrentPosition());
+}
 
-  headerBuffer.WriteBytes(bodyBuffer.GetBytes(), bodyBuffer.GetLength());
+ByteBuffer CompileVisitor::GetBytecode()
+{
+  ByteBuffer buffer;
+  WriteBytecode(buffer);
 
-  return headerBuffer;
+  return buffer;
 }
 
 // --------------------------------------------------
 // Helper functions
 // --------------------------------------------------
 
+void CompileVisitor::AcceptStmt(SyntaxNode *node)
+{
+  unsigned int start = body.GetCurrentPosition();
+
+  node->Accept(this);
+
+  // Nothing uses the value of an expression statement
+  if (node->IsExpr())
+    body.EmitDiscard(start, *header.constNumberTable);
+}
+
+void CompileVisitor::AcceptCondition(Expr *node)
+{
+  unsigned int start = body.GetCurrentPosition();
+
+  node->Accept(this);
+  body.PatchRead(InferType(node), start);
+}
+
 void CompileVisitor::PrintEnterNode(SyntaxNode *node, const char *name)
 {
   auto text = source.GetRangeContents(node->GetRange());
@@ -0,0 +1,132 @@
+#include <gs1/compiler/CompilerSession.hpp>
+#include <gs1/compiler/FlowSimplifier.hpp>
+#include <gs1/compiler/FunctionInliner.hpp>
+#include <gs1/compiler/Optimizer.hpp>
+
+using namespace gs1;
+
+CompilerSession::CompilerSession(PrototypeMap commands, PrototypeMap functions,
+                                 CompileMode mode)
+    : commands(std::move(commands)), functions(std::move(functions)),
+      mode(mode), optimize(false), inlineSize(INLINE_SIZE_DEFAULT),
+      inlineGrowth(INLINE_GROWTH_DEFAULT),
+      diag([this](const Diag &d) { AddDiag(d); }),
+      compiler(diag, this->commands, this->functions), outputWritten(false),
+      source(nullptr), errorCount(0)
+{
+}
+
+bool CompilerSession::Compile(ISource &source)
+{
+  Begin(source);
+
+  Lexer lexer(diag, source);
+
+  if (mode == COMPILEMODE_STREAM) {
+    compiler.Compile(lexer);
+  } else {
+    // The previous tree is only dropped now, its blocks are reused
+    arena.Reset();
+
+    visitor.reset(new CompileVisitor(source));
+    Parser parser(diag, lexer, arena, commands, functions, false);
+
+    parser.Parse()->Accept(visitor.get());
+  }
+
+  if (errorCount == 0) {
+    if (optimize && inlineSize != 0) {
+      FunctionInliner(GetOutputHeader(), GetOutputBody(), inlineSize,
+                      inlineGrowth)
+          .Inline();
+    }
+
+    FlowSimplifier(GetOutputHeader(), GetOutputBody()).Simplify();
+
+    if (optimize)
+      Optimizer(GetOutputHeader(), GetOutputBody()).Optimize();
+  }
+
+  this->source = nullptr;
+
+  return errorCount == 0;
+}
+
+bool CompilerSession::CompileExpression(string_view text)
+{
+  MemorySource source(text);
+  Begin(source);
+
+  Lexer lexer(diag, source);
+  compiler.CompileExpression(lexer);
+
+  this->source = nullptr;
+
+  return errorCount == 0;
+}
+
+bool CompilerSession::CompileString(string_view text)
+{
+  MemorySource source(text);
+  return Compile(source);
+}
+
+bool CompilerSession::CompileFile(const string &path)
+{
+  MappedFileSource source(path);
+  return Compile(source);
+}
+
+ByteBuffer &CompilerSession::GetBytecode()
+{
+  if (!outputWritten) {
+    BytecodeBody &body = GetOutputBody();
+    GetOutputHeader().Write(output, body.GetBytes(), body.GetCurrentPosition());
+    outputWritten = true;
+  }
+
+  return output;
+}
+
+void CompilerSession::TakeOutput(BytecodeHeader &header, ByteBuffer &body)
+{
+  BytecodeHeader &outputHeader = GetOutputHeader();
+
+  std::swap(outputHeader.constStringTable, header.constStringTable);
+  std::swap(outputHeader.constNumberTable, header.constNumberTable);
+  std::swap(outputHeader.functionOffsetTable, header.functionOffsetTable);
+
+  GetOutputBody().SwapBuffer(body);
+}
+
+BytecodeHeader &CompilerSession::GetOutputHeader()
+{
+  return visitor ? visitor->GetHeader() : compiler.GetHeader();
+}
+
+BytecodeBody &CompilerSession::GetOutputBody()
+{
+  return visitor ? visitor->GetBody() : compiler.GetBody();
+}
+
+void CompilerSession::Begin(ISource &source)
+{
+  this->source = &source;
+  diags.clear();
+  errorCount = 0;
+  output.Truncate(0);
+  outputWritten = false;
+  visitor.reset();
+}
+
+void CompilerSession::AddDiag(const Diag &d)
+{
+  // Lines are only looked up for what gets reported
+  int offset = d.pos.offset != -1 ? d.pos.offset : d.range.beg.offset;
+  uint32_t line = offset != -1 ? source->GetLine(offset) : 0;
+
+  diags.push_back({d, line});
+
+  if (d.severity == Diag::Error)
+    errorCount++;
+}
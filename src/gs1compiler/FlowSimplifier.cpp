@@ -0,0 +1,272 @@
+#include <gs1/common/Log.hpp>
+#include <gs1/compiler/FlowSimplifier.hpp>
+
+#include <algorithm>
+
+using namespace gs1;
+
+FlowSimplifier::FlowSimplifier(BytecodeHeader &header, BytecodeBody &body)
+    : header(header), body(body)
+{
+}
+
+void FlowSimplifier::Simplify()
+{
+  if (!Decode()) {
+    Log::Get().Print(LOGLEVEL_VERBOSE, "SIMPLIFY: body left as it is\n");
+    return;
+  }
+
+  bool changed = true;
+
+  while (changed) {
+    changed = ThreadJumps();
+    changed |= RemoveUnreachable();
+    changed |= RemoveNoOpJumps();
+  }
+
+  Encode();
+}
+
+bool FlowSimplifier::Decode()
+{
+  const char *code = body.GetBytes();
+  unsigned int len = body.GetCurrentPosition();
+  unsigned int pos = 0;
+
+  while (pos < len) {
+    unsigned int size = GetInstructionSize(code + pos, len - pos);
+
+    if (size == 0)
+      return false;
+
+    uint32_t word = ReadInstruction(code + pos);
+
+    instructions.push_back(
+        {pos, size, word, GetOpcode(word), -1, false, false});
+    pos += size;
+  }
+
+  for (auto &instr : instructions) {
+    if (!IsJump(instr.op))
+      continue;
+
+    int64_t target = (int64_t)instr.pos + GetJumpOffset(instr.word);
+
+    if (target == len) {
+      instr.target = instructions.size();
+    } else if (target < 0 || target > len ||
+               (instr.target = FindInstruction(target)) == -1) {
+      return false;
+    }
+  }
+
+  for (auto &function : header.functionOffsetTable) {
+    if (FindInstruction(function.second) == -1)
+      return false;
+  }
+
+  return true;
+}
+
+bool FlowSimplifier::ThreadJumps()
+{
+  int count = instructions.size();
+  bool changed = false;
+
+  for (int i = 0; i < count; ++i) {
+    Instruction &instr = instructions[i];
+
+    // Calls keep pointing at the function they call
+    if (instr.removed || instr.target == -1 || instr.op == OP_JAL)
+      continue;
+
+    // Chains are followed no further than there are instructions, so jumps
+    // which loop forever end somewhere
+    int target = GetNext(instr.target);
+
+    for (int steps = 0; target < count && steps < count; ++steps) {
+      Instruction &next = instructions[target];
+
+      if (next.op != OP_JMP || next.rewritten)
+        break;
+
+      target = GetNext(next.target);
+    }
+
+    if (target != instr.target) {
+      Log::Get().Print(LOGLEVEL_VERBOSE, "%5d SIMPLIFY THREAD JUMP\n",
+                       instr.pos);
+
+      instr.target = target;
+      changed = true;
+    }
+
+    // Running off the end isn't the same as stopping when a script function
+    // is called from outside, so only jumps to a return or stop are replaced
+    if (instr.op != OP_JMP || target == count)
+      continue;
+
+    Opcode op = instructions[target].op;
+
+    if (op == OP_RET || op == OP_STOP) {
+      Log::Get().Print(LOGLEVEL_VERBOSE, "%5d SIMPLIFY JUMP TO %s\n",
+                       instr.pos, OpcodeToString(op).c_str());
+
+      instr.op = op;
+      instr.target = -1;
+      instr.rewritten = true;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool FlowSimplifier::RemoveUnreachable()
+{
+  int count = instructions.size();
+  std::vector<bool> reached(count, false);
+  std::vector<int> pending = {GetNext(0)};
+
+  // Script functions are entered from outside too
+  for (auto &function : header.functionOffsetTable)
+    pending.push_back(GetNext(FindInstruction(function.second)));
+
+  while (!pending.empty()) {
+    int i = pending.back();
+    pending.pop_back();
+
+    if (i >= count || reached[i])
+      continue;
+
+    reached[i] = true;
+
+    Instruction &instr = instructions[i];
+
+    if (instr.target != -1)
+      pending.push_back(GetNext(instr.target));
+
+    if (instr.op != OP_JMP && instr.op != OP_RET && instr.op != OP_STOP)
+      pending.push_back(GetNext(i + 1));
+  }
+
+  bool changed = false;
+
+  for (int i = 0; i < count; ++i) {
+    if (reached[i] || instructions[i].removed)
+      continue;
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%5d SIMPLIFY UNREACHABLE\n",
+                     instructions[i].pos);
+
+    instructions[i].removed = true;
+    changed = true;
+  }
+
+  return changed;
+}
+
+bool FlowSimplifier::RemoveNoOpJumps()
+{
+  int count = instructions.size();
+  bool changed = false;
+
+  for (int i = 0; i < count; ++i) {
+    Instruction &instr = instructions[i];
+
+    if (instr.removed || instr.target == -1 ||
+        GetNext(instr.target) != GetNext(i + 1))
+      continue;
+
+    switch (instr.op) {
+    case OP_JMP:
+      instr.removed = true;
+      break;
+
+    case OP_JEZ:
+    case OP_JNZ:
+      // Whichever way it goes the condition is still taken off the stack
+      instr.op = OP_POP;
+      instr.target = -1;
+      instr.rewritten = true;
+      break;
+
+    default:
+      // Calls and loops do more than jump
+      continue;
+    }
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%5d SIMPLIFY NO-OP JUMP\n", instr.pos);
+    changed = true;
+  }
+
+  return changed;
+}
+
+void FlowSimplifier::Encode()
+{
+  const char *code = body.GetBytes();
+  ByteBuffer output;
+
+  // Where each instruction went, removed ones are where the next kept one
+  // went, so jumps are pointed at them once it's known
+  std::vector<uint32_t> positions(instructions.size() + 1);
+  std::vector<std::pair<int, uint32_t>> jumps;
+
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    Instruction &instr = instructions[i];
+
+    positions[i] = output.GetLength();
+
+    if (instr.removed)
+      continue;
+
+    if (instr.target != -1)
+      jumps.push_back({i, output.GetLength()});
+
+    if (instr.rewritten)
+      output.WriteU32(MakeInstruction(instr.op));
+    else
+      output.WriteBytes(code + instr.pos, instr.size);
+  }
+
+  positions[instructions.size()] = output.GetLength();
+
+  for (auto &jump : jumps) {
+    Instruction &instr = instructions[jump.first];
+
+    Reservation(&output, jump.second, instr.op)
+        .Emit((int)positions[instr.target] - (int)jump.second);
+  }
+
+  for (auto &function : header.functionOffsetTable)
+    function.second = positions[FindInstruction(function.second)];
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "SIMPLIFY: %u bytes to %u\n",
+                   body.GetCurrentPosition(), output.GetLength());
+
+  body.SwapBuffer(output);
+}
+
+int FlowSimplifier::FindInstruction(uint32_t pos)
+{
+  auto itr = std::lower_bound(
+      instructions.begin(), instructions.end(), pos,
+      [](const Instruction &instr, uint32_t pos) { return instr.pos < pos; });
+
+  if (itr == instructions.end() || itr->pos != pos)
+    return -1;
+
+  return itr - instructions.begin();
+}
+
+int FlowSimplifier::GetNext(int i)
+{
+  int count = instructions.size();
+
+  while (i < count && instructions[i].removed)
+    ++i;
+
+  return i;
+}
@@ -0,0 +1,403 @@
+#include <gs1/common/Log.hpp>
+#include <gs1/compiler/FunctionInliner.hpp>
+
+#include <algorithm>
+
+using namespace gs1;
+
+FunctionInliner::FunctionInliner(BytecodeHeader &header, BytecodeBody &body,
+                                 unsigned int maxSize, unsigned int maxGrowth)
+    : header(header), body(body), maxSize(maxSize), maxGrowth(maxGrowth)
+{
+}
+
+void FunctionInliner::Inline()
+{
+  if (header.functionOffsetTable.empty() || !Decode()) {
+    Log::Get().Print(LOGLEVEL_VERBOSE, "INLINE: body left as it is\n");
+    return;
+  }
+
+  FindFunctions();
+  ChooseCalls();
+
+  Encode();
+}
+
+bool FunctionInliner::Decode()
+{
+  const char *code = body.GetBytes();
+  unsigned int len = body.GetCurrentPosition();
+  unsigned int pos = 0;
+
+  while (pos < len) {
+    unsigned int size = GetInstructionSize(code + pos, len - pos);
+
+    if (size == 0)
+      return false;
+
+    uint32_t word = ReadInstruction(code + pos);
+
+    instructions.push_back(
+        {pos, size, word, GetOpcode(word), -1, -1, false});
+    pos += size;
+  }
+
+  for (auto &instr : instructions) {
+    if (!IsJump(instr.op))
+      continue;
+
+    int64_t target = (int64_t)instr.pos + GetJumpOffset(instr.word);
+
+    if (target == len) {
+      instr.target = instructions.size();
+    } else if (target < 0 || target > len ||
+               (instr.target = FindInstruction(target)) == -1) {
+      return false;
+    }
+  }
+
+  for (auto &function : header.functionOffsetTable) {
+    if (FindInstruction(function.second) == -1)
+      return false;
+  }
+
+  return true;
+}
+
+void FunctionInliner::FindFunctions()
+{
+  int count = instructions.size();
+
+  for (auto &entry : header.functionOffsetTable) {
+    Function function;
+    function.name = entry.first;
+    function.first = FindInstruction(entry.second);
+    function.last = -1;
+    function.inlinable = false;
+
+    // Bodies are jumped over, and end in the return closing them
+    int first = function.first;
+
+    if (first > 0 && instructions[first - 1].op == OP_JMP) {
+      int end = instructions[first - 1].target;
+
+      if (end > first && end <= count && instructions[end - 1].op == OP_RET)
+        function.last = end - 1;
+    }
+
+    if (function.last != -1) {
+      for (int i = first; i <= function.last; ++i) {
+        if (instructions[i].op == OP_JAL)
+          function.callees.push_back(instructions[i].target);
+      }
+    }
+
+    functions.push_back(function);
+  }
+
+  for (auto &function : functions) {
+    if (function.last == -1 || GetSize(function) > maxSize)
+      continue;
+
+    function.inlinable = CheckFunction(function) && !IsRecursive(function);
+  }
+}
+
+bool FunctionInliner::CheckFunction(const Function &function)
+{
+  int first = function.first;
+  int last = function.last;
+
+  // Only calls jump into the body, and only to its start
+  for (int i = 0; i < (int)instructions.size(); ++i) {
+    Instruction &instr = instructions[i];
+    bool inside = i >= first && i <= last;
+
+    if (instr.target == -1)
+      continue;
+
+    if (instr.op == OP_JAL) {
+      if (instr.target > first && instr.target <= last)
+        return false;
+    } else if (inside != (instr.target >= first && instr.target <= last)) {
+      return false;
+    }
+  }
+
+  // Returns are replaced by jumps, so they have to find the stack as the
+  // call left it
+  std::vector<int64_t> depths(last - first + 1, -1);
+  std::vector<int> pending = {first};
+  depths[0] = 0;
+
+  while (!pending.empty()) {
+    int i = pending.back();
+    pending.pop_back();
+
+    Instruction &instr = instructions[i];
+    int64_t depth = depths[i - first];
+    int64_t pops, pushes;
+
+    if (!GetInstructionStackUse(body.GetBytes() + instr.pos,
+                                *header.constNumberTable, pops, pushes) ||
+        depth < pops)
+      return false;
+
+    depth += pushes - pops;
+
+    std::vector<int> succs;
+
+    switch (instr.op) {
+    case OP_RET:
+      if (depths[i - first] != 0)
+        return false;
+      break;
+
+    case OP_STOP:
+      break;
+
+    case OP_JMP:
+      succs.push_back(instr.target);
+      break;
+
+    case OP_JEZ:
+    case OP_JNZ:
+    case OP_FORLOOP:
+      succs.push_back(instr.target);
+      succs.push_back(i + 1);
+      break;
+
+    default:
+      // Calls are returned from with the stack they had, plus the result
+      succs.push_back(i + 1);
+      break;
+    }
+
+    for (int succ : succs) {
+      if (succ > last)
+        return false;
+
+      int64_t &known = depths[succ - first];
+
+      if (known == -1) {
+        known = depth;
+        pending.push_back(succ);
+      } else if (known != depth) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool FunctionInliner::IsRecursive(const Function &function)
+{
+  // Follows calls out of the function, looking for one back into it
+  std::vector<int> pending = function.callees;
+  std::vector<int> seen;
+
+  while (!pending.empty()) {
+    int first = pending.back();
+    pending.pop_back();
+
+    if (first == function.first)
+      return true;
+
+    if (std::find(seen.begin(), seen.end(), first) != seen.end())
+      continue;
+
+    seen.push_back(first);
+
+    Function *callee = GetFunction(first);
+
+    // Calls to code which isn't a function can't be followed
+    if (callee == nullptr || callee->last == -1)
+      return true;
+
+    pending.insert(pending.end(), callee->callees.begin(),
+                   callee->callees.end());
+  }
+
+  return false;
+}
+
+void FunctionInliner::ChooseCalls()
+{
+  int count = instructions.size();
+  std::vector<bool> targeted(count + 1, false);
+
+  for (auto &instr : instructions) {
+    if (instr.target != -1)
+      targeted[instr.target] = true;
+  }
+
+  for (auto &function : functions)
+    targeted[function.first] = true;
+
+  // Calls are taken in order while the budget lasts, each growing the body
+  // by the function less the call
+  unsigned int growth = 0;
+
+  for (int i = 0; i < count; ++i) {
+    Instruction &instr = instructions[i];
+
+    if (instr.op != OP_JAL)
+      continue;
+
+    Function *function = GetFunction(instr.target);
+
+    if (function == nullptr || !function->inlinable)
+      continue;
+
+    uint32_t argCount =
+        ReadInstruction(body.GetBytes() + instr.pos + INSTRUCTION_SIZE);
+
+    // Calls used as statements have their result popped, which is left out
+    // along with the push
+    bool discarded = i + 1 < count && instructions[i + 1].op == OP_POP &&
+                     !targeted[i + 1];
+
+    unsigned int words = GetSize(*function) + argCount + (discarded ? 0 : 1);
+    unsigned int saved = instr.size / INSTRUCTION_SIZE + (discarded ? 1 : 0);
+
+    if (words > saved) {
+      if (growth + (words - saved) > maxGrowth)
+        continue;
+
+      growth += words - saved;
+    }
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%5d INLINE CALL TO %s\n", instr.pos,
+                     function->name.c_str());
+
+    instr.inlined = function->first;
+
+    if (discarded)
+      instructions[i + 1].removed = true;
+  }
+}
+
+void FunctionInliner::Encode()
+{
+  const char *code = body.GetBytes();
+  ByteBuffer output;
+
+  // Where each instruction went, and where each copy's went by their place
+  // in the function, followed by where the copy ends
+  std::vector<uint32_t> positions(instructions.size() + 1);
+  std::vector<std::vector<uint32_t>> copies;
+
+  // Jumps to point once it's known where everything went, into the body or
+  // into a copy
+  struct Jump {
+    uint32_t pos;
+    Opcode op;
+    int copy;
+    int target;
+  };
+
+  std::vector<Jump> jumps;
+
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    Instruction &instr = instructions[i];
+
+    positions[i] = output.GetLength();
+
+    if (instr.removed)
+      continue;
+
+    if (instr.inlined == -1) {
+      if (instr.target != -1)
+        jumps.push_back({output.GetLength(), instr.op, -1, instr.target});
+
+      output.WriteBytes(code + instr.pos, instr.size);
+      continue;
+    }
+
+    Function &function = *GetFunction(instr.inlined);
+    int copy = copies.size();
+    copies.emplace_back(function.last - function.first + 1);
+
+    // The arguments are only evaluated
+    uint32_t argCount = ReadInstruction(code + instr.pos + INSTRUCTION_SIZE);
+
+    for (uint32_t arg = 0; arg < argCount; ++arg)
+      output.WriteU32(MakeInstruction(OP_POP));
+
+    for (int j = function.first; j < function.last; ++j) {
+      Instruction &source = instructions[j];
+
+      copies[copy][j - function.first] = output.GetLength();
+
+      if (source.op == OP_RET) {
+        jumps.push_back({output.GetLength(), OP_JMP, copy,
+                         function.last - function.first});
+
+        output.WriteU32(MakeInstruction(OP_JMP));
+        continue;
+      }
+
+      // Calls out of the copy still go to the functions
+      if (source.op == OP_JAL)
+        jumps.push_back({output.GetLength(), source.op, -1, source.target});
+      else if (source.target != -1)
+        jumps.push_back({output.GetLength(), source.op, copy,
+                         source.target - function.first});
+
+      output.WriteBytes(code + source.pos, source.size);
+    }
+
+    copies[copy][function.last - function.first] = output.GetLength();
+
+    if (i + 1 >= instructions.size() || !instructions[i + 1].removed)
+      output.WriteU32(MakeInstruction(OP_PUSH0));
+  }
+
+  positions[instructions.size()] = output.GetLength();
+
+  for (auto &jump : jumps) {
+    uint32_t target = jump.copy == -1 ? positions[jump.target]
+                                      : copies[jump.copy][jump.target];
+
+    Reservation(&output, jump.pos, jump.op)
+        .Emit((int)target - (int)jump.pos);
+  }
+
+  for (auto &function : header.functionOffsetTable)
+    function.second = positions[FindInstruction(function.second)];
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "INLINE: %u bytes to %u\n",
+                   body.GetCurrentPosition(), output.GetLength());
+
+  body.SwapBuffer(output);
+}
+
+int FunctionInliner::FindInstruction(uint32_t pos)
+{
+  auto itr = std::lower_bound(
+      instructions.begin(), instructions.end(), pos,
+      [](const Instruction &instr, uint32_t pos) { return instr.pos < pos; });
+
+  if (itr == instructions.end() || itr->pos != pos)
+    return -1;
+
+  return itr - instructions.begin();
+}
+
+unsigned int FunctionInliner::GetSize(const Function &function)
+{
+  return (instructions[function.last].pos - instructions[function.first].pos) /
+         INSTRUCTION_SIZE;
+}
+
+FunctionInliner::Function *FunctionInliner::GetFunction(int first)
+{
+  for (auto &function : functions) {
+    if (function.first == first)
+      return &function;
+  }
+
+  return nullptr;
+}
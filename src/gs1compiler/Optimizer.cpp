@@ -0,0 +1,1125 @@
+#include <gs1/common/Log.hpp>
+#include <gs1/compiler/Optimizer.hpp>
+
+#include <algorithm>
+#include <map>
+#include <string.h>
+#include <string>
+#include <tuple>
+
+using namespace gs1;
+
+Optimizer::Optimizer(BytecodeHeader &header, BytecodeBody &body)
+    : header(header), body(body), hoistTemps(0)
+{
+}
+
+void Optimizer::Optimize()
+{
+  if (!Decode() || !BuildBlocks() || !BuildValues()) {
+    Log::Get().Print(LOGLEVEL_VERBOSE, "OPTIMIZE: body left as it is\n");
+    return;
+  }
+
+  ComputeDominators();
+
+  PropagateCopies();
+  EliminateDeadStores();
+  HoistInvariants();
+  EliminateCommonSubexpressions();
+
+  Encode();
+}
+
+bool Optimizer::Decode()
+{
+  const char *code = body.GetBytes();
+  unsigned int len = body.GetCurrentPosition();
+  unsigned int pos = 0;
+
+  while (pos < len) {
+    unsigned int size = GetInstructionSize(code + pos, len - pos);
+
+    if (size == 0)
+      return false;
+
+    Instruction instr;
+    instr.pos = pos;
+    instr.size = size;
+    instr.word = ReadInstruction(code + pos);
+    instr.op = GetOpcode(instr.word);
+    instr.target = -1;
+    instr.operand = PackedValue(PACKVALUE_NAMED);
+    instr.block = -1;
+    instr.result = -1;
+    instr.removed = false;
+    instr.pushTemp = -1;
+    instr.storeTemp = -1;
+
+    const char *operands = code + pos + INSTRUCTION_SIZE;
+
+    switch (instr.op) {
+    case OP_PUSH:
+    case OP_PUSH_NUM:
+    case OP_CALL:
+    case OP_CMD_CALL: {
+      instr.operand = ReadPackedOperand(instr.word, operands);
+
+      bool number = instr.operand.valueType == PACKVALUE_CONST_NUMBER ||
+                    instr.operand.valueType == PACKVALUE_CONST_ARRAY;
+      size_t tableSize = number ? header.constNumberTable->GetSize()
+                                : header.constStringTable->GetSize();
+
+      // Left for the verifier to reject
+      if (instr.operand.value >= tableSize)
+        return false;
+      break;
+    }
+
+    case OP_FORLOOP:
+      // The counter is read and written like a pushed variable
+      instr.operand = PackedValue(PACKVALUE_NAMED, ReadInstruction(operands));
+      break;
+
+    case OP_STORE_TEMP:
+    case OP_PUSH_TEMP:
+      // Already optimised, its temps would be reused
+      return false;
+
+    default:
+      break;
+    }
+
+    instructions.push_back(instr);
+    pos += size;
+  }
+
+  for (auto &instr : instructions) {
+    if (!IsJump(instr.op))
+      continue;
+
+    int64_t target = (int64_t)instr.pos + GetJumpOffset(instr.word);
+
+    if (target == len) {
+      instr.target = instructions.size();
+    } else if (target < 0 || target > len ||
+               (instr.target = FindInstruction(target)) == -1) {
+      return false;
+    }
+  }
+
+  return !instructions.empty();
+}
+
+bool Optimizer::BuildBlocks()
+{
+  int count = instructions.size();
+  std::vector<bool> leaders(count + 1, false);
+  std::vector<bool> entries(count + 1, false);
+
+  leaders[0] = true;
+  entries[0] = true;
+
+  for (auto &function : header.functionOffsetTable) {
+    int start = FindInstruction(function.second);
+
+    if (start == -1)
+      return false;
+
+    leaders[start] = true;
+    entries[start] = true;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    Instruction &instr = instructions[i];
+
+    if (instr.target != -1)
+      leaders[instr.target] = true;
+
+    // Script functions are entered by calls rather than jumps
+    if (instr.op == OP_JAL)
+      entries[instr.target] = true;
+
+    switch (instr.op) {
+    case OP_JMP:
+    case OP_JEZ:
+    case OP_JNZ:
+    case OP_FORLOOP:
+    case OP_RET:
+    case OP_STOP:
+      leaders[i + 1] = true;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (leaders[i]) {
+      Block block;
+      block.first = i;
+      block.depth = -1;
+      block.entry = entries[i];
+      block.idom = -1;
+      block.order = -1;
+
+      blocks.push_back(block);
+    }
+
+    blocks.back().last = i;
+    instructions[i].block = blocks.size() - 1;
+  }
+
+  for (int b = 0; b < (int)blocks.size(); ++b) {
+    Instruction &last = instructions[blocks[b].last];
+    std::vector<int> succs;
+
+    if (last.op != OP_JMP && last.op != OP_RET && last.op != OP_STOP)
+      succs.push_back(blocks[b].last + 1);
+
+    if (last.op == OP_JMP || last.op == OP_JEZ || last.op == OP_JNZ ||
+        last.op == OP_FORLOOP)
+      succs.push_back(last.target);
+
+    // Running off the end stops the script
+    for (int next : succs) {
+      if (next >= count)
+        continue;
+
+      int succ = instructions[next].block;
+
+      if (std::find(blocks[b].succs.begin(), blocks[b].succs.end(), succ) ==
+          blocks[b].succs.end()) {
+        blocks[b].succs.push_back(succ);
+        blocks[succ].preds.push_back(b);
+      }
+    }
+  }
+
+  // Follow the stack depth from every entry, which all start out empty
+  std::vector<int> pending;
+
+  for (int b = 0; b < (int)blocks.size(); ++b) {
+    if (blocks[b].entry) {
+      blocks[b].depth = 0;
+      pending.push_back(b);
+    }
+  }
+
+  while (!pending.empty()) {
+    Block &block = blocks[pending.back()];
+    pending.pop_back();
+
+    int64_t depth = block.depth;
+
+    for (int i = block.first; i <= block.last; ++i) {
+      int64_t pops, pushes;
+
+      if (!GetInstructionStackUse(body.GetBytes() + instructions[i].pos,
+                                  *header.constNumberTable, pops, pushes) ||
+          depth < pops)
+        return false;
+
+      depth += pushes - pops;
+    }
+
+    for (int succ : block.succs) {
+      if (blocks[succ].depth == -1) {
+        blocks[succ].depth = depth;
+        pending.push_back(succ);
+      } else if (blocks[succ].depth != depth) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool Optimizer::BuildValues()
+{
+  // A phi for every slot of the stack a block is entered with
+  for (int b = 0; b < (int)blocks.size(); ++b) {
+    for (int slot = 0; slot < blocks[b].depth; ++slot) {
+      blocks[b].entryStack.push_back(values.size());
+      values.push_back({-1, b, {}, -1, -1, -1});
+    }
+  }
+
+  for (int b = 0; b < (int)blocks.size(); ++b) {
+    Block &block = blocks[b];
+
+    if (block.depth == -1)
+      continue;
+
+    std::vector<int> stack = block.entryStack;
+
+    for (int i = block.first; i <= block.last; ++i) {
+      Instruction &instr = instructions[i];
+      int64_t pops, pushes;
+
+      GetInstructionStackUse(body.GetBytes() + instr.pos,
+                             *header.constNumberTable, pops, pushes);
+
+      instr.args.assign(stack.end() - pops, stack.end());
+      stack.resize(stack.size() - pops);
+
+      for (int arg : instr.args)
+        values[arg].user = i;
+
+      if (pushes == 0)
+        continue;
+
+      Value value = {i, b, {}, -1, -1, -1};
+
+      switch (instr.op) {
+      case OP_PUSH:
+        if (instr.operand.valueType == PACKVALUE_CONST_NUMBER)
+          value.rangeStart = i;
+        break;
+
+      case OP_PUSH_NUM:
+      case OP_PUSH0:
+      case OP_PUSH1:
+      case OP_PUSHI:
+        value.rangeStart = i;
+        break;
+
+      case OP_ADD_NN:
+      case OP_SUB_NN:
+      case OP_MUL_NN:
+      case OP_DIV_NN:
+      case OP_MOD_NN:
+      case OP_POW_NN: {
+        // The operands' code has to run straight into the operator
+        Value &left = values[instr.args[0]];
+        Value &right = values[instr.args[1]];
+
+        if (left.rangeStart != -1 && right.rangeStart != -1 &&
+            left.instr + 1 == right.rangeStart && right.instr + 1 == i)
+          value.rangeStart = left.rangeStart;
+        break;
+      }
+
+      default:
+        break;
+      }
+
+      instr.result = values.size();
+      stack.push_back(instr.result);
+      values.push_back(value);
+    }
+
+    block.exitStack = stack;
+  }
+
+  for (auto &block : blocks) {
+    if (block.depth == -1)
+      continue;
+
+    for (int pred : block.preds) {
+      for (int slot = 0; slot < block.depth; ++slot) {
+        values[block.entryStack[slot]].inputs.push_back(
+            blocks[pred].exitStack[slot]);
+      }
+    }
+  }
+
+  return true;
+}
+
+void Optimizer::ComputeDominators()
+{
+  // Entries hang off a root standing for whatever runs the body
+  int root = blocks.size();
+  std::vector<int> postorder;
+  std::vector<bool> seen(blocks.size(), false);
+
+  for (int b = 0; b < root; ++b) {
+    if (!blocks[b].entry || seen[b])
+      continue;
+
+    // Blocks and how many of their successors have been walked
+    std::vector<std::pair<int, size_t>> walk = {{b, 0}};
+    seen[b] = true;
+
+    while (!walk.empty()) {
+      auto &top = walk.back();
+      Block &block = blocks[top.first];
+
+      if (top.second < block.succs.size()) {
+        int succ = block.succs[top.second++];
+
+        if (!seen[succ]) {
+          seen[succ] = true;
+          walk.push_back({succ, 0});
+        }
+      } else {
+        postorder.push_back(top.first);
+        walk.pop_back();
+      }
+    }
+  }
+
+  order.assign(postorder.rbegin(), postorder.rend());
+
+  for (size_t i = 0; i < order.size(); ++i)
+    blocks[order[i]].order = i;
+
+  auto orderOf = [&](int b) { return b == root ? -1 : blocks[b].order; };
+  auto idomOf = [&](int b) { return b == root ? root : blocks[b].idom; };
+
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (orderOf(a) > orderOf(b))
+        a = idomOf(a);
+
+      while (orderOf(b) > orderOf(a))
+        b = idomOf(b);
+    }
+
+    return a;
+  };
+
+  for (int b : order) {
+    if (blocks[b].entry)
+      blocks[b].idom = root;
+  }
+
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    for (int b : order) {
+      if (blocks[b].entry)
+        continue;
+
+      int idom = -1;
+
+      for (int pred : blocks[b].preds) {
+        if (blocks[pred].idom == -1)
+          continue;
+
+        idom = idom == -1 ? pred : intersect(pred, idom);
+      }
+
+      if (idom != blocks[b].idom) {
+        blocks[b].idom = idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+void Optimizer::PropagateCopies()
+{
+  // A phi whose inputs are all one value, other than itself, is that value
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    for (int v = 0; v < (int)values.size(); ++v) {
+      Value &value = values[v];
+
+      if (value.instr != -1 || value.copyOf != -1)
+        continue;
+
+      int same = -1;
+      bool trivial = true;
+
+      for (int input : value.inputs) {
+        int resolved = Resolve(input);
+
+        if (resolved == v || resolved == same)
+          continue;
+
+        if (same != -1) {
+          trivial = false;
+          break;
+        }
+
+        same = resolved;
+      }
+
+      if (trivial && same != -1) {
+        value.copyOf = same;
+        changed = true;
+      }
+    }
+  }
+}
+
+void Optimizer::EliminateDeadStores()
+{
+  for (auto &block : blocks) {
+    if (block.depth == -1)
+      continue;
+
+    // Number stores nothing has read since, by variable
+    std::map<uint32_t, int> unread;
+
+    for (int i = block.first; i <= block.last; ++i) {
+      Instruction &instr = instructions[i];
+      uint32_t name;
+
+      // Pushing a variable to assign to doesn't read it
+      int user = instr.result != -1 ? values[instr.result].user : -1;
+      bool target = instr.op == OP_PUSH && user != -1 &&
+                    instructions[user].op == OP_ASSIGN &&
+                    instructions[user].args[0] == instr.result;
+
+      switch (GetRead(i, name)) {
+      case ACCESS_ANY:
+        unread.clear();
+        break;
+
+      case ACCESS_NAME:
+        if (!target)
+          unread.erase(name);
+        break;
+
+      default:
+        break;
+      }
+
+      Access write = GetWrite(i, name);
+
+      if (write == ACCESS_ANY)
+        unread.clear();
+
+      if (write != ACCESS_NAME)
+        continue;
+
+      bool number = instr.op == OP_ASSIGN && IsNumber(instr.args[1]);
+      auto itr = unread.find(name);
+
+      if (itr != unread.end() && number) {
+        Instruction &store = instructions[itr->second];
+        int start = values[store.args[0]].instr;
+
+        Log::Get().Print(LOGLEVEL_VERBOSE, "%5d OPTIMIZE DEAD STORE\n",
+                         instructions[start].pos);
+
+        for (int j = start; j <= itr->second; ++j)
+          instructions[j].removed = true;
+      }
+
+      unread.erase(name);
+
+      if (!number)
+        continue;
+
+      // Only a store whose code is its own can be dropped
+      Value &variable = values[instr.args[0]];
+      Value &value = values[instr.args[1]];
+
+      if (variable.instr != -1 && instructions[variable.instr].op == OP_PUSH &&
+          value.rangeStart == variable.instr + 1 && value.instr == i - 1 &&
+          !IsRewritten(variable.instr, i))
+        unread[name] = i;
+    }
+  }
+}
+
+void Optimizer::HoistInvariants()
+{
+  const char *code = body.GetBytes();
+
+  // Natural loops by their head, the blocks which reach a jump back to it
+  // without going through it
+  std::map<int, std::vector<bool>> loops;
+
+  for (int b = 0; b < (int)blocks.size(); ++b) {
+    if (blocks[b].depth == -1)
+      continue;
+
+    for (int head : blocks[b].succs) {
+      if (!Dominates(head, b))
+        continue;
+
+      std::vector<bool> &inLoop = loops[head];
+
+      if (inLoop.empty()) {
+        inLoop.assign(blocks.size(), false);
+        inLoop[head] = true;
+      }
+
+      std::vector<int> pending = {b};
+
+      while (!pending.empty()) {
+        int n = pending.back();
+        pending.pop_back();
+
+        if (inLoop[n])
+          continue;
+
+        inLoop[n] = true;
+
+        for (int pred : blocks[n].preds) {
+          if (blocks[pred].depth != -1)
+            pending.push_back(pred);
+        }
+      }
+    }
+  }
+
+  // Outer loops first, so code is hoisted as far out as it can go
+  std::vector<std::pair<int, int>> bySize;
+
+  for (auto &loop : loops) {
+    int size = std::count(loop.second.begin(), loop.second.end(), true);
+    bySize.push_back({-size, loop.first});
+  }
+
+  std::sort(bySize.begin(), bySize.end());
+
+  for (auto &entry : bySize) {
+    int head = entry.second;
+    std::vector<bool> &inLoop = loops[head];
+
+    // Calls can change any variable and would clobber temps
+    std::set<uint32_t> written;
+    bool calls = false;
+
+    for (int b = 0; b < (int)blocks.size() && !calls; ++b) {
+      if (!inLoop[b])
+        continue;
+
+      // Functions starting inside the loop would run without the temps
+      if (blocks[b].entry) {
+        calls = true;
+        break;
+      }
+
+      for (int i = blocks[b].first; i <= blocks[b].last; ++i) {
+        uint32_t name;
+
+        if (GetRead(i, name) == ACCESS_ANY) {
+          calls = true;
+          break;
+        }
+
+        switch (GetWrite(i, name)) {
+        case ACCESS_ANY:
+          calls = true;
+          break;
+
+        case ACCESS_NAME:
+          written.insert(name);
+          break;
+
+        default:
+          break;
+        }
+      }
+    }
+
+    if (calls)
+      continue;
+
+    // The loop has to be entered from a single block, whose end the code
+    // can go at
+    int preheader = -1;
+    bool single = true;
+
+    for (int pred : blocks[head].preds) {
+      if (inLoop[pred])
+        continue;
+
+      single = preheader == -1;
+      preheader = pred;
+    }
+
+    if (!single || preheader == -1)
+      continue;
+
+    Instruction &last = instructions[blocks[preheader].last];
+    bool before;
+
+    switch (last.op) {
+    case OP_JMP:
+    case OP_JEZ:
+    case OP_JNZ:
+      before = true;
+      break;
+
+    case OP_FORLOOP:
+    case OP_RET:
+    case OP_STOP:
+      continue;
+
+    default:
+      before = false;
+      break;
+    }
+
+    // The same code is only hoisted once
+    std::map<std::string, int> temps;
+
+    for (int b = 0; b < (int)blocks.size(); ++b) {
+      if (!inLoop[b])
+        continue;
+
+      for (int i = blocks[b].first; i <= blocks[b].last; ++i) {
+        int v = instructions[i].result;
+
+        if (v == -1 || !IsInvariant(v, written))
+          continue;
+
+        // Code hoisted as part of what uses it
+        int user = values[v].user;
+
+        if (user != -1 && instructions[user].result != -1 &&
+            IsInvariant(instructions[user].result, written))
+          continue;
+
+        // A constant is as quick to push as a temp
+        int start = values[v].rangeStart;
+
+        if (start == i && instructions[i].op != OP_PUSH_NUM)
+          continue;
+
+        if (IsRewritten(start, i))
+          continue;
+
+        uint32_t startPos = instructions[start].pos;
+        uint32_t endPos = instructions[i].pos + instructions[i].size;
+        std::string bytes(code + startPos, endPos - startPos);
+        auto itr = temps.find(bytes);
+        int temp;
+
+        if (itr != temps.end()) {
+          temp = itr->second;
+        } else {
+          if (hoistTemps >= TEMP_COUNT_MAX)
+            continue;
+
+          temp = hoistTemps++;
+          temps[bytes] = temp;
+
+          hoists.push_back({start, i, temp});
+          (before ? last.hoistBefore : last.hoistAfter)
+              .push_back(hoists.size() - 1);
+        }
+
+        Log::Get().Print(LOGLEVEL_VERBOSE, "%5d OPTIMIZE HOIST TO TEMP %d\n",
+                         startPos, temp);
+
+        for (int j = start; j <= i; ++j)
+          instructions[j].removed = true;
+
+        instructions[start].pushTemp = temp;
+      }
+    }
+  }
+}
+
+void Optimizer::EliminateCommonSubexpressions()
+{
+  // Values are numbered by the first value in the block known to be equal,
+  // loads by the variable and how many times it's been written to
+  enum { KEY_LOAD, KEY_CONSTANT, KEY_ARITHMETIC, KEY_TEMP };
+  typedef std::tuple<int, int64_t, int64_t, int64_t> Key;
+
+  std::vector<int> numbers(values.size());
+
+  for (size_t v = 0; v < values.size(); ++v)
+    numbers[v] = v;
+
+  auto numberOf = [&](int value) { return numbers[Resolve(value)]; };
+
+  for (auto &block : blocks) {
+    if (block.depth == -1)
+      continue;
+
+    std::map<Key, int> available;
+    std::map<uint32_t, int64_t> versions;
+    std::vector<int> redundant;
+
+    for (int i = block.first; i <= block.last; ++i) {
+      Instruction &instr = instructions[i];
+      int v = instr.result;
+      int start = v != -1 ? values[v].rangeStart : -1;
+
+      if (start != -1) {
+        Key key;
+        bool keyed = true;
+        double constant;
+
+        switch (instr.op) {
+        case OP_PUSH_NUM:
+          key = Key(KEY_LOAD, (uint32_t)instr.operand.value,
+                    versions[(uint32_t)instr.operand.value], 0);
+          break;
+
+        case OP_PUSH0:
+        case OP_PUSH1:
+        case OP_PUSHI:
+        case OP_PUSH:
+          if (instr.op == OP_PUSH)
+            constant =
+                header.constNumberTable->constants[instr.operand.value].val;
+          else if (instr.op == OP_PUSHI)
+            constant = GetImmediate(instr.word);
+          else
+            constant = instr.op == OP_PUSH1;
+
+          int64_t bits;
+          memcpy(&bits, &constant, sizeof(bits));
+
+          key = Key(KEY_CONSTANT, bits, 0, 0);
+          break;
+
+        default:
+          key = Key(KEY_ARITHMETIC, instr.op, numberOf(instr.args[0]),
+                    numberOf(instr.args[1]));
+          break;
+        }
+
+        // Hoisted code is known by its temp, as a whole rather than by the
+        // parts it starts with. Dropped code isn't known.
+        if (instr.removed) {
+          int user = values[v].user;
+          int whole = user != -1 ? instructions[user].result : -1;
+
+          keyed = instructions[start].pushTemp != -1 &&
+                  !(whole != -1 && instructions[user].removed &&
+                    values[whole].rangeStart == start);
+          key = Key(KEY_TEMP, instructions[start].pushTemp, 0, 0);
+        }
+
+        if (keyed) {
+          auto itr = available.find(key);
+
+          if (itr == available.end()) {
+            available[key] = v;
+          } else {
+            numbers[v] = itr->second;
+
+            if (!instr.removed && (start != i || instr.op == OP_PUSH_NUM))
+              redundant.push_back(v);
+          }
+        }
+      }
+
+      uint32_t name;
+      Access write = GetWrite(i, name);
+
+      if (write == ACCESS_ANY || GetRead(i, name) == ACCESS_ANY) {
+        available.clear();
+        versions.clear();
+      } else if (write == ACCESS_NAME) {
+        versions[name]++;
+      }
+    }
+
+    // Whole expressions are replaced before what's inside them
+    int nextTemp = hoistTemps;
+
+    for (auto itr = redundant.rbegin(); itr != redundant.rend(); ++itr) {
+      int v = *itr;
+      int end = values[v].instr;
+      int start = values[v].rangeStart;
+      Value &original = values[numbers[v]];
+      Instruction &originalEnd = instructions[original.instr];
+
+      if (IsRewritten(start, end))
+        continue;
+
+      int temp;
+
+      if (originalEnd.removed) {
+        temp = instructions[original.rangeStart].pushTemp;
+
+        if (temp == -1)
+          continue;
+      } else if (originalEnd.storeTemp != -1) {
+        temp = originalEnd.storeTemp;
+      } else {
+        if (nextTemp >= TEMP_COUNT_MAX)
+          continue;
+
+        temp = nextTemp++;
+        originalEnd.storeTemp = temp;
+      }
+
+      Log::Get().Print(LOGLEVEL_VERBOSE, "%5d OPTIMIZE REUSE TEMP %d\n",
+                       instructions[start].pos, temp);
+
+      for (int j = start; j <= end; ++j)
+        instructions[j].removed = true;
+
+      instructions[start].pushTemp = temp;
+      values[v].copyOf = numbers[v];
+    }
+  }
+}
+
+void Optimizer::Encode()
+{
+  const char *code = body.GetBytes();
+  ByteBuffer output;
+
+  // Where each instruction went, jumps are pointed at them once it's known
+  std::vector<uint32_t> positions(instructions.size() + 1);
+  std::vector<std::pair<int, uint32_t>> jumps;
+
+  auto emitHoists = [&](const std::vector<int> &list) {
+    for (int h : list) {
+      Hoist &hoist = hoists[h];
+      uint32_t start = instructions[hoist.start].pos;
+      uint32_t end = instructions[hoist.end].pos + instructions[hoist.end].size;
+
+      output.WriteBytes(code + start, end - start);
+      output.WriteU32(MakeInstruction(OP_STORE_TEMP, hoist.temp));
+      output.WriteU32(MakeInstruction(OP_POP));
+    }
+  };
+
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    Instruction &instr = instructions[i];
+
+    positions[i] = output.GetLength();
+    emitHoists(instr.hoistBefore);
+
+    if (instr.pushTemp != -1)
+      output.WriteU32(MakeInstruction(OP_PUSH_TEMP, instr.pushTemp));
+
+    if (!instr.removed) {
+      if (instr.target != -1)
+        jumps.push_back({i, output.GetLength()});
+
+      output.WriteBytes(code + instr.pos, instr.size);
+    }
+
+    if (instr.storeTemp != -1)
+      output.WriteU32(MakeInstruction(OP_STORE_TEMP, instr.storeTemp));
+
+    emitHoists(instr.hoistAfter);
+  }
+
+  positions[instructions.size()] = output.GetLength();
+
+  for (auto &jump : jumps) {
+    Instruction &instr = instructions[jump.first];
+
+    Reservation(&output, jump.second, instr.op)
+        .Emit((int)positions[instr.target] - (int)jump.second);
+  }
+
+  for (auto &function : header.functionOffsetTable)
+    function.second = positions[FindInstruction(function.second)];
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "OPTIMIZE: %u bytes to %u\n",
+                   body.GetCurrentPosition(), output.GetLength());
+
+  body.SwapBuffer(output);
+}
+
+int Optimizer::FindInstruction(uint32_t pos)
+{
+  auto itr = std::lower_bound(
+      instructions.begin(), instructions.end(), pos,
+      [](const Instruction &instr, uint32_t pos) { return instr.pos < pos; });
+
+  if (itr == instructions.end() || itr->pos != pos)
+    return -1;
+
+  return itr - instructions.begin();
+}
+
+int Optimizer::Resolve(int value)
+{
+  while (values[value].copyOf != -1)
+    value = values[value].copyOf;
+
+  return value;
+}
+
+bool Optimizer::Dominates(int a, int b)
+{
+  int root = blocks.size();
+
+  while (b != -1 && b != root) {
+    if (b == a)
+      return true;
+
+    b = blocks[b].idom;
+  }
+
+  return false;
+}
+
+int Optimizer::GetVariableName(int value)
+{
+  int instr = values[Resolve(value)].instr;
+
+  if (instr == -1 || instructions[instr].op != OP_PUSH ||
+      instructions[instr].operand.valueType != PACKVALUE_NAMED)
+    return -1;
+
+  return instructions[instr].operand.value;
+}
+
+bool Optimizer::IsNumber(int value)
+{
+  int instr = values[Resolve(value)].instr;
+
+  if (instr == -1)
+    return false;
+
+  switch (instructions[instr].op) {
+  case OP_PUSH:
+    return instructions[instr].operand.valueType == PACKVALUE_CONST_NUMBER;
+
+  case OP_PUSH_NUM:
+  case OP_PUSH0:
+  case OP_PUSH1:
+  case OP_PUSHI:
+  case OP_ADD_NN:
+  case OP_SUB_NN:
+  case OP_MUL_NN:
+  case OP_DIV_NN:
+  case OP_MOD_NN:
+  case OP_POW_NN:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+Optimizer::Access Optimizer::GetRead(int i, uint32_t &name)
+{
+  Instruction &instr = instructions[i];
+
+  switch (instr.op) {
+  case OP_PUSH:
+    if (instr.operand.valueType != PACKVALUE_NAMED &&
+        instr.operand.valueType != PACKVALUE_NAMED_VALUE)
+      return ACCESS_NONE;
+
+    name = instr.operand.value;
+    return ACCESS_NAME;
+
+  case OP_PUSH_NUM:
+  case OP_FORLOOP:
+    name = instr.operand.value;
+    return ACCESS_NAME;
+
+  case OP_ARR_GET:
+  case OP_ARR_SET: {
+    int variable = GetVariableName(instr.args[0]);
+
+    if (variable == -1)
+      return ACCESS_ANY;
+
+    name = variable;
+    return ACCESS_NAME;
+  }
+
+  default:
+    // Pushed variables are read as they're pushed, anything which can write
+    // to any variable can read any too
+    return GetWrite(i, name) == ACCESS_ANY ? ACCESS_ANY : ACCESS_NONE;
+  }
+}
+
+Optimizer::Access Optimizer::GetWrite(int i, uint32_t &name)
+{
+  Instruction &instr = instructions[i];
+
+  switch (instr.op) {
+  case OP_ASSIGN:
+  case OP_ARR_SET:
+  case OP_INC:
+  case OP_DEC:
+  case OP_INCPUSH:
+  case OP_DECPUSH: {
+    int variable = GetVariableName(instr.args[0]);
+
+    if (variable == -1)
+      return ACCESS_ANY;
+
+    name = variable;
+    return ACCESS_NAME;
+  }
+
+  case OP_FORLOOP:
+    name = instr.operand.value;
+    return ACCESS_NAME;
+
+  case OP_PUSH:
+  case OP_PUSH_NUM:
+  case OP_PUSH0:
+  case OP_PUSH1:
+  case OP_PUSHI:
+  case OP_ARR_GET:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_POW:
+  case OP_EQ:
+  case OP_LT:
+  case OP_GT:
+  case OP_LTE:
+  case OP_GTE:
+  case OP_NOT:
+  case OP_ADD_NN:
+  case OP_SUB_NN:
+  case OP_MUL_NN:
+  case OP_DIV_NN:
+  case OP_MOD_NN:
+  case OP_POW_NN:
+  case OP_EQ_NN:
+  case OP_LT_NN:
+  case OP_GT_NN:
+  case OP_LTE_NN:
+  case OP_GTE_NN:
+  case OP_POP:
+  case OP_JMP:
+  case OP_JEZ:
+  case OP_JNZ:
+  case OP_RET:
+  case OP_STOP:
+    return ACCESS_NONE;
+
+  default:
+    // Calls
+    return ACCESS_ANY;
+  }
+}
+
+bool Optimizer::IsInvariant(int value, const std::set<uint32_t> &written)
+{
+  int start = values[value].rangeStart;
+
+  if (start == -1)
+    return false;
+
+  for (int i = start; i <= values[value].instr; ++i) {
+    if (instructions[i].op == OP_PUSH_NUM &&
+        written.count(instructions[i].operand.value))
+      return false;
+  }
+
+  return true;
+}
+
+bool Optimizer::IsRewritten(int start, int end)
+{
+  for (int i = start; i <= end; ++i) {
+    Instruction &instr = instructions[i];
+
+    if (instr.removed || instr.pushTemp != -1 || instr.storeTemp != -1 ||
+        !instr.hoistBefore.empty() || !instr.hoistAfter.empty())
+      return true;
+  }
+
+  return false;
+}
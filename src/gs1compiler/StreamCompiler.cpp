@@ -0,0 +1,941 @@
+#include <gs1/common/Log.hpp>
+#include <gs1/compiler/StreamCompiler.hpp>
+
+#include <climits>
+
+using namespace gs1;
+
+// Opcode for a binary operator, OP_NUM_OPS if it doesn't emit one
+static Opcode GetBinaryOpcode(TokenType type)
+{
+  switch (type) {
+  case TokOpAssign:
+    return OP_ASSIGN;
+
+  case TokOpEquals:
+  case TokOpNotEquals:
+    return OP_EQ;
+
+  case TokOpLessThan:
+    return OP_LT;
+
+  case TokOpGreaterThan:
+    return OP_GT;
+
+  case TokOpLessThanOrEqual:
+    return OP_LTE;
+
+  case TokOpGreaterThanOrEqual:
+    return OP_GTE;
+
+  case TokOpAdd:
+  case TokOpAddAssign:
+    return OP_ADD;
+
+  case TokOpSub:
+  case TokOpSubAssign:
+    return OP_SUB;
+
+  case TokOpMul:
+  case TokOpMulAssign:
+    return OP_MUL;
+
+  case TokOpDiv:
+  case TokOpDivAssign:
+    return OP_DIV;
+
+  case TokOpMod:
+  case TokOpModAssign:
+    return OP_MOD;
+
+  case TokOpPow:
+  case TokOpPowAssign:
+    return OP_POW;
+
+  default:
+    return OP_NUM_OPS;
+  }
+}
+
+static bool IsOpAssign(TokenType type)
+{
+  switch (type) {
+  case TokOpAddAssign:
+  case TokOpSubAssign:
+  case TokOpMulAssign:
+  case TokOpDivAssign:
+  case TokOpModAssign:
+  case TokOpPowAssign:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+StreamCompiler::StreamCompiler(DiagBuilder &diag,
+                               const PrototypeMap &commands,
+                               const PrototypeMap &functions)
+    : lexer(nullptr), realDiag(diag), silentDiag([](const Diag &) {}),
+      diag(&diag), commands(commands), functions(functions), lastEnd(0),
+      depth(0)
+{
+}
+
+void StreamCompiler::Compile(Lexer &lexer)
+{
+  Begin(lexer);
+
+  while (ParseStmt(true)) {
+  }
+
+  if (token.type == TokEOF) {
+    EatTerminal();
+  } else {
+    diag->Warn(token.GetRange().beg, Range(), "expected end of file");
+  }
+
+  // Every function is known now, calls to them can go straight there
+  body.LinkFunctions(*header.constStringTable, header.functionOffsetTable);
+}
+
+void StreamCompiler::CompileExpression(Lexer &lexer)
+{
+  Begin(lexer);
+
+  ParseExpr(false, 0, VALUE_USED);
+
+  if (token.type == TokEOF) {
+    EatTerminal();
+  } else {
+    diag->Error(token.GetRange().beg, Range(), "expected end of expression");
+  }
+}
+
+void StreamCompiler::Begin(Lexer &lexer)
+{
+  header.Clear();
+  body.Clear();
+  pending.clear();
+
+  this->lexer = &lexer;
+  token = Token();
+  lastEnd = 0;
+  depth = 0;
+
+  lexer.SetKeepTrivia(false);
+  EatTerminal();
+}
+
+void StreamCompiler::WriteBytecode(ByteBuffer &buffer)
+{
+  header.Write(buffer, body.GetBytes(), body.GetCurrentPosition());
+}
+
+ByteBuffer StreamCompiler::GetBytecode()
+{
+  ByteBuffer buffer;
+  WriteBytecode(buffer);
+
+  return buffer;
+}
+
+void StreamCompiler::EatTerminal()
+{
+  // Trivia is skipped by the lexer, and nothing past this token is lexed so
+  // a string argument can still be flagged
+  lastEnd = token.offset + token.length;
+  token = lexer->Current();
+  lexer->Advance();
+}
+
+void StreamCompiler::EatTerminal(TokenType type)
+{
+  if (token.type == type) {
+    EatTerminal();
+  } else {
+    diag->Error(token.GetRange().beg, Range(), "expected '%s' got '%s'",
+                GetTokenTypeSpelling(type), GetTokenTypeSpelling(token.type));
+  }
+}
+
+StreamCompiler::SourceMark StreamCompiler::Mark()
+{
+  return {token, lexer->GetOffset(), lastEnd};
+}
+
+void StreamCompiler::Restore(const SourceMark &mark)
+{
+  lexer->Seek(mark.offset);
+  token = mark.token;
+  lastEnd = mark.lastEnd;
+}
+
+// --------------------------------------------------
+// Statements
+// --------------------------------------------------
+
+bool StreamCompiler::ParseStmt(bool optional)
+{
+  switch (token.type) {
+  case TokSemicolon:
+    EatTerminal(TokSemicolon);
+    return true;
+  case TokLeftBrace:
+    ParseStmtBlock();
+    return true;
+  case TokKwIf:
+    ParseStmtIf();
+    return true;
+  case TokKwFor:
+    ParseStmtFor();
+    return true;
+  case TokKwWhile:
+    ParseStmtWhile();
+    return true;
+  case TokKwBreak:
+    ParseStmtBreak();
+    return true;
+  case TokKwContinue:
+    ParseStmtContinue();
+    return true;
+  case TokKwReturn:
+    ParseStmtReturn();
+    return true;
+  case TokKwFunction: {
+    uint32_t begin = token.offset;
+    ParseStmtFunctionDecl();
+    if (depth != 0) {
+      diag->Error(Pos(), Range(Pos(begin), Pos(lastEnd)),
+                  "function declaration not at top level");
+    }
+    return true;
+  }
+  default:
+    break;
+  }
+
+  if (token.type == TokId) {
+    auto it = commands.find(string(lexer->GetText(token)));
+    if (it != commands.end()) {
+      ParseStmtCommand(it->second);
+      return true;
+    }
+  }
+
+  unsigned int start = body.GetCurrentPosition();
+
+  if (ParseExpr(true, 0, VALUE_DISCARDED).valid) {
+    // Nothing uses the value of an expression statement
+    body.EmitDiscard(start, *header.constNumberTable);
+
+    EatTerminal(TokSemicolon);
+    return true;
+  }
+
+  if (!optional) {
+    diag->Error(token.GetRange().beg, Range(), "expected statement");
+  }
+
+  return false;
+}
+
+void StreamCompiler::ParseStmtBlock()
+{
+  depth++;
+
+  EatTerminal(TokLeftBrace);
+
+  while (token.type != TokRightBrace) {
+    if (!ParseStmt()) {
+      break;
+    }
+  }
+
+  EatTerminal(TokRightBrace);
+
+  depth--;
+}
+
+void StreamCompiler::ParseStmtIf()
+{
+  depth++;
+
+  EatTerminal(TokKwIf);
+  EatTerminal(TokLeftParen);
+  ExprResult cond = ParseExpr(false, 0, VALUE_DISCARDED);
+  EatTerminal(TokRightParen);
+
+  body.PatchRead(cond.type, cond.start);
+
+  // Jump past the body if the condition is false
+  Reservation offsetReservation = body.EmitJump(OP_JEZ);
+
+  ParseStmt();
+
+  if (token.type == TokKwElse) {
+    EatTerminal();
+
+    // Skip the else body at the end of the "then" body
+    Reservation elseOffsetReservation = body.EmitJump(OP_JMP);
+
+    offsetReservation.Emit(body.GetCurrentPosition() -
+                           offsetReservation.GetPosition());
+
+    ParseStmt();
+
+    elseOffsetReservation.Emit(body.GetCurrentPosition() -
+                               elseOffsetReservation.GetPosition());
+  } else {
+    offsetReservation.Emit(body.GetCurrentPosition() -
+                           offsetReservation.GetPosition());
+  }
+
+  depth--;
+}
+
+void StreamCompiler::ParseStmtFor()
+{
+  depth++;
+
+  EatTerminal(TokKwFor);
+  EatTerminal(TokLeftParen);
+
+  unsigned int initPosition = body.GetCurrentPosition();
+
+  if (ParseExpr(true, 0, VALUE_DISCARDED).valid)
+    body.EmitDiscard(initPosition, *header.constNumberTable);
+
+  EatTerminal(TokSemicolon);
+
+  unsigned int stepConditionPosition = body.GetCurrentPosition();
+
+  // Without a condition the loop only ends through a break
+  ExprResult cond = ParseExpr(true, 0, VALUE_DISCARDED);
+  bool hasCondition = cond.valid;
+  EatTerminal(TokSemicolon);
+
+  Reservation failReservation(nullptr, 0);
+
+  if (hasCondition) {
+    body.PatchRead(cond.type, cond.start);
+    failReservation = body.EmitJump(OP_JEZ);
+  }
+
+  // The step is emitted after the body, and its constants have to be tabled
+  // after the body's too. Parse over it without a trace now and come back to
+  // it once the body is done.
+  SourceMark stepMark = Mark();
+  unsigned int stepCodePosition = body.GetCurrentPosition();
+  size_t stringCount = header.constStringTable->GetSize();
+  size_t numberCount = header.constNumberTable->GetSize();
+
+  diag = &silentDiag;
+  ParseExpr(true, 0, VALUE_DISCARDED);
+  diag = &realDiag;
+
+  body.Truncate(stepCodePosition);
+  header.constStringTable->Truncate(stringCount);
+  header.constNumberTable->Truncate(numberCount);
+
+  EatTerminal(TokRightParen);
+
+  body.BeginLoop();
+  ParseStmt();
+
+  // "continue" runs the step before checking the condition again
+  unsigned int stepPosition = body.GetCurrentPosition();
+
+  SourceMark bodyEndMark = Mark();
+  Restore(stepMark);
+
+  if (ParseExpr(true, 0, VALUE_DISCARDED).valid)
+    body.EmitDiscard(stepPosition, *header.constNumberTable);
+
+  Restore(bodyEndMark);
+
+  // Jump back to step condition, the body starts where the step parsed
+  // ahead of it was dropped
+  body.EmitForLoopEnd(stepConditionPosition, stepCodePosition, stepPosition,
+                      *header.constNumberTable);
+
+  if (hasCondition) {
+    failReservation.Emit(body.GetCurrentPosition() -
+                         failReservation.GetPosition());
+  }
+
+  body.EndLoop(stepPosition);
+
+  depth--;
+}
+
+void StreamCompiler::ParseStmtWhile()
+{
+  depth++;
+
+  unsigned int conditionPosition = body.GetCurrentPosition();
+
+  EatTerminal(TokKwWhile);
+  EatTerminal(TokLeftParen);
+  ExprResult cond = ParseExpr(false, 0, VALUE_DISCARDED);
+  EatTerminal(TokRightParen);
+
+  body.PatchRead(cond.type, cond.start);
+
+  // Jump out if the condition fails
+  Reservation failReservation = body.EmitJump(OP_JEZ);
+
+  body.BeginLoop();
+  ParseStmt();
+
+  // Jump back to condition check
+  body.EmitJump(OP_JMP, conditionPosition);
+
+  failReservation.Emit(body.GetCurrentPosition() -
+                       failReservation.GetPosition());
+
+  body.EndLoop(conditionPosition);
+
+  depth--;
+}
+
+void StreamCompiler::ParseStmtBreak()
+{
+  EatTerminal(TokKwBreak);
+  EatTerminal(TokSemicolon);
+
+  body.EmitBreak();
+}
+
+void StreamCompiler::ParseStmtContinue()
+{
+  EatTerminal(TokKwContinue);
+  EatTerminal(TokSemicolon);
+
+  body.EmitContinue();
+}
+
+void StreamCompiler::ParseStmtReturn()
+{
+  EatTerminal(TokKwReturn);
+  EatTerminal(TokSemicolon);
+
+  body.Emit(OP_RET);
+}
+
+void StreamCompiler::ParseStmtCommand(const vector<bool> &prototype)
+{
+  if (!prototype.empty() && prototype[0]) {
+    lexer->FlagNextAsString(false, prototype.size() == 1);
+  }
+
+  // Table command name
+  ConstantKey nameKey =
+      header.constStringTable->GetKey(string(lexer->GetText(token)));
+  EatTerminal(TokId);
+
+  // Emit arguments
+  for (size_t i = 0; i < prototype.size(); i++) {
+    if (i != 0) {
+      if (prototype[i]) {
+        lexer->FlagNextAsString(false, i == prototype.size() - 1);
+      }
+
+      EatTerminal(TokComma);
+    }
+
+    ParseExpr(false, 0, VALUE_DISCARDED);
+  }
+
+  EatTerminal(TokSemicolon);
+
+  // Emit call, command name and argument count
+  body.EmitCall(OP_CMD_CALL, PackedValue(PACKVALUE_CONST_STRING, nameKey.index),
+                prototype.size());
+}
+
+void StreamCompiler::ParseStmtFunctionDecl()
+{
+  depth++;
+
+  EatTerminal(TokKwFunction);
+
+  // A missing name is tabled empty, as the tree would
+  std::string funcName;
+  if (token.type == TokId) {
+    funcName = string(lexer->GetText(token));
+  }
+
+  EatTerminal(TokId);
+  EatTerminal(TokLeftParen);
+  EatTerminal(TokRightParen);
+
+  header.constStringTable->GetKey(funcName);
+
+  auto reservation = body.BeginFunction();
+  header.functionOffsetTable[funcName] = body.GetCurrentPosition();
+
+  ParseStmt();
+
+  body.EndFunction(reservation);
+
+  depth--;
+}
+
+// --------------------------------------------------
+// Expressions
+// --------------------------------------------------
+
+StreamCompiler::ExprResult StreamCompiler::ParseExpr(bool optional,
+                                                     int precedence,
+                                                     ValueUse use)
+{
+  size_t pendingMark = pending.size();
+  ExprResult left;
+
+  switch (token.type) {
+  case TokId:
+    left = ParseExprId();
+    break;
+  case TokNumberLiteral:
+    left = ParseExprNumberLiteral();
+    break;
+  case TokStringLiteral:
+    left = ParseExprStringLiteral();
+    break;
+  case TokLeftParen:
+    // Parentheses leave no trace, the inner expression stands in for them
+    EatTerminal(TokLeftParen);
+    left = ParseExpr(false, 0, VALUE_DEFERRED);
+    EatTerminal(TokRightParen);
+    break;
+  case TokLeftBrace:
+    left = ParseExprList();
+    break;
+  case TokPipe:
+    left = ParseExprRange();
+    break;
+  default:
+    break;
+  }
+
+  if (!left.valid && IsUnaryPrefix(token.type)) {
+    left = ParseExprPrefixUnaryOp();
+  }
+
+  if (!left.valid) {
+    if (!optional) {
+      diag->Error(token.GetRange().beg, Range(), "expected expression");
+    }
+    return left;
+  }
+
+  while (true) {
+    if (IsBinaryOrTernaryOperator(token.type)) {
+      auto p = GetOperatorPrecedence(token.type);
+      if (p >= precedence) {
+        left = ParseExprBinaryOp(left, p, pendingMark);
+        continue;
+      }
+    }
+
+    if (IsUnaryPostfix(token.type)) {
+      // The operand now belongs to an expression which uses it
+      ResolvePending(pendingMark, true);
+
+      TokenType op = token.type;
+      EatTerminal();
+      EmitIncDec(op);
+
+      left = ExprResult(NodeExprUnaryOp, left.start, EXPRTYPE_NUMBER);
+      continue;
+    }
+
+    break;
+  }
+
+  if (use == VALUE_USED) {
+    ResolvePending(pendingMark, true);
+  } else if (use == VALUE_DISCARDED) {
+    ResolvePending(pendingMark, false);
+  }
+
+  return left;
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprId()
+{
+  unsigned int start = body.GetCurrentPosition();
+  string name(lexer->GetText(token));
+
+  EatTerminal(TokId);
+
+  if (token.type == TokLeftParen) {
+    auto it = functions.find(name);
+    if (it != functions.end()) {
+      return ParseExprCallBuiltin(name, start, it->second);
+    }
+
+    return ParseExprCall(name, start);
+  }
+
+  EmitId(name);
+
+  if (token.type == TokLeftBracket) {
+    return ParseExprIndex(start);
+  }
+
+  return ExprResult(NodeExprId, start, EXPRTYPE_VARIABLE);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprNumberLiteral()
+{
+  unsigned int start = body.GetCurrentPosition();
+
+  float num = std::stof(string(lexer->GetText(token)));
+
+  EatTerminal();
+
+  // Push number literal onto stack
+  body.EmitNumber(num, *header.constNumberTable);
+
+  return ExprResult(NodeExprNumberLiteral, start, EXPRTYPE_NUMBER);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprStringLiteral()
+{
+  unsigned int start = body.GetCurrentPosition();
+
+  // Table string literal
+  ConstantKey key =
+      header.constStringTable->GetKey(string(lexer->GetText(token)));
+
+  EatTerminal();
+
+  // Push string literal onto stack
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_CONST_STRING, key.index));
+
+  return ExprResult(NodeExprStringLiteral, start);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprList()
+{
+  unsigned int start = body.GetCurrentPosition();
+  uint32_t size = 0;
+
+  EatTerminal(TokLeftBrace);
+
+  while (token.type != TokRightBrace) {
+    ParseExpr(false, 0, VALUE_USED);
+    size++;
+
+    if (token.type == TokComma) {
+      EatTerminal();
+    } else {
+      break;
+    }
+  }
+
+  EatTerminal(TokRightBrace);
+
+  // Push size of array onto stack
+  ConstantKey key = header.constNumberTable->GetKey(size);
+
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_CONST_ARRAY, key.index));
+
+  return ExprResult(NodeExprList, start);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprRange()
+{
+  unsigned int start = body.GetCurrentPosition();
+
+  EatTerminal(TokPipe);
+  EatTerminal(TokNumberLiteral);
+  EatTerminal(TokComma);
+  EatTerminal(TokNumberLiteral);
+  EatTerminal(TokPipe);
+
+  return ExprResult(NodeExprRange, start);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprPrefixUnaryOp()
+{
+  unsigned int start = body.GetCurrentPosition();
+  TokenType op = token.type;
+
+  EatTerminal();
+  ParseExpr(false, INT_MAX, VALUE_USED);
+  EmitIncDec(op);
+
+  // Only increments and decrements emit anything, and push numbers
+  bool incDec = op == TokOpIncrement || op == TokOpDecrement;
+
+  return ExprResult(NodeExprUnaryOp, start,
+                    incDec ? EXPRTYPE_NUMBER : EXPRTYPE_ANY);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprBinaryOp(ExprResult left,
+                                                             int precedence,
+                                                             size_t pendingMark)
+{
+  if (token.type == TokOpTernary) {
+    return ParseExprTernaryOp(left, precedence);
+  }
+
+  // The left operand now belongs to an expression which uses it
+  ResolvePending(pendingMark, true);
+
+  TokenType op = token.type;
+  ExprType type = EXPRTYPE_ANY;
+  EatTerminal();
+
+  if (op == TokOpAnd) {
+    // Early-out if the left-hand condition is false
+    body.PatchRead(left.type, left.start);
+    Reservation leftFailReservation = body.EmitJump(OP_JEZ);
+
+    ExprResult right = ParseExpr(false, precedence, VALUE_USED);
+    body.PatchRead(right.type, right.start);
+
+    Reservation rightFailReservation = body.EmitJump(OP_JEZ);
+
+    // Push a 1, this is the success block
+    body.Emit(OP_PUSH1);
+
+    Reservation successReservation = body.EmitJump(OP_JMP);
+
+    leftFailReservation.Emit(body.GetCurrentPosition() -
+                             leftFailReservation.GetPosition());
+    rightFailReservation.Emit(body.GetCurrentPosition() -
+                              rightFailReservation.GetPosition());
+
+    // Push a zero, this is the failure block
+    body.Emit(OP_PUSH0);
+
+    successReservation.Emit(body.GetCurrentPosition() -
+                            successReservation.GetPosition());
+
+    type = EXPRTYPE_NUMBER;
+  } else if (op == TokOpOr) {
+    // Short-circuit if the left-hand condition is true
+    body.PatchRead(left.type, left.start);
+    Reservation leftSuccessReservation = body.EmitJump(OP_JNZ);
+
+    ExprResult right = ParseExpr(false, precedence, VALUE_USED);
+    body.PatchRead(right.type, right.start);
+
+    Reservation rightSuccessReservation = body.EmitJump(OP_JNZ);
+
+    // Push a zero, this is the failure block
+    body.Emit(OP_PUSH0);
+
+    Reservation failReservation = body.EmitJump(OP_JMP);
+
+    leftSuccessReservation.Emit(body.GetCurrentPosition() -
+                                leftSuccessReservation.GetPosition());
+    rightSuccessReservation.Emit(body.GetCurrentPosition() -
+                                 rightSuccessReservation.GetPosition());
+
+    // Push a 1, this is the success block
+    body.Emit(OP_PUSH1);
+
+    failReservation.Emit(body.GetCurrentPosition() -
+                         failReservation.GetPosition());
+
+    type = EXPRTYPE_NUMBER;
+  } else if (op == TokOpAssign && left.kind == NodeExprIndex) {
+    // Array assignment reuses the id and index, without the lookup
+    body.Truncate(body.GetCurrentPosition() - INSTRUCTION_SIZE);
+
+    ParseExpr(false, precedence, VALUE_USED);
+
+    body.Emit(OP_ARR_SET);
+  } else {
+    unsigned int leftStart = left.start;
+
+    // OpAssign needs the left operand twice, the copy is the one operated on
+    if (IsOpAssign(op)) {
+      leftStart = body.GetCurrentPosition();
+      body.EmitCopy(left.start, leftStart);
+    }
+
+    unsigned int rightStart = body.GetCurrentPosition();
+    ExprResult right = ParseExpr(false, precedence, VALUE_USED);
+
+    Opcode opcode = GetBinaryOpcode(op);
+    if (opcode == OP_ASSIGN) {
+      body.Emit(opcode);
+    } else if (opcode != OP_NUM_OPS) {
+      type = body.EmitNumberOp(opcode, left.type, leftStart, right.type,
+                               rightStart);
+    }
+
+    // There's no opcode for '!=', the equality is inverted
+    if (op == TokOpNotEquals)
+      body.Emit(OP_NOT);
+
+    if (IsOpAssign(op)) {
+      body.Emit(OP_ASSIGN);
+      type = EXPRTYPE_ANY;
+    }
+  }
+
+  return ExprResult(NodeExprBinaryOp, left.start, type);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprTernaryOp(ExprResult left,
+                                                              int precedence)
+{
+  // The condition is already emitted, jump past "then" if it's false
+  EatTerminal(TokOpTernary);
+
+  body.PatchRead(left.type, left.start);
+
+  Reservation failReservation = body.EmitJump(OP_JEZ);
+
+  ParseExpr(false, precedence, VALUE_DEFERRED);
+
+  Reservation successReservation = body.EmitJump(OP_JMP);
+
+  failReservation.Emit(body.GetCurrentPosition() -
+                       failReservation.GetPosition());
+
+  EatTerminal(TokColon);
+  ParseExpr(false, precedence, VALUE_DEFERRED);
+
+  successReservation.Emit(body.GetCurrentPosition() -
+                          successReservation.GetPosition());
+
+  return ExprResult(NodeExprTernaryOp, left.start);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprIndex(unsigned int start)
+{
+  // Array ID is already on the stack
+  EatTerminal(TokLeftBracket);
+  ParseExpr(false, 0, VALUE_USED);
+  EatTerminal(TokRightBracket);
+
+  body.Emit(OP_ARR_GET);
+
+  if (token.type == TokDot) {
+    EatTerminal(TokDot);
+    EatTerminal(TokId);
+
+    return ExprResult(NodeExprIndexDotLookup, start);
+  }
+
+  return ExprResult(NodeExprIndex, start);
+}
+
+StreamCompiler::ExprResult StreamCompiler::ParseExprCall(const string &name,
+                                                         unsigned int start)
+{
+  ConstantKey nameKey = header.constStringTable->GetKey(name);
+
+  EatTerminal(TokLeftParen);
+
+  bool hasComma = false;
+  uint32_t commaOffset = 0;
+  unsigned int argCount = 0;
+
+  while (token.type != TokRightParen) {
+    ParseExpr(false, 0, VALUE_USED);
+    argCount++;
+
+    if (token.type == TokComma) {
+      commaOffset = token.offset;
+      EatTerminal();
+      hasComma = true;
+    } else {
+      hasComma = false;
+      break;
+    }
+  }
+
+  if (hasComma) {
+    diag->Error(Pos(commaOffset), Range(), "trailing comma in argument list");
+  }
+
+  EatTerminal(TokRightParen);
+
+  // Emit call, function name and argument count
+  body.EmitCall(OP_CALL, PackedValue(PACKVALUE_CONST_STRING, nameKey.index),
+                argCount);
+
+  return ExprResult(NodeExprCall, start);
+}
+
+StreamCompiler::ExprResult
+StreamCompiler::ParseExprCallBuiltin(const string &name, unsigned int start,
+                                     const vector<bool> &prototype)
+{
+  ConstantKey nameKey = header.constStringTable->GetKey(name);
+
+  if (!prototype.empty() && prototype[0]) {
+    lexer->FlagNextAsString(true, prototype.size() == 1);
+  }
+
+  EatTerminal(TokLeftParen);
+
+  for (size_t i = 0; i < prototype.size(); i++) {
+    if (i != 0) {
+      if (prototype[i]) {
+        lexer->FlagNextAsString(true, i == prototype.size() - 1);
+      }
+
+      EatTerminal(TokComma);
+    }
+
+    ParseExpr(false, 0, VALUE_USED);
+  }
+
+  EatTerminal(TokRightParen);
+
+  // Emit call, function name and argument count
+  body.EmitCall(OP_CALL, PackedValue(PACKVALUE_CONST_STRING, nameKey.index),
+                prototype.size());
+
+  return ExprResult(NodeExprCall, start);
+}
+
+// --------------------------------------------------
+// Helper functions
+// --------------------------------------------------
+
+void StreamCompiler::EmitId(const string &name)
+{
+  ConstantKey key = header.constStringTable->GetKey(name);
+
+  body.Emit(OP_PUSH, PackedValue(PACKVALUE_NAMED, key.index));
+}
+
+void StreamCompiler::EmitIncDec(TokenType op)
+{
+  // Emitted without a push until it's known that the value is used
+  switch (op) {
+  case TokOpIncrement:
+    pending.push_back({body.GetCurrentPosition(), OP_INCPUSH});
+    body.Emit(OP_INC);
+    break;
+
+  case TokOpDecrement:
+    pending.push_back({body.GetCurrentPosition(), OP_DECPUSH});
+    body.Emit(OP_DEC);
+    break;
+
+  default:
+    break;
+  }
+}
+
+void StreamCompiler::ResolvePending(size_t pendingMark, bool used)
+{
+  if (used) {
+    for (size_t i = pendingMark; i < pending.size(); i++)
+      body.Patch(pending[i].position, pending[i].pushOp);
+  }
+
+  pending.resize(pendingMark);
+}
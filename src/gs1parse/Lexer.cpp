@@ -1,51 +1,224 @@
 #include <gs1/parse/Lexer.hpp>
+#include <gs1/parse/ScanKernels.hpp>
+
+#include <array>
+#include <cassert>
+#include <cstring>
 
 using namespace gs1;
 
+// ------------------------------------------------------------
+// Keyword perfect hash
+// ------------------------------------------------------------
+
+struct Keyword {
+  const char *text;
+  uint32_t length;
+  TokenType type;
+};
+
+static constexpr Keyword keywordList[] = {
+    {"in", 2, TokKwIn},
+    {"if", 2, TokKwIf},
+    {"else", 4, TokKwElse},
+    {"for", 3, TokKwFor},
+    {"while", 5, TokKwWhile},
+    {"break", 5, TokKwBreak},
+    {"continue", 8, TokKwContinue},
+    {"function", 8, TokKwFunction},
+    {"return", 6, TokKwReturn},
+};
+
+static const uint32_t keywordMinLength = 2;
+static const uint32_t keywordMaxLength = 8;
+static const uint32_t keywordTableSize = 16;
+
+// Distinct for every keyword, checked below
+static constexpr uint32_t KeywordHash(const char *text, uint32_t length)
+{
+  return ((uint8_t)text[0] * 2 + (uint8_t)text[length - 1] * 5) &
+         (keywordTableSize - 1);
+}
+
+static constexpr std::array<Keyword, keywordTableSize> BuildKeywordTable()
+{
+  std::array<Keyword, keywordTableSize> table{};
+
+  for (auto &keyword : keywordList)
+    table[KeywordHash(keyword.text, keyword.length)] = keyword;
+
+  return table;
+}
+
+static constexpr std::array<Keyword, keywordTableSize> keywordTable =
+    BuildKeywordTable();
+
+static constexpr bool KeywordTableIsPerfect()
+{
+  for (auto &keyword : keywordList) {
+    if (keywordTable[KeywordHash(keyword.text, keyword.length)].type !=
+        keyword.type)
+      return false;
+  }
+
+  return true;
+}
+
+static_assert(KeywordTableIsPerfect(), "keyword hash has collisions");
+
+static TokenType LookupKeyword(const char *text, uint32_t length)
+{
+  if (length < keywordMinLength || length > keywordMaxLength)
+    return TokId;
+
+  const Keyword &keyword = keywordTable[KeywordHash(text, length)];
+
+  if (keyword.length == length && memcmp(keyword.text, text, length) == 0)
+    return keyword.type;
+
+  return TokId;
+}
+
+// ------------------------------------------------------------
+// Operator state table
+// ------------------------------------------------------------
+
+// Every two character operator is either the first character doubled or
+// followed by '=', so one state per first character is enough
+struct OperatorState {
+  TokenType single;
+  TokenType withEquals;
+  TokenType doubled;
+};
+
+static constexpr std::array<OperatorState, 256> BuildOperatorTable()
+{
+  std::array<OperatorState, 256> table{};
+
+  table['.'] = {TokDot, TokInvalid, TokInvalid};
+  table[','] = {TokComma, TokInvalid, TokInvalid};
+  table[':'] = {TokColon, TokInvalid, TokInvalid};
+  table[';'] = {TokSemicolon, TokInvalid, TokInvalid};
+  table['|'] = {TokPipe, TokInvalid, TokOpOr};
+  table['&'] = {TokInvalid, TokInvalid, TokOpAnd};
+
+  table['('] = {TokLeftParen, TokInvalid, TokInvalid};
+  table[')'] = {TokRightParen, TokInvalid, TokInvalid};
+  table['{'] = {TokLeftBrace, TokInvalid, TokInvalid};
+  table['}'] = {TokRightBrace, TokInvalid, TokInvalid};
+  table['['] = {TokLeftBracket, TokInvalid, TokInvalid};
+  table[']'] = {TokRightBracket, TokInvalid, TokInvalid};
+
+  table['?'] = {TokOpTernary, TokInvalid, TokInvalid};
+
+  table['!'] = {TokOpNot, TokOpNotEquals, TokInvalid};
+  table['='] = {TokOpAssign, TokOpEquals, TokOpEquals};
+  table['<'] = {TokOpLessThan, TokOpLessThanOrEqual, TokInvalid};
+  table['>'] = {TokOpGreaterThan, TokOpGreaterThanOrEqual, TokInvalid};
+
+  table['+'] = {TokOpAdd, TokOpAddAssign, TokOpIncrement};
+  table['-'] = {TokOpSub, TokOpSubAssign, TokOpDecrement};
+  table['*'] = {TokOpMul, TokOpMulAssign, TokInvalid};
+  table['/'] = {TokOpDiv, TokOpDivAssign, TokInvalid};
+  table['^'] = {TokOpPow, TokOpPowAssign, TokInvalid};
+  table['%'] = {TokOpMod, TokOpModAssign, TokInvalid};
+
+  return table;
+}
+
+static constexpr std::array<OperatorState, 256> operatorTable =
+    BuildOperatorTable();
+
+// ------------------------------------------------------------
+// Lexer implementation
+// ------------------------------------------------------------
+
 Lexer::Lexer(DiagBuilder &diag, ISource &source)
-    : diag(diag), source(source), stringNext(false)
+    : diag(diag), source(source), keepTrivia(true), stringNext(false),
+      tokenHead(0), tokenCount(0)
 {
-  ch = source.Current();
-  pk = source.Lookahead();
+  beg = ptr = start = source.GetBegin();
+  end = source.GetEnd();
 }
 
+void Lexer::SetKeepTrivia(bool keep) { keepTrivia = keep; }
+
 void Lexer::FlagNextAsString(bool inCall, bool lastArg)
 {
   stringNext = true;
   stringInCall = inCall;
   stringLastArg = lastArg;
 
-  if (!tokens.empty()) {
-    source.Reset(tokens.front().range.beg);
-    tokens.clear();
-
-    ch = source.Current();
-    pk = source.Lookahead();
+  // The parser doesn't look past trailing trivia, so this only rewinds if
+  // someone used Lookahead across a string argument
+  if (tokenCount != 0) {
+    Seek(tokens[tokenHead].offset);
   }
 }
 
 void Lexer::Advance()
 {
-  if (tokens.empty()) {
+  if (tokenCount == 0) {
     FetchToken();
   }
-  tokens.pop_front();
+  tokenHead = (tokenHead + 1) % maxTokens;
+  tokenCount--;
 }
 
 Token Lexer::Current()
 {
-  if (tokens.empty()) {
+  if (tokenCount == 0) {
     FetchToken();
   }
-  return tokens.front();
+  return tokens[tokenHead];
 }
 
 Token Lexer::Lookahead(size_t n)
 {
-  while (tokens.size() <= n) {
+  if (n >= maxTokens) {
+    throw Exception("lookahead of %u exceeds the token buffer", (uint32_t)n);
+  }
+
+  while (tokenCount <= n) {
     FetchToken();
   }
-  return tokens[n];
+  return tokens[(tokenHead + n) % maxTokens];
+}
+
+bool Lexer::PeekTrailingTrivia()
+{
+  if (!keepTrivia) {
+    return false;
+  }
+
+  if (tokenCount != 0) {
+    TokenType type = tokens[tokenHead].type;
+    return type == TokWhitespace || type == TokComment;
+  }
+
+  if (ptr >= end) {
+    return false;
+  }
+
+  if (IsWhitespace(*ptr)) {
+    return true;
+  }
+
+  // String arguments may start with '//'
+  return !stringNext && *ptr == '/' && (Peek(1) == '/' || Peek(1) == '*');
+}
+
+string_view Lexer::GetText(const Token &token) const
+{
+  return token.GetText(source);
+}
+
+uint32_t Lexer::GetOffset() const { return ptr - beg; }
+
+void Lexer::Seek(uint32_t offset)
+{
+  ptr = beg + offset;
+  ClearTokens();
 }
 
 bool Lexer::IsAlpha(uint32_t c)
@@ -66,24 +239,23 @@ bool Lexer::IsHexDigit(uint32_t c)
   return IsDecDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
 }
 
-void Lexer::NextChar()
+uint32_t Lexer::Peek(size_t n) const
 {
-  source.Advance();
-
-  if (source.GetFinished()) {
-    ch = pk = 0;
-    return;
-  }
-
-  ch = source.Current();
-  pk = source.Lookahead();
+  return (ptr + n < end) ? (uint8_t)ptr[n] : '\0';
 }
 
 void Lexer::FetchToken()
 {
-  start = source.GetPos();
+  if (!keepTrivia) {
+    SkipTrivia();
+  }
+
+  start = ptr;
 
-  if (ch == '\0') {
+  uint32_t ch = Peek();
+  uint32_t pk = Peek(1);
+
+  if (ptr >= end) {
     HandleEOF();
   } else if (IsWhitespace(ch)) {
     HandleWhitespace();
@@ -101,79 +273,138 @@ void Lexer::FetchToken()
     HandleNumberLiteral();
   } else if (!HandleSymbol()) {
     // TODO: diag, but it might be inside a string..
-    NextChar();
+    ptr++;
     PushToken(TokInvalid);
   }
+
+  // With trivia kept the parser takes a token's trailing trivia before it
+  // can flag a string argument, so comments after a command name are skipped
+  // here rather than becoming part of the argument
+  if (!keepTrivia) {
+    SkipTrailingTrivia();
+  }
 }
 
 void Lexer::PushToken(TokenType type)
 {
-  auto range = Range(start, source.GetPos());
-  auto text = source.GetRangeContents(range);
-  tokens.push_back(Token(range, text, type));
+  // Each fetch pushes one token and Lookahead never fetches past the ring
+  assert(tokenCount < maxTokens);
+
+  tokens[(tokenHead + tokenCount) % maxTokens] =
+      Token(start - beg, ptr - start, type);
+  tokenCount++;
+}
+
+void Lexer::ClearTokens()
+{
+  tokenHead = 0;
+  tokenCount = 0;
+}
+
+void Lexer::SkipTrivia()
+{
+  while (ptr < end) {
+    uint32_t ch = Peek();
+    uint32_t pk = Peek(1);
+
+    start = ptr;
+
+    if (IsWhitespace(ch)) {
+      ptr = SkipWhitespace(ptr + 1, end);
+    } else if (ch == '\n') {
+      ptr++;
+    } else if (ch == '\r' && pk == '\n') {
+      ptr += 2;
+    } else if (stringNext) {
+      break;
+    } else if (ch == '/' && pk == '/') {
+      SkipLineComment();
+    } else if (ch == '/' && pk == '*') {
+      SkipBlockComment();
+    } else {
+      break;
+    }
+  }
+}
+
+void Lexer::SkipTrailingTrivia()
+{
+  while (ptr < end) {
+    uint32_t ch = Peek();
+    uint32_t pk = Peek(1);
+
+    start = ptr;
+
+    if (IsWhitespace(ch)) {
+      ptr = SkipWhitespace(ptr + 1, end);
+    } else if (ch == '/' && pk == '/') {
+      SkipLineComment();
+    } else if (ch == '/' && pk == '*') {
+      SkipBlockComment();
+    } else {
+      break;
+    }
+  }
+}
+
+void Lexer::SkipLineComment()
+{
+  ptr = FindLineBreak(ptr + 2, end);
+
+  // A lone '\r' doesn't end the comment
+  while (ptr < end && *ptr == '\r' && Peek(1) != '\n') {
+    ptr = FindLineBreak(ptr + 1, end);
+  }
+}
+
+void Lexer::SkipBlockComment()
+{
+  ptr = FindBlockCommentEnd(ptr + 2, end);
+
+  if (ptr >= end) {
+    diag.Error(Pos(), Range(Pos(start - beg), Pos(ptr - beg)),
+               "unterminated block comment");
+  } else {
+    ptr += 2;
+  }
 }
 
 void Lexer::HandleEOF() { PushToken(TokEOF); }
 
 void Lexer::HandleWhitespace()
 {
-  do {
-    NextChar();
-  } while (IsWhitespace(ch));
+  ptr = SkipWhitespace(ptr + 1, end);
 
   PushToken(TokWhitespace);
 }
 
 void Lexer::HandleNewline()
 {
-  if (ch == '\r') {
-    NextChar();
+  if (*ptr == '\r') {
+    ptr++;
   }
 
-  NextChar();
+  ptr++;
   PushToken(TokNewline);
 }
 
 void Lexer::HandleLineComment()
 {
-  do {
-    NextChar();
-  } while (ch != '\0' && ch != '\n' && !(ch == '\r' && pk == '\n'));
-
+  SkipLineComment();
   PushToken(TokComment);
 }
 
 void Lexer::HandleBlockComment()
 {
-  do {
-    NextChar();
-  } while (ch != '\0' && !(ch == '*' && pk == '/'));
-
-  if (ch == '\0') {
-    diag.Error(Pos(), Range(start, source.GetPos()),
-               "unterminated block comment");
-  } else {
-    NextChar();
-    NextChar();
-  }
-
+  SkipBlockComment();
   PushToken(TokComment);
 }
 
 void Lexer::HandleId()
 {
-  do {
-    NextChar();
-  } while (ch == '_' || ch == '.' || IsAlphaNum(ch));
+  ptr = SkipIdChars(ptr + 1, end);
 
-  auto text = source.GetRangeContents(Range(start, source.GetPos()));
-
-  auto it = keywords.find(text);
-  if (it != keywords.end()) {
-    PushToken(it->second);
-  } else {
-    PushToken(TokId);
-  }
+  PushToken(LookupKeyword(start, ptr - start));
 }
 
 void Lexer::HandleNumberLiteral()
@@ -181,55 +412,57 @@ void Lexer::HandleNumberLiteral()
   int base = 10;
   bool hasDot = false;
 
-  if (ch == '0') {
-    if (pk == 'b' || pk == 'B') {
-      NextChar();
-      NextChar();
+  if (Peek() == '0') {
+    if (Peek(1) == 'b' || Peek(1) == 'B') {
+      ptr += 2;
       base = 2;
-    } else if (pk == 'x' || pk == 'X') {
-      NextChar();
-      NextChar();
+    } else if (Peek(1) == 'x' || Peek(1) == 'X') {
+      ptr += 2;
       base = 16;
     }
   }
 
   if (base == 2) {
-    while (IsBinDigit(ch)) {
-      NextChar();
+    while (IsBinDigit(Peek())) {
+      ptr++;
     }
   } else if (base == 10) {
     do {
-      if (ch == '.') {
+      if (Peek() == '.') {
         if (hasDot) {
           break;
         } else {
           hasDot = true;
         }
       }
-      NextChar();
-    } while (ch == '.' || IsDecDigit(ch));
+      ptr++;
+    } while (Peek() == '.' || IsDecDigit(Peek()));
 
-    if ((hasDot && ch == 'e') || ch == 'E') {
-      NextChar();
+    if ((hasDot && Peek() == 'e') || Peek() == 'E') {
+      ptr++;
 
-      if (ch == '+' || ch == '-') {
-        NextChar();
+      if (Peek() == '+' || Peek() == '-') {
+        ptr++;
       }
 
       do {
-        NextChar();
-      } while (IsDecDigit(ch));
+        ptr++;
+      } while (IsDecDigit(Peek()));
     }
 
-    if (ch == 'f') {
-      NextChar();
+    if (Peek() == 'f') {
+      ptr++;
     }
   } else if (base == 16) {
-    while (IsHexDigit(ch)) {
-      NextChar();
+    while (IsHexDigit(Peek())) {
+      ptr++;
     }
   }
 
+  if (ptr > end) {
+    ptr = end;
+  }
+
   PushToken(TokNumberLiteral);
 }
 
@@ -239,7 +472,9 @@ void Lexer::HandleStringLiteral()
 
   int nestLevel = 0;
 
-  do {
+  while ((ptr = FindStringArgStop(ptr, end)) < end) {
+    char ch = *ptr;
+
     if (stringInCall && stringLastArg && ch == ')' && !nestLevel) {
       break;
     } else if (stringInCall && !stringLastArg && ch == ',' && !nestLevel) {
@@ -257,92 +492,34 @@ void Lexer::HandleStringLiteral()
       nestLevel--;
     }
 
-    NextChar();
-  } while (ch != '\0');
+    ptr++;
+  }
 
   PushToken(TokStringLiteral);
 }
 
 bool Lexer::HandleSymbol()
 {
-  string op2;
-  op2 += ch;
-  op2 += pk;
-
-  auto it = symbols.find(op2);
-  if (it != symbols.end()) {
-    NextChar();
-    NextChar();
-    PushToken(it->second);
+  const OperatorState &state = operatorTable[Peek()];
+  uint32_t pk = Peek(1);
+
+  if (pk == '=' && state.withEquals != TokInvalid) {
+    ptr += 2;
+    PushToken(state.withEquals);
     return true;
   }
 
-  string op1;
-  op1 += ch;
+  if (pk == Peek() && state.doubled != TokInvalid) {
+    ptr += 2;
+    PushToken(state.doubled);
+    return true;
+  }
 
-  it = symbols.find(op1);
-  if (it != symbols.end()) {
-    NextChar();
-    PushToken(it->second);
+  if (state.single != TokInvalid) {
+    ptr++;
+    PushToken(state.single);
     return true;
   }
 
   return false;
 }
-
-unordered_map<string, TokenType> Lexer::keywords = {
-    {"in", TokKwIn},
-    {"if", TokKwIf},
-    {"else", TokKwElse},
-    {"for", TokKwFor},
-    {"while", TokKwWhile},
-    {"break", TokKwBreak},
-    {"continue", TokKwContinue},
-    {"function", TokKwFunction},
-    {"return", TokKwReturn},
-};
-
-unordered_map<string, TokenType> Lexer::symbols = {
-    {".", TokDot},
-    {",", TokComma},
-    {":", TokColon},
-    {";", TokSemicolon},
-    {"|", TokPipe},
-
-    {"(", TokLeftParen},
-    {")", TokRightParen},
-    {"{", TokLeftBrace},
-    {"}", TokRightBrace},
-    {"[", TokLeftBracket},
-    {"]", TokRightBracket},
-
-    {"?", TokOpTernary},
-
-    {"!", TokOpNot},
-    {"&&", TokOpAnd},
-    {"||", TokOpOr},
-    {"==", TokOpEquals},
-    {"!=", TokOpNotEquals},
-    {"<", TokOpLessThan},
-    {"<=", TokOpLessThanOrEqual},
-    {">", TokOpGreaterThan},
-    {">=", TokOpGreaterThanOrEqual},
-
-    {"+", TokOpAdd},
-    {"-", TokOpSub},
-    {"*", TokOpMul},
-    {"/", TokOpDiv},
-    {"^", TokOpPow},
-    {"%", TokOpMod},
-
-    {"=", TokOpAssign},
-    {"+=", TokOpAddAssign},
-    {"-=", TokOpSubAssign},
-    {"*=", TokOpMulAssign},
-    {"/=", TokOpDivAssign},
-    {"^=", TokOpPowAssign},
-    {"%=", TokOpModAssign},
-
-    {"++", TokOpIncrement},
-    {"--", TokOpDecrement},
-};
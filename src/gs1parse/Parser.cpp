@@ -4,17 +4,19 @@
 
 using namespace gs1;
 
-Parser::Parser(DiagBuilder &diag, Lexer &lexer, const PrototypeMap &commands,
-               const PrototypeMap &functions)
-    : diag(diag), lexer(lexer), token(terminal.token.type), commands(commands),
-      functions(functions)
+Parser::Parser(DiagBuilder &diag, Lexer &lexer, Arena &arena,
+               const PrototypeMap &commands, const PrototypeMap &functions,
+               bool keepTrivia)
+    : diag(diag), lexer(lexer), arena(arena), token(terminal.token.type),
+      commands(commands), functions(functions)
 {
+  lexer.SetKeepTrivia(keepTrivia);
   EatTerminal();
 }
 
-shared_ptr<SyntaxNode> Parser::Parse()
+SyntaxNode *Parser::Parse()
 {
-  auto node = new StmtBlock;
+  auto node = arena.New<StmtBlock>();
 
   PushNode(node);
   {
@@ -30,26 +32,26 @@ shared_ptr<SyntaxNode> Parser::Parse()
     if (token == TokEOF) {
       EatTerminal();
     } else {
-      diag.Warn(terminal.token.range.beg, Range(), "expected end of file");
+      diag.Warn(terminal.token.GetRange().beg, Range(), "expected end of file");
     }
   }
   PopNode();
 
-  return shared_ptr<SyntaxNode>(node);
+  return node;
 }
 
 void Parser::EatTerminal(SyntaxTerminal **ref)
 {
   if (!stack.empty()) {
     auto node = stack.back();
-    auto term = new SyntaxTerminal(terminal);
+    auto term = arena.New<SyntaxTerminal>(terminal);
 
     if (ref) {
       *ref = term;
     }
 
     term->parent = node;
-    node->children.push_back(shared_ptr<SyntaxNodeOrTerminal>(term));
+    node->children.push_back(term);
   }
 
   auto tok = lexer.Current();
@@ -65,12 +67,11 @@ void Parser::EatTerminal(SyntaxTerminal **ref)
 
   terminal.token = tok;
   lexer.Advance();
-  tok = lexer.Current();
 
-  while (tok.type == TokWhitespace || tok.type == TokComment) {
-    terminal.trailingTrivia.push_back(tok);
+  // Stop without lexing the next token, a string argument may follow
+  while (lexer.PeekTrailingTrivia()) {
+    terminal.trailingTrivia.push_back(lexer.Current());
     lexer.Advance();
-    tok = lexer.Current();
   }
 }
 
@@ -80,15 +81,13 @@ void Parser::EatTerminal(TokenType type, SyntaxTerminal **ref)
     EatTerminal(ref);
   } else {
     auto node = stack.back();
-    auto term = new SyntaxTerminal;
-    term->token.type = type;
-    term->token.range =
-        Range(terminal.token.range.beg, terminal.token.range.beg);
+    auto term = arena.New<SyntaxTerminal>();
+    term->token = Token(terminal.token.offset, 0, type);
 
     term->parent = node;
-    node->children.push_back(shared_ptr<SyntaxNodeOrTerminal>(term));
+    node->children.push_back(term);
 
-    diag.Error(terminal.token.range.beg, Range(), "expected '%s' got '%s'",
+    diag.Error(terminal.token.GetRange().beg, Range(), "expected '%s' got '%s'",
                GetTokenTypeSpelling(type),
                GetTokenTypeSpelling(terminal.token.type));
   }
@@ -101,10 +100,9 @@ void Parser::AdoptNode(SyntaxNode *child, SyntaxNode *newParent)
 
   for (auto it = oldParent->children.begin(); it != oldParent->children.end();
        it++) {
-    if (it->get() == child) {
-      auto ptr = *it;
+    if (*it == child) {
       oldParent->children.erase(it);
-      newParent->children.push_back(ptr);
+      newParent->children.push_back(child);
       break;
     }
   }
@@ -115,7 +113,7 @@ void Parser::PushNode(SyntaxNode *node)
   if (!stack.empty()) {
     auto parent = stack.back();
     node->parent = parent;
-    parent->children.push_back(shared_ptr<SyntaxNodeOrTerminal>(node));
+    parent->children.push_back(node);
   } else {
     node->parent = nullptr;
   }
@@ -161,7 +159,7 @@ Stmt *Parser::ParseStmt(bool optional)
   }
 
   if (token == TokId) {
-    auto it = commands.find(terminal.token.text);
+    auto it = commands.find(string(lexer.GetText(terminal.token)));
     if (it != commands.end()) {
       return ParseStmtCommand(it->second);
     }
@@ -175,7 +173,7 @@ Stmt *Parser::ParseStmt(bool optional)
   }
 
   if (!optional) {
-    diag.Error(terminal.token.range.beg, Range(), "expected statement");
+    diag.Error(terminal.token.GetRange().beg, Range(), "expected statement");
   }
 
   return nullptr;
@@ -183,7 +181,7 @@ Stmt *Parser::ParseStmt(bool optional)
 
 Stmt *Parser::ParseStmtEmpty()
 {
-  auto node = new StmtEmpty;
+  auto node = arena.New<StmtEmpty>();
   PushNode(node);
   {
     EatTerminal(TokSemicolon);
@@ -194,7 +192,7 @@ Stmt *Parser::ParseStmtEmpty()
 
 Stmt *Parser::ParseStmtBlock()
 {
-  auto node = new StmtBlock;
+  auto node = arena.New<StmtBlock>();
   PushNode(node);
   {
     EatTerminal(TokLeftBrace);
@@ -216,7 +214,7 @@ Stmt *Parser::ParseStmtBlock()
 
 Stmt *Parser::ParseStmtIf()
 {
-  auto node = new StmtIf;
+  auto node = arena.New<StmtIf>();
   PushNode(node);
   {
     EatTerminal(TokKwIf);
@@ -238,7 +236,7 @@ Stmt *Parser::ParseStmtIf()
 
 Stmt *Parser::ParseStmtFor()
 {
-  auto node = new StmtFor;
+  auto node = arena.New<StmtFor>();
   PushNode(node);
   {
     EatTerminal(TokKwFor);
@@ -259,7 +257,7 @@ Stmt *Parser::ParseStmtFor()
 
 Stmt *Parser::ParseStmtWhile()
 {
-  auto node = new StmtWhile;
+  auto node = arena.New<StmtWhile>();
   PushNode(node);
   {
     EatTerminal(TokKwWhile);
@@ -274,7 +272,7 @@ Stmt *Parser::ParseStmtWhile()
 
 Stmt *Parser::ParseStmtBreak()
 {
-  auto node = new StmtBreak;
+  auto node = arena.New<StmtBreak>();
   PushNode(node);
   {
     EatTerminal(TokKwBreak);
@@ -286,7 +284,7 @@ Stmt *Parser::ParseStmtBreak()
 
 Stmt *Parser::ParseStmtContinue()
 {
-  auto node = new StmtContinue;
+  auto node = arena.New<StmtContinue>();
   PushNode(node);
   {
     EatTerminal(TokKwContinue);
@@ -298,7 +296,7 @@ Stmt *Parser::ParseStmtContinue()
 
 Stmt *Parser::ParseStmtReturn()
 {
-  auto node = new StmtReturn();
+  auto node = arena.New<StmtReturn>();
   PushNode(node);
   {
     EatTerminal(TokKwReturn);
@@ -310,7 +308,7 @@ Stmt *Parser::ParseStmtReturn()
 
 Stmt *Parser::ParseStmtCommand(const vector<bool> &prototype)
 {
-  auto node = new StmtCommand;
+  auto node = arena.New<StmtCommand>();
   PushNode(node);
   {
     if (!prototype.empty() && prototype[0]) {
@@ -341,7 +339,7 @@ Stmt *Parser::ParseStmtCommand(const vector<bool> &prototype)
 
 Stmt *Parser::ParseStmtFunctionDecl()
 {
-  auto node = new StmtFunctionDecl;
+  auto node = arena.New<StmtFunctionDecl>();
   PushNode(node);
   {
     EatTerminal(TokKwFunction);
@@ -393,7 +391,7 @@ Expr *Parser::ParseExpr(bool optional, int precedence)
 
   if (!left) {
     if (!optional) {
-      diag.Error(terminal.token.range.beg, Range(), "expected expression");
+      diag.Error(terminal.token.GetRange().beg, Range(), "expected expression");
     }
     return nullptr;
   }
@@ -420,7 +418,7 @@ Expr *Parser::ParseExpr(bool optional, int precedence)
 
 Expr *Parser::ParseExprId()
 {
-  auto node = new ExprId;
+  auto node = arena.New<ExprId>();
   PushNode(node);
   {
     EatTerminal(TokId, &node->name);
@@ -438,7 +436,7 @@ Expr *Parser::ParseExprId()
 
 Expr *Parser::ParseExprNumberLiteral()
 {
-  auto node = new ExprNumberLiteral();
+  auto node = arena.New<ExprNumberLiteral>();
   PushNode(node);
   {
     EatTerminal(&node->literal);
@@ -449,7 +447,7 @@ Expr *Parser::ParseExprNumberLiteral()
 
 Expr *Parser::ParseExprStringLiteral()
 {
-  auto node = new ExprStringLiteral;
+  auto node = arena.New<ExprStringLiteral>();
   PushNode(node);
   {
     EatTerminal(&node->literal);
@@ -460,7 +458,7 @@ Expr *Parser::ParseExprStringLiteral()
 
 Expr *Parser::ParseExprList()
 {
-  auto node = new ExprList;
+  auto node = arena.New<ExprList>();
   PushNode(node);
   {
     EatTerminal(TokLeftBrace);
@@ -483,7 +481,7 @@ Expr *Parser::ParseExprList()
 
 Expr *Parser::ParseExprRange()
 {
-  auto node = new ExprRange;
+  auto node = arena.New<ExprRange>();
   PushNode(node);
   {
     EatTerminal(TokPipe);
@@ -498,7 +496,7 @@ Expr *Parser::ParseExprRange()
 
 Expr *Parser::ParseExprUnaryOp(Expr *left, int precedence)
 {
-  auto node = new ExprUnaryOp;
+  auto node = arena.New<ExprUnaryOp>();
 
   if (left) {
     AdoptNode(left, node);
@@ -528,7 +526,7 @@ Expr *Parser::ParseExprBinaryOp(Expr *left, int precedence)
     return ParseExprTernaryOp(left, precedence);
   }
 
-  auto node = new ExprBinaryOp;
+  auto node = arena.New<ExprBinaryOp>();
   AdoptNode(left, node);
   PushNode(node);
   {
@@ -542,7 +540,7 @@ Expr *Parser::ParseExprBinaryOp(Expr *left, int precedence)
 
 Expr *Parser::ParseExprTernaryOp(Expr *left, int precedence)
 {
-  auto node = new ExprTernaryOp;
+  auto node = arena.New<ExprTernaryOp>();
   AdoptNode(left, node);
   PushNode(node);
   {
@@ -558,7 +556,7 @@ Expr *Parser::ParseExprTernaryOp(Expr *left, int precedence)
 
 Expr *Parser::ParseExprIndex(Expr *left)
 {
-  auto node = new ExprIndex;
+  auto node = arena.New<ExprIndex>();
   AdoptNode(left, node);
   PushNode(node);
   {
@@ -577,7 +575,7 @@ Expr *Parser::ParseExprIndex(Expr *left)
 
 Expr *Parser::ParseExprIndexDotLookup(Expr *left)
 {
-  auto node = new ExprIndexDotLookup;
+  auto node = arena.New<ExprIndexDotLookup>();
   AdoptNode(left, node);
   PushNode(node);
   {
@@ -593,13 +591,13 @@ Expr *Parser::ParseExprCall(Expr *left)
 {
   auto id = dynamic_cast<ExprId *>(left);
   if (id) {
-    auto it = functions.find(id->name->token.text);
+    auto it = functions.find(string(lexer.GetText(id->name->token)));
     if (it != functions.end()) {
       return ParseExprCallBuiltin(left, it->second);
     }
   }
 
-  auto node = new ExprCall;
+  auto node = arena.New<ExprCall>();
   AdoptNode(left, node);
   PushNode(node);
   {
@@ -621,7 +619,7 @@ Expr *Parser::ParseExprCall(Expr *left)
     }
 
     if (hasComma) {
-      auto comma = node->children.back().get();
+      auto comma = node->children.back();
       diag.Error(comma->GetRange().beg, Range(),
                  "trailing comma in argument list");
     }
@@ -634,7 +632,7 @@ Expr *Parser::ParseExprCall(Expr *left)
 
 Expr *Parser::ParseExprCallBuiltin(Expr *left, const vector<bool> &prototype)
 {
-  auto node = new ExprCall;
+  auto node = arena.New<ExprCall>();
   AdoptNode(left, node);
   PushNode(node);
   {
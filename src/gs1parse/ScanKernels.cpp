@@ -0,0 +1,361 @@
+#include <gs1/parse/ScanKernels.hpp>
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GS1_SCANKERNELS_SSE2
+#endif
+
+#if defined(GS1_SCANKERNELS_SSE2) && defined(__GNUC__) &&                      \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GS1_SCANKERNELS_AVX2
+#define GS1_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace gs1;
+
+static inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#if defined(__GNUC__)
+  return __builtin_ctz(mask);
+#else
+  uint32_t n = 0;
+
+  while (!(mask & 1)) {
+    mask >>= 1;
+    n++;
+  }
+
+  return n;
+#endif
+}
+
+// ------------------------------------------------------------
+// Scalar kernels, also used for the tail of the vector loops
+// ------------------------------------------------------------
+
+static inline bool IsIdChar(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
+
+static const char *SkipWhitespaceScalar(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+
+  return p;
+}
+
+static const char *FindLineBreakScalar(const char *p, const char *end)
+{
+  while (p < end && *p != '\n' && *p != '\r')
+    p++;
+
+  return p;
+}
+
+static const char *FindBlockCommentEndScalar(const char *p, const char *end)
+{
+  while (p < end && !(*p == '*' && p + 1 < end && p[1] == '/'))
+    p++;
+
+  return p;
+}
+
+static const char *SkipIdCharsScalar(const char *p, const char *end)
+{
+  while (p < end && IsIdChar(*p))
+    p++;
+
+  return p;
+}
+
+static const char *FindStringArgStopScalar(const char *p, const char *end)
+{
+  while (p < end && *p != '(' && *p != ')' && *p != ',' && *p != ';')
+    p++;
+
+  return p;
+}
+
+// ------------------------------------------------------------
+// SSE2 kernels, 16 bytes at a time
+// ------------------------------------------------------------
+
+#ifdef GS1_SCANKERNELS_SSE2
+
+static inline __m128i Load16(const char *p)
+{
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline __m128i Eq16(__m128i v, char c)
+{
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+// Characters are signed here, so anything above 0x7f is never in range
+static inline __m128i InRange16(__m128i v, char lo, char hi)
+{
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline uint32_t Mask16(__m128i v)
+{
+  return (uint32_t)_mm_movemask_epi8(v);
+}
+
+static const char *SkipWhitespaceSSE2(const char *p, const char *end)
+{
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = Load16(p);
+    uint32_t stop =
+        ~Mask16(_mm_or_si128(Eq16(v, ' '), Eq16(v, '\t'))) & 0xffff;
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return SkipWhitespaceScalar(p, end);
+}
+
+static const char *FindLineBreakSSE2(const char *p, const char *end)
+{
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = Load16(p);
+    uint32_t stop = Mask16(_mm_or_si128(Eq16(v, '\n'), Eq16(v, '\r')));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindLineBreakScalar(p, end);
+}
+
+static const char *FindBlockCommentEndSSE2(const char *p, const char *end)
+{
+  // The second load looks one byte ahead for the '/'
+  for (; p + 17 <= end; p += 16) {
+    uint32_t stop =
+        Mask16(_mm_and_si128(Eq16(Load16(p), '*'), Eq16(Load16(p + 1), '/')));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindBlockCommentEndScalar(p, end);
+}
+
+static const char *SkipIdCharsSSE2(const char *p, const char *end)
+{
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = Load16(p);
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i id = _mm_or_si128(
+        _mm_or_si128(InRange16(lower, 'a', 'z'), InRange16(v, '0', '9')),
+        _mm_or_si128(Eq16(v, '_'), Eq16(v, '.')));
+    uint32_t stop = ~Mask16(id) & 0xffff;
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return SkipIdCharsScalar(p, end);
+}
+
+static const char *FindStringArgStopSSE2(const char *p, const char *end)
+{
+  for (; p + 16 <= end; p += 16) {
+    __m128i v = Load16(p);
+    uint32_t stop =
+        Mask16(_mm_or_si128(_mm_or_si128(Eq16(v, '('), Eq16(v, ')')),
+                            _mm_or_si128(Eq16(v, ','), Eq16(v, ';'))));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindStringArgStopScalar(p, end);
+}
+
+#endif
+
+// ------------------------------------------------------------
+// AVX2 kernels, 32 bytes at a time
+// ------------------------------------------------------------
+
+#ifdef GS1_SCANKERNELS_AVX2
+
+GS1_TARGET_AVX2 static inline __m256i Load32(const char *p)
+{
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+GS1_TARGET_AVX2 static inline __m256i Eq32(__m256i v, char c)
+{
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+GS1_TARGET_AVX2 static inline __m256i InRange32(__m256i v, char lo, char hi)
+{
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+GS1_TARGET_AVX2 static inline uint32_t Mask32(__m256i v)
+{
+  return (uint32_t)_mm256_movemask_epi8(v);
+}
+
+GS1_TARGET_AVX2 static const char *SkipWhitespaceAVX2(const char *p,
+                                                      const char *end)
+{
+  for (; p + 32 <= end; p += 32) {
+    __m256i v = Load32(p);
+    uint32_t stop = ~Mask32(_mm256_or_si256(Eq32(v, ' '), Eq32(v, '\t')));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return SkipWhitespaceSSE2(p, end);
+}
+
+GS1_TARGET_AVX2 static const char *FindLineBreakAVX2(const char *p,
+                                                     const char *end)
+{
+  for (; p + 32 <= end; p += 32) {
+    __m256i v = Load32(p);
+    uint32_t stop = Mask32(_mm256_or_si256(Eq32(v, '\n'), Eq32(v, '\r')));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindLineBreakSSE2(p, end);
+}
+
+GS1_TARGET_AVX2 static const char *FindBlockCommentEndAVX2(const char *p,
+                                                           const char *end)
+{
+  for (; p + 33 <= end; p += 32) {
+    uint32_t stop = Mask32(
+        _mm256_and_si256(Eq32(Load32(p), '*'), Eq32(Load32(p + 1), '/')));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindBlockCommentEndSSE2(p, end);
+}
+
+GS1_TARGET_AVX2 static const char *SkipIdCharsAVX2(const char *p,
+                                                   const char *end)
+{
+  for (; p + 32 <= end; p += 32) {
+    __m256i v = Load32(p);
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i id = _mm256_or_si256(
+        _mm256_or_si256(InRange32(lower, 'a', 'z'), InRange32(v, '0', '9')),
+        _mm256_or_si256(Eq32(v, '_'), Eq32(v, '.')));
+    uint32_t stop = ~Mask32(id);
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return SkipIdCharsSSE2(p, end);
+}
+
+GS1_TARGET_AVX2 static const char *FindStringArgStopAVX2(const char *p,
+                                                         const char *end)
+{
+  for (; p + 32 <= end; p += 32) {
+    __m256i v = Load32(p);
+    uint32_t stop =
+        Mask32(_mm256_or_si256(_mm256_or_si256(Eq32(v, '('), Eq32(v, ')')),
+                               _mm256_or_si256(Eq32(v, ','), Eq32(v, ';'))));
+
+    if (stop)
+      return p + CountTrailingZeros(stop);
+  }
+
+  return FindStringArgStopSSE2(p, end);
+}
+
+#endif
+
+// ------------------------------------------------------------
+// Runtime selection
+// ------------------------------------------------------------
+
+typedef const char *(*ScanKernel)(const char *p, const char *end);
+
+struct ScanKernelSet {
+  const char *name;
+  ScanKernel skipWhitespace;
+  ScanKernel findLineBreak;
+  ScanKernel findBlockCommentEnd;
+  ScanKernel skipIdChars;
+  ScanKernel findStringArgStop;
+};
+
+static ScanKernelSet SelectScanKernels()
+{
+#ifdef GS1_SCANKERNELS_AVX2
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return {"avx2",          SkipWhitespaceAVX2,      FindLineBreakAVX2,
+            FindBlockCommentEndAVX2, SkipIdCharsAVX2, FindStringArgStopAVX2};
+  }
+#endif
+
+#ifdef GS1_SCANKERNELS_SSE2
+  return {"sse2",          SkipWhitespaceSSE2,      FindLineBreakSSE2,
+          FindBlockCommentEndSSE2, SkipIdCharsSSE2, FindStringArgStopSSE2};
+#else
+  return {"scalar",          SkipWhitespaceScalar,
+          FindLineBreakScalar,   FindBlockCommentEndScalar,
+          SkipIdCharsScalar,     FindStringArgStopScalar};
+#endif
+}
+
+static const ScanKernelSet &GetScanKernels()
+{
+  static const ScanKernelSet kernels = SelectScanKernels();
+  return kernels;
+}
+
+const char *gs1::SkipWhitespace(const char *p, const char *end)
+{
+  return GetScanKernels().skipWhitespace(p, end);
+}
+
+const char *gs1::FindLineBreak(const char *p, const char *end)
+{
+  return GetScanKernels().findLineBreak(p, end);
+}
+
+const char *gs1::FindBlockCommentEnd(const char *p, const char *end)
+{
+  return GetScanKernels().findBlockCommentEnd(p, end);
+}
+
+const char *gs1::SkipIdChars(const char *p, const char *end)
+{
+  return GetScanKernels().skipIdChars(p, end);
+}
+
+const char *gs1::FindStringArgStop(const char *p, const char *end)
+{
+  return GetScanKernels().findStringArgStop(p, end);
+}
+
+const char *gs1::GetScanKernelsName() { return GetScanKernels().name; }
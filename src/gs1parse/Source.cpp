@@ -1,104 +1,152 @@
 #include <gs1/parse/Source.hpp>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
-using namespace gs1;
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GS1_SOURCE_MMAP
+#endif
 
-// ------------------------------------------------------------
-// MemorySource implementation
-// ------------------------------------------------------------
+using namespace gs1;
 
-MemorySource::MemorySource(const char *beg, int size)
-    : beg(beg), ptr(beg), currentLine(0)
+static void ReadFile(const string &filename, vector<char> &buffer)
 {
-  if (size == -1) {
-    end = beg + strlen(beg);
-  } else {
-    end = beg + size;
+  auto file = fopen(filename.c_str(), "rb");
+  if (!file) {
+    throw Exception("couldn't open file: %s", filename.c_str());
+  }
+
+  fseek(file, 0, SEEK_END);
+  auto size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if (size < 0) {
+    fclose(file);
+    throw Exception("couldn't read file: %s", filename.c_str());
+  }
+
+  buffer.resize(size);
+
+  size_t read = size > 0 ? fread(&buffer[0], 1, size, file) : 0;
+  fclose(file);
+
+  if (read != (size_t)size) {
+    throw Exception("couldn't read file: %s", filename.c_str());
   }
 }
 
-void MemorySource::Reset(Pos p) { ptr = beg + p.offset; }
+// ------------------------------------------------------------
+// ISource implementation
+// ------------------------------------------------------------
 
-Pos MemorySource::GetPos() const { return Pos(ptr - beg, currentLine); }
+string ISource::GetRangeContents(Range r) const
+{
+  if (r.end.offset <= r.beg.offset)
+    return "";
+
+  return string(beg + r.beg.offset, r.end.offset - r.beg.offset);
+}
 
-string MemorySource::GetRangeContents(Range r) const
+string_view ISource::GetView(size_t offset, size_t length) const
 {
-  return string(&beg[r.beg.offset], r.end.offset - r.beg.offset);
+  return string_view(beg + offset, length);
 }
 
-void MemorySource::Advance()
+uint32_t ISource::GetLine(size_t offset) const
 {
-  if (ptr < end) {
-    if (*ptr == '\n')
-      currentLine++;
+  if (!newlinesIndexed) {
+    const char *p = beg;
+
+    while (p < end &&
+           (p = (const char *)memchr(p, '\n', end - p)) != nullptr) {
+      newlines.push_back(p - beg);
+      p++;
+    }
 
-    ptr++;
+    newlinesIndexed = true;
   }
+
+  // Number of newlines before offset
+  return std::lower_bound(newlines.begin(), newlines.end(), offset) -
+         newlines.begin();
 }
 
-uint32_t MemorySource::Current() { return (ptr < end) ? *ptr : '\0'; }
+// ------------------------------------------------------------
+// MemorySource implementation
+// ------------------------------------------------------------
 
-uint32_t MemorySource::Lookahead(size_t n)
+MemorySource::MemorySource(const char *beg, int size)
 {
-  return (ptr + n < end) ? *(ptr + n) : '\0';
+  this->beg = beg;
+  end = beg + (size == -1 ? strlen(beg) : size);
 }
 
-bool MemorySource::GetFinished() { return ptr >= end; }
+MemorySource::MemorySource(string_view text)
+{
+  beg = text.data();
+  end = beg + text.size();
+}
 
 // ------------------------------------------------------------
 // FileSource implementation
 // ------------------------------------------------------------
 
-FileSource::FileSource(string filename) : offset(0), currentLine(0)
+FileSource::FileSource(string filename)
 {
-  auto file = fopen(filename.c_str(), "rb");
-  if (!file) {
-    throw Exception("couldn't open file: %s", filename.c_str());
-  }
+  ReadFile(filename, buffer);
 
-  fseek(file, 0, SEEK_END);
-  auto size = ftell(file);
-  fseek(file, 0, SEEK_SET);
-
-  buffer.resize(size);
-
-  fread(&buffer[0], 1, size, file);
-  fclose(file);
+  beg = buffer.data();
+  end = beg + buffer.size();
 }
 
-void FileSource::Reset(Pos p) { offset = p.offset; }
-
-Pos FileSource::GetPos() const { return Pos(offset, currentLine); }
+// ------------------------------------------------------------
+// MappedFileSource implementation
+// ------------------------------------------------------------
 
-string FileSource::GetRangeContents(Range r) const
+MappedFileSource::MappedFileSource(string filename)
+    : mapping(nullptr), mappingLength(0)
 {
-  if (r.end.offset == r.beg.offset)
-    return "";
+#ifdef GS1_SOURCE_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw Exception("couldn't open file: %s", filename.c_str());
+  }
 
-  return string(&buffer[r.beg.offset], r.end.offset - r.beg.offset);
-}
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-void FileSource::Advance()
-{
-  if (offset < buffer.size()) {
-    if (buffer[offset] == '\n')
-      currentLine++;
-
-    offset++;
+    if (p != MAP_FAILED) {
+      mapping = p;
+      mappingLength = st.st_size;
+    }
   }
-}
 
-uint32_t FileSource::Current() { return (uint32_t)buffer[offset]; }
+  close(fd);
 
-uint32_t FileSource::Lookahead(size_t n)
-{
-  if (offset + n < buffer.size()) {
-    return (uint32_t)buffer[offset + n];
-  } else {
-    return '\0';
+  if (mapping != nullptr) {
+    beg = (const char *)mapping;
+    end = beg + mappingLength;
+    return;
   }
+#endif
+
+  // Empty files (and mmap failures) go through a plain read
+  ReadFile(filename, buffer);
+
+  beg = buffer.data();
+  end = beg + buffer.size();
 }
 
-bool FileSource::GetFinished() { return offset >= buffer.size(); }
\ No newline at end of file
+MappedFileSource::~MappedFileSource()
+{
+#ifdef GS1_SOURCE_MMAP
+  if (mapping != nullptr)
+    munmap(mapping, mappingLength);
+#endif
+}
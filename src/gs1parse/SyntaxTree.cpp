@@ -18,23 +18,61 @@ Range SyntaxNode::GetFullRange() const
   return r;
 }
 
-Range SyntaxTerminal::GetRange() const { return token.range; }
+Range SyntaxTerminal::GetRange() const { return token.GetRange(); }
 
 Range SyntaxTerminal::GetFullRange() const
 {
   Range r;
 
   if (leadingTrivia.empty()) {
-    r.beg = token.range.beg;
+    r.beg = token.GetRange().beg;
   } else {
-    r.beg = leadingTrivia.front().range.beg;
+    r.beg = leadingTrivia.front().GetRange().beg;
   }
 
   if (trailingTrivia.empty()) {
-    r.end = token.range.end;
+    r.end = token.GetRange().end;
   } else {
-    r.end = trailingTrivia.back().range.end;
+    r.end = trailingTrivia.back().GetRange().end;
   }
 
   return r;
 }
+
+const char *gs1::GetNodeKindName(NodeKind kind)
+{
+  static const char *names[] = {
+      "SyntaxNode",
+
+      "Stmt",
+      "StmtEmpty",
+      "StmtBlock",
+      "StmtIf",
+      "StmtFor",
+      "StmtWhile",
+      "StmtBreak",
+      "StmtContinue",
+      "StmtReturn",
+      "StmtCommand",
+      "StmtFunctionDecl",
+
+      "Expr",
+      "ExprId",
+      "ExprNumberLiteral",
+      "ExprStringLiteral",
+      "ExprList",
+      "ExprRange",
+      "ExprUnaryOp",
+      "ExprBinaryOp",
+      "ExprTernaryOp",
+      "ExprIndex",
+      "ExprIndexDotLookup",
+      "ExprCall",
+  };
+
+  if (kind >= NodeSyntaxNode && kind <= NodeExprCall) {
+    return names[kind];
+  }
+
+  throw Exception("name requested for unknown node kind: %u", kind);
+}
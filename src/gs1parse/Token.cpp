@@ -2,13 +2,23 @@
 
 using namespace gs1;
 
-Token::Token() : type(TokInvalid) {}
+Token::Token() : offset(0), length(0), type(TokInvalid) {}
 
-Token::Token(Range range, string text, TokenType type)
-    : range(range), text(text), type(type)
+Token::Token(uint32_t offset, uint32_t length, TokenType type)
+    : offset(offset), length(length), type(type)
 {
 }
 
+Range Token::GetRange() const
+{
+  return Range(Pos(offset), Pos(offset + length));
+}
+
+string_view Token::GetText(const ISource &source) const
+{
+  return source.GetView(offset, length);
+}
+
 const char *gs1::GetTokenTypeName(TokenType type)
 {
   static const char *spelling[] = {
@@ -32,6 +42,7 @@ const char *gs1::GetTokenTypeName(TokenType type)
       "TokKwFunction",
       "TokKwReturn",
 
+      "TokDot",
       "TokComma",
       "TokColon",
       "TokSemicolon",
@@ -92,7 +103,7 @@ const char *gs1::GetTokenTypeSpelling(TokenType type)
       "in",       "if",          "else",       "for",     "while",   "break",
       "continue", "function",    "return",
 
-      ",",        ":",           ";",          "|",
+      ".",        ",",           ":",          ";",       "|",
 
       "(",        ")",           "{",          "}",       "[",       "]",
 
@@ -14,7 +14,7 @@ void DebugVisitor::Visit(SyntaxTerminal *node)
     Log::Get().Print(LOGLEVEL_VERBOSE, "%*s", level, "");
     Log::Get().Print(LOGLEVEL_VERBOSE, "* %s(%s)\n",
                      GetTokenTypeName(node->token.type),
-                     node->token.text.c_str());
+                     string(node->token.GetText(source)).c_str());
   }
 }
 
@@ -30,6 +30,10 @@ int main(int argc, const char *argv[])
                        {"debugstr", {true}},
                        {"setplayerprop", {true, true}},
 
+                       {"arrayfill", {false, false}},
+                       {"arrayscale", {false, false}},
+                       {"arraycopy", {false, false}},
+
                        {"set", {true}},
                        {"unset", {true}},
 
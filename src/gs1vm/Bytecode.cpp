@@ -1,54 +1,314 @@
 #include <gs1/common/BufferReader.hpp>
+#include <gs1/common/Instruction.hpp>
 #include <gs1/vm/Bytecode.hpp>
 
 #include <gs1/common/Log.hpp>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 using namespace gs1;
 
-Bytecode::Bytecode(const char *data, int len) : len(len)
+// Deepest the stack gets running body, left at 0 for bodies the verifier
+// rejects
+static uint32_t
+GetBodyStackDepth(const char *body, uint32_t len,
+                  const ConstantTable<float> &numbers,
+                  const std::map<std::string, uint32_t> &functions)
 {
-  this->data = (char *)malloc(len);
+  uint32_t depth, errorPos;
 
-  memcpy(this->data, data, len);
+  if (!ComputeMaxStackDepth(body, len, numbers, functions, depth, errorPos))
+    return 0;
 
-  // Set offset to body
+  return depth;
+}
+
+// Version 1 opcodes took a byte, followed by a 4 byte packed value or jump
+// offset for those with an operand
+static unsigned int GetV1OperandSize(uint8_t op)
+{
+  switch (op) {
+  case OP_PUSH:
+  case OP_CALL:
+  case OP_CMD_CALL:
+  case OP_JMP:
+  case OP_JAL:
+  case OP_JEZ:
+  case OP_JNZ:
+    return 4;
+
+  default:
+    return 0;
+  }
+}
+
+Bytecode::Bytecode(const char *data, int len)
+    : stringConstants(std::make_shared<ConstantTable<std::string>>()),
+      numberConstants(std::make_shared<ConstantTable<float>>()),
+      maxStackDepth(0), tempCount(0), verified(false),
+      version(BYTECODE_VERSION)
+{
   BufferReader reader(data, len);
 
-  // Load the offset to the bytecode body
+  if (reader.ReadU32() == BYTECODE_MAGIC) {
+    LoadV2(reader, data, len);
+  } else {
+    reader.Seek(0);
+    LoadV1(reader, data, len);
+
+    version = 1;
+  }
+
+  body = bodyBuffer.GetBytes();
+  bodyLen = bodyBuffer.GetLength();
+
+  // Version 1 doesn't give it
+  if (version == 1)
+    maxStackDepth =
+        GetBodyStackDepth(body, bodyLen, *numberConstants, functionOffsets);
+
+  DecodeNumbers();
+}
+
+Bytecode::Bytecode(const BytecodeHeader &header, ByteBuffer &body)
+    : stringConstants(header.constStringTable),
+      numberConstants(header.constNumberTable),
+      functionOffsets(header.functionOffsetTable), maxStackDepth(0),
+      tempCount(0), verified(false), version(BYTECODE_VERSION)
+{
+  swap(bodyBuffer, body);
+
+  this->body = bodyBuffer.GetBytes();
+  bodyLen = bodyBuffer.GetLength();
+  maxStackDepth = GetBodyStackDepth(this->body, bodyLen, *numberConstants,
+                                    functionOffsets);
+
+  DecodeNumbers();
+}
+
+Bytecode::~Bytecode() {}
+
+void Bytecode::DecodeNumbers()
+{
+  numbers.clear();
+  numbers.reserve(numberConstants->GetSize());
+
+  for (auto &constant : numberConstants->constants)
+    numbers.push_back(constant.val);
+}
+
+void Bytecode::LoadV2(BufferReader &reader, const char *data, uint32_t len)
+{
+  uint16_t version = reader.ReadU16();
+
+  if (version != BYTECODE_VERSION)
+    throw Exception("unsupported bytecode version %u", version);
+
+  // Flags
+  reader.ReadU16();
+
   uint32_t bodyOffset = reader.ReadU32();
+  uint32_t bodyLength = reader.ReadU32();
+
+  if (bodyOffset > len || bodyLength > len - bodyOffset)
+    throw Exception("bytecode body at %u is past its end", bodyOffset);
 
-  body = (char *)data + bodyOffset;
-  bodyLen = len - (body - data);
+  if (bodyLength % INSTRUCTION_SIZE != 0)
+    throw Exception("bytecode body length %u isn't whole instructions",
+                    bodyLength);
 
-  // Load the constant tables
+  // The verifier checks it against the body
+  maxStackDepth = reader.ReadU32();
 
   // String constants
   uint32_t numStrConstants = reader.ReadU32();
 
-  for (uint32_t i = 0; i < numStrConstants; ++i) {
-    std::string value = reader.ReadString();
+  for (uint32_t i = 0; i < numStrConstants; ++i)
+    stringConstants->Append(reader.ReadString());
+
+  // Number constants
+  uint32_t numNumConstants = reader.ReadU32();
+
+  for (uint32_t i = 0; i < numNumConstants; ++i)
+    numberConstants->Append(reader.ReadFloat());
+
+  // Function names and offsets
+  uint32_t numFunctions = reader.ReadU32();
 
-    stringConstants.GetKey(value);
+  for (uint32_t i = 0; i < numFunctions; ++i) {
+    std::string name = reader.ReadString();
+    uint32_t offset = reader.ReadU32();
+
+    if (offset > bodyLength || offset % INSTRUCTION_SIZE != 0)
+      throw Exception("function %s starts at bad offset %u", name.c_str(),
+                      offset);
+
+    functionOffsets[name] = offset;
   }
 
+  if (reader.GetPosition() > bodyOffset)
+    throw Exception("bytecode body offset %u is inside its header",
+                    bodyOffset);
+
+  bodyBuffer.WriteBytes(data + bodyOffset, bodyLength);
+}
+
+void Bytecode::LoadV1(BufferReader &reader, const char *data, uint32_t len)
+{
+  // Load the offset to the bytecode body
+  uint32_t bodyOffset = reader.ReadU32();
+
+  if (bodyOffset > len)
+    throw Exception("bytecode body offset %u is past its end", bodyOffset);
+
+  // String constants
+  uint32_t numStrConstants = reader.ReadU32();
+
+  for (uint32_t i = 0; i < numStrConstants; ++i)
+    stringConstants->Append(reader.ReadString());
+
   // Number constants
   uint32_t numNumConstants = reader.ReadU32();
 
-  for (uint32_t i = 0; i < numNumConstants; ++i) {
-    float num = reader.ReadFloat();
+  for (uint32_t i = 0; i < numNumConstants; ++i)
+    numberConstants->Append(reader.ReadFloat());
+
+  const char *code = data + bodyOffset;
+  uint32_t codeLen = len - bodyOffset;
+  BufferReader operands(code, codeLen);
+
+  // The index took 16 bits after the type and the rest went unused,
+  // uninitialised, until it was widened. An index past its table can only
+  // be an old one.
+  auto readPacked = [&](uint32_t pos) {
+    operands.Seek(pos + 1);
+
+    uint32_t packed = operands.ReadU32();
+    uint32_t type = packed & 0xf;
+    uint32_t index = packed >> 4;
+
+    size_t tableSize =
+        type == PACKVALUE_CONST_NUMBER || type == PACKVALUE_CONST_ARRAY
+            ? numberConstants->GetSize()
+            : stringConstants->GetSize();
+
+    if (index >= tableSize)
+      index &= 0xffff;
 
-    numberConstants.GetKey(num);
+    return PackedValue((PackedValueType)type, index);
+  };
+
+  // Each instruction is converted on its own, so first work out where each
+  // one ends up for the jumps between them
+  std::vector<int64_t> newPositions(codeLen + 1, -1);
+  uint32_t newLen = 0;
+
+  for (uint32_t pos = 0; pos < codeLen;) {
+    uint8_t op = (uint8_t)code[pos];
+
+    // Version 1 ended at OP_DBG_OUT
+    if (op > OP_DBG_OUT)
+      throw Exception("unknown opcode %u at %u", op, pos);
+
+    unsigned int size = 1 + GetV1OperandSize(op);
+
+    if (size > codeLen - pos)
+      throw Exception("instruction at %u runs past the end", pos);
+
+    newPositions[pos] = newLen;
+    newLen += INSTRUCTION_SIZE;
+
+    // Operands past the short form take another word
+    if (op == OP_PUSH || op == OP_CALL || op == OP_CMD_CALL) {
+      if (readPacked(pos).value >= PACKED_INDEX_LONG)
+        newLen += INSTRUCTION_SIZE;
+    }
+
+    // Calls gain an argument count, which version 1 didn't record
+    if (op == OP_CALL || op == OP_CMD_CALL || op == OP_JAL)
+      newLen += INSTRUCTION_SIZE;
+
+    pos += size;
   }
-}
 
-Bytecode::~Bytecode() { free(data); }
+  newPositions[codeLen] = newLen;
+  bodyBuffer.EnsureCapacity(newLen);
+
+  for (uint32_t pos = 0; pos < codeLen;) {
+    Opcode op = (Opcode)(uint8_t)code[pos];
+
+    operands.Seek(pos + 1);
+
+    switch (op) {
+    case OP_PUSH:
+    case OP_CALL:
+    case OP_CMD_CALL: {
+      WritePackedInstruction(bodyBuffer, op, readPacked(pos));
+
+      if (op != OP_PUSH)
+        bodyBuffer.WriteU32(0);
+      break;
+    }
+
+    case OP_JMP:
+    case OP_JAL:
+    case OP_JEZ:
+    case OP_JNZ: {
+      // Offsets were relative to the operand
+      int64_t target = (int64_t)pos + 1 + operands.Read32();
+
+      if (target < 0 || target > codeLen || newPositions[target] < 0)
+        throw Exception("jump at %u doesn't land on an instruction", pos);
+
+      int64_t words =
+          (newPositions[target] - newPositions[pos]) / INSTRUCTION_SIZE;
+
+      if (words < JUMP_OFFSET_MIN || words > JUMP_OFFSET_MAX)
+        throw Exception("jump at %u is out of range", pos);
+
+      bodyBuffer.WriteU32(MakeInstruction(op, (uint32_t)words & 0xffffff));
+
+      if (op == OP_JAL)
+        bodyBuffer.WriteU32(0);
+      break;
+    }
+
+    default:
+      bodyBuffer.WriteU32(MakeInstruction(op));
+      break;
+    }
+
+    pos += 1 + GetV1OperandSize(op);
+  }
+}
 
 const char *Bytecode::GetBody() { return body; }
 
 unsigned int Bytecode::GetBodyLen() { return bodyLen; }
 
-const char *Bytecode::GetData() { return data; }
+bool Bytecode::GetFunctionOffset(const std::string &name,
+                                 uint32_t &offset) const
+{
+  auto itr = functionOffsets.find(name);
+
+  if (itr == functionOffsets.end())
+    return false;
+
+  offset = itr->second;
 
-unsigned int Bytecode::GetLen() { return len; }
\ No newline at end of file
+  return true;
+}
+
+ByteBuffer Bytecode::Serialize()
+{
+  BytecodeHeader header;
+  header.constStringTable = stringConstants;
+  header.constNumberTable = numberConstants;
+  header.functionOffsetTable = functionOffsets;
+
+  ByteBuffer buffer;
+  header.Write(buffer, body, bodyLen);
+
+  return buffer;
+}
@@ -1,8 +1,10 @@
+#include <gs1/common/Instruction.hpp>
 #include <gs1/compiler/CompileVisitor.hpp>
 #include <gs1/parse/Parser.hpp>
 #include <gs1/vm/Context.hpp>
 #include <gs1/vm/Device.hpp>
 
+#include <cmath>
 #include <functional>
 
 using namespace gs1;
@@ -19,6 +21,9 @@ void Context::LinkBytecode(std::shared_ptr<Bytecode> bytecode)
 {
   ContextLinkedBytecode cb(bytecode);
   linkedBytecode.push_back(cb);
+
+  // Functions are looked up again, in case they're found earlier now
+  scriptFunctions.clear();
 }
 
 void Context::LinkVarStore(std::shared_ptr<GVarStore> varstore,
@@ -32,18 +37,28 @@ void Context::LinkLibrary(std::shared_ptr<GLibrary> library)
   linkedLibraries.push_back(ContextLinkedLibrary(library));
 }
 
+void Context::SetPrototypes(std::shared_ptr<const PrototypeSet> prototypes)
+{
+  this->prototypes = std::move(prototypes);
+}
+
 GValue Context::UnpackValue(const PackedValue &value,
                             const UnpackType unpackType)
 {
   switch (value.valueType) {
   case PACKVALUE_CONST_NUMBER:
-    return GValue(
-        currentBytecode->numberConstants.GetConstant(value.value).val);
+    // The verifier has checked the index, version 1 bytecode isn't verified
+    if (!currentBytecode->IsVerified() &&
+        value.value >= currentBytecode->numbers.size())
+      throw Exception("number constant %u is out of range", value.value);
+
+    return GValue(currentBytecode->numbers[value.value]);
 
   case PACKVALUE_CONST_STRING: {
     GStringVariable *sv = new GStringVariable();
 
-    sv->string = currentBytecode->stringConstants.GetConstant(value.value).val;
+    sv->string =
+        currentBytecode->stringConstants->GetConstant(value.value).val;
 
     return GValue((GVariable *)sv);
   }
@@ -52,19 +67,20 @@ GValue Context::UnpackValue(const PackedValue &value,
     GArrayVariable *array = new GArrayVariable();
 
     uint32_t size =
-        currentBytecode->numberConstants.GetConstant(value.value).val;
+        currentBytecode->numberConstants->GetConstant(value.value).val;
 
-    array->values.resize(size);
+    // Starts out dense, promoted if a non-number element is popped
+    array->Resize(size);
 
     for (uint32_t i = 0; i < size; ++i)
-      array->values[size - i - 1] = stack.Pop();
+      array->Set(size - i - 1, stack.Pop());
 
     return GValue((GVariable *)array);
   }
 
   case PACKVALUE_NAMED: {
     std::string varName =
-        currentBytecode->stringConstants.GetConstant(value.value).val;
+        currentBytecode->stringConstants->GetConstant(value.value).val;
 
     switch (unpackType) {
     case UNPACK_NUMBER:
@@ -80,85 +96,121 @@ GValue Context::UnpackValue(const PackedValue &value,
       return GetVariableValue(varName, GVARTYPE_ARRAY);
 
     case UNPACK_ANY: {
-      GVariable *var;
+      static const GVarType lookupOrder[] = {GVARTYPE_FLAG, GVARTYPE_NUMBER,
+                                             GVARTYPE_STRING, GVARTYPE_ARRAY};
 
-      if ((var = GetVariable(varName, GVARTYPE_FLAG)))
-        return GValue(*var);
+      for (auto type : lookupOrder) {
+        GVarStore *varStore = FindVarStore(varName, type);
 
-      if ((var = GetVariable(varName, GVARTYPE_NUMBER)))
-        return GValue(*var);
-
-      if ((var = GetVariable(varName, GVARTYPE_STRING)))
-        return GValue(*var);
-
-      if ((var = GetVariable(varName, GVARTYPE_ARRAY)))
-        return GValue(*var);
+        if (varStore != nullptr)
+          return GetNamedValue(varName, type, varStore);
+      }
 
       // Variable wasn't found..
       // Return a temporary named value
-      return GetVariableValue(varName, GVARTYPE_NUMBER);
+      return GetNamedValue(varName, GVARTYPE_NUMBER, nullptr);
     }
     }
   }
 
+  case PACKVALUE_NAMED_VALUE: {
+    const std::string &varName =
+        currentBytecode->stringConstants->GetConstant(value.value).val;
+
+    // Same lookup as UNPACK_ANY, but nothing assigns to the value so numbers
+    // and flags don't need a named temporary
+    static const GVarType lookupOrder[] = {GVARTYPE_FLAG, GVARTYPE_NUMBER,
+                                           GVARTYPE_STRING, GVARTYPE_ARRAY};
+
+    for (auto type : lookupOrder) {
+      GVarStore *varStore = FindVarStore(varName, type);
+
+      if (varStore == nullptr)
+        continue;
+
+      if (type == GVARTYPE_FLAG || type == GVARTYPE_NUMBER)
+        return varStore->GetValue(varName, type);
+
+      return GetNamedValue(varName, type, varStore);
+    }
+
+    // Missing variables are zero
+    return GValue(0.0);
+  }
+
   default:
     return GValue();
   }
 }
 
-GValue Context::GetVariableValue(const std::string &name, const GVarType &type)
+double Context::UnpackNumber(const PackedValue &value)
 {
-  // Check if this variable's prefix is owned
-  for (auto &clv : linkedVarstores) {
-    if (HasPrefix(name, clv.GetPrefix())) {
-      auto varStore = clv.GetVarstore();
+  return ReadNumber(
+      currentBytecode->stringConstants->GetConstant(value.value).val);
+}
 
-      if (varStore->HasValue(name, type))
-        return varStore->GetValue(name, type);
-    }
-  }
+double Context::ReadNumber(const std::string &varName)
+{
+  // Same lookup as UNPACK_ANY, only numbers read as more than NaN
+  static const GVarType lookupOrder[] = {GVARTYPE_FLAG, GVARTYPE_NUMBER,
+                                         GVARTYPE_STRING, GVARTYPE_ARRAY};
 
-  // Otherwise, use the unprefixed, primary varstore
-  if (primaryVarStore->HasValue(name, type))
-    return primaryVarStore->GetValue(name, type);
+  for (auto type : lookupOrder) {
+    GVarStore *varStore = FindVarStore(varName, type);
 
-  // Return a GValue with a name
-  // TODO: Maybe separate this into a GetNamedValue?
-  GVariable *var;
+    if (varStore == nullptr)
+      continue;
 
-  switch (type) {
-  case GVARTYPE_NUMBER:
-    var = new GNumberVariable();
-    var->name = name;
+    if (type != GVARTYPE_NUMBER)
+      return NAN;
 
-    return GValue(var);
+    return varStore->GetValue(varName, type).GetNumber();
+  }
 
-  case GVARTYPE_FLAG:
-    var = new GFlagVariable();
-    var->name = name;
+  // Missing variables are zero
+  return 0;
+}
 
-    return GValue(var);
+bool Context::StepCounter(uint32_t nameIndex, uint32_t boundIndex)
+{
+  // Only verified bytecode has OP_FORLOOP, so the indices are in range
+  const std::string &name =
+      currentBytecode->stringConstants->GetConstant(nameIndex).val;
+  double bound = currentBytecode->numbers[boundIndex];
 
-  case GVARTYPE_STRING:
-    var = new GStringVariable();
-    var->name = name;
+  GVarStore *varStore = FindVarStore(name, GVARTYPE_NUMBER);
+  double counter = 0;
 
-    return GValue(var);
+  if (varStore != nullptr)
+    counter = varStore->GetValue(name, GVARTYPE_NUMBER).GetNumber();
 
-  case GVARTYPE_ARRAY:
-    var = new GArrayVariable();
-    var->name = name;
+  SetVariable(name, GVARTYPE_NUMBER, GValue(counter + 1));
 
-    return GValue(var);
-  }
+  // Read back the way the condition would, another type may shadow it
+  return ReadNumber(name) < bound;
+}
+
+GValue Context::GetVariableValue(const std::string &name, const GVarType &type)
+{
+  return GetNamedValue(name, type, FindVarStore(name, type));
 }
 
 GVariable *Context::GetVariable(const std::string &name, const GVarType &type)
+{
+  GVarStore *varStore = FindVarStore(name, type);
+
+  if (varStore != nullptr)
+    return varStore->GetVariable(name, type);
+
+  return nullptr;
+}
+
+GVarStore *Context::FindVarStore(const std::string &name, const GVarType &type)
 {
   // Event flags are read only and have top priority
   if (eventFlags != nullptr) {
     if (eventFlags->HasValue(name, type))
-      return eventFlags->GetVariable(name, type);
+      return eventFlags;
   }
 
   // Check if this variable's prefix is owned
@@ -167,17 +219,54 @@ GVariable *Context::GetVariable(const std::string &name, const GVarType &type)
       auto varStore = clv.GetVarstore();
 
       if (varStore->HasValue(name, type))
-        return varStore->GetVariable(name, type);
+        return varStore.get();
     }
   }
 
   // Otherwise, use the unprefixed, primary varstore
   if (primaryVarStore->HasValue(name, type))
-    return primaryVarStore->GetVariable(name, type);
+    return primaryVarStore.get();
 
   return nullptr;
 }
 
+GValue Context::GetNamedValue(const std::string &name, const GVarType &type,
+                              GVarStore *varStore)
+{
+  // Strings and arrays are copied out of the store with their name
+  if (varStore != nullptr &&
+      (type == GVARTYPE_STRING || type == GVARTYPE_ARRAY))
+    return varStore->GetValue(name, type);
+
+  // Numbers and flags are stored unboxed, so they're wrapped in a named
+  // temporary which can be used as an assignment target
+  GVariable *var;
+
+  switch (type) {
+  case GVARTYPE_NUMBER:
+    var = new GNumberVariable(
+        varStore != nullptr ? varStore->GetValue(name, type).GetNumber() : 0);
+    break;
+
+  case GVARTYPE_FLAG:
+    var = new GFlagVariable(
+        varStore != nullptr ? varStore->GetValue(name, type).GetFlag() : false);
+    break;
+
+  case GVARTYPE_STRING:
+    var = new GStringVariable();
+    break;
+
+  default:
+    var = new GArrayVariable();
+    break;
+  }
+
+  var->name = name;
+
+  return GValue(var);
+}
+
 void Context::SetVariable(const std::string &name, const GVarType &type,
                           const GValue &value)
 {
@@ -196,6 +285,25 @@ void Context::SetVariable(const std::string &name, const GVarType &type,
   primaryVarStore->SetValue(name, type, value);
 }
 
+void Context::SettleStack(int size, bool keepTop)
+{
+  // A native's result is the last value it pushed
+  if (keepTop && stack.Size() > size) {
+    GValue top = stack.Pop();
+
+    while (stack.Size() >= size)
+      stack.Pop();
+
+    stack.Push(top);
+  }
+
+  while (stack.Size() > size)
+    stack.Pop();
+
+  while (stack.Size() < size)
+    stack.Push(GValue(0.0));
+}
+
 void Context::CallCommand(const std::string &name)
 {
   // Call command by library
@@ -210,7 +318,7 @@ void Context::CallCommand(const std::string &name)
   }
 }
 
-void Context::CallFunction(const std::string &name)
+bool Context::CallFunction(const std::string &name)
 {
   // Call function by library
   std::function<void(Context * context)> *func;
@@ -219,14 +327,25 @@ void Context::CallFunction(const std::string &name)
     if ((func = lib.GetLibrary()->GetFunction(name))) {
       (*func)(this);
 
-      break;
+      return true;
     }
   }
+
+  return false;
 }
 
-void Context::BranchAndLink(const uint32_t &offset)
+void Context::BranchAndLink(const uint32_t &offset, uint32_t argCount)
 {
-  jumpStack.Push(currentBytecode->body - instructionPointer);
+  if (jumpStack.Size() >= MAX_CALL_DEPTH)
+    throw Exception("script function calls nested over %d deep",
+                    MAX_CALL_DEPTH);
+
+  // Script functions don't take parameters, arguments are only evaluated
+  int stackBase = stack.Size() - (int)argCount;
+  SettleStack(stackBase > 0 ? stackBase : 0);
+
+  jumpStack.Push(CallFrame(instructionPointer - currentBytecode->body,
+                           stack.Size()));
 
   instructionPointer = currentBytecode->body + offset;
 }
@@ -234,14 +353,19 @@ void Context::BranchAndLink(const uint32_t &offset)
 void Context::Return()
 {
   if (jumpStack.Size() > 0) {
-    instructionPointer = currentBytecode->body + jumpStack.Pop();
+    CallFrame frame = jumpStack.Pop();
+
+    // Nothing is returned, the call's value is zero
+    SettleStack(frame.stackBase);
+    stack.Push(GValue(0.0));
+
+    instructionPointer = currentBytecode->body + frame.returnOffset;
   } else {
     Halt();
   }
 }
 
 // TODO:
-// Clean this up..
 // This should be part of AST generation, perhaps
 std::string Context::InterpolateString(std::string inputString)
 {
@@ -251,61 +375,101 @@ std::string Context::InterpolateString(std::string inputString)
   const char *c = inputString.c_str();
 
   while (*c != '\0') {
-    if (*c == '#') {
-      // Check if needs formatting
-      int len;
-      if ((len = stringFormatter->NeedsFormatting(++c))) {
-        std::string specifier = std::string(c, len);
-        c += specifier.length();
-
-        // Get the parameters
-        // Is as follows:
-        // Look for uninterrupted whitespace followed by (
-        // If there's a (, go until matching )
-        // If no (, there are no parameters
-        std::string param;
-        const char *p = c;
-
-        // Skip whitespace until '('
-        while (*p == ' ' && *p != '(') {
-          ++p;
-          continue;
-        }
-
-        // Check if there's a parameter
-        if (*p == '(') {
-          int depth = 1;
-
-          // Skip the leading bracket
-          p++;
-
-          while (true) {
-            if (*p == '(')
-              depth++;
-
-            if (*p == ')')
-              depth--;
-
-            if (depth <= 0)
-              break;
-
-            param += *p++;
-          }
-        }
-
-        c = p + 1;
-
-        outputString += stringFormatter->Format(this, specifier, param);
+    int len;
+
+    // A '#' which doesn't start a specifier is kept as is
+    if (*c != '#' || !(len = stringFormatter->NeedsFormatting(c + 1))) {
+      outputString += *c++;
+      continue;
+    }
+
+    std::string specifier(c + 1, len);
+    c += 1 + len;
+
+    // Get the parameters
+    // Is as follows:
+    // Look for uninterrupted whitespace followed by (
+    // If there's a (, go until matching )
+    // If no (, there are no parameters
+    std::string param;
+    const char *p = c;
+
+    // Skip whitespace until '('
+    while (*p == ' ')
+      ++p;
+
+    // Check if there's a parameter, an unclosed one runs to the end
+    if (*p == '(') {
+      int depth = 1;
+
+      // Skip the leading bracket
+      p++;
+
+      while (*p != '\0') {
+        if (*p == '(')
+          depth++;
+        else if (*p == ')' && --depth == 0)
+          break;
+
+        param += *p++;
       }
+
+      // Skip the closing bracket
+      c = *p == ')' ? p + 1 : p;
     }
 
-    outputString += *c++;
+    outputString += stringFormatter->Format(this, specifier, param);
   }
 
   return outputString;
 }
 
-void Context::Eval(const std::string &code, const Stack &stack) {}
+GValue Context::Eval(const std::string &expression)
+{
+  std::shared_ptr<Bytecode> snippet =
+      device->LoadSnippet(expression, prototypes);
+
+  // Eval can be called from a native while other bytecode is being ran, the
+  // snippet is run on top of it and it's picked up again after
+  std::shared_ptr<Bytecode> outerBytecode = std::move(currentBytecode);
+  const char *outerPointer = instructionPointer;
+  uint32_t outerInstruction = instruction;
+  bool outerHalted = halted;
+  int stackBase = stack.Size();
+
+  auto restore = [&]() {
+    SettleStack(stackBase);
+
+    currentBytecode = std::move(outerBytecode);
+    instructionPointer = outerPointer;
+    instruction = outerInstruction;
+    halted = outerHalted;
+  };
+
+  currentBytecode = snippet;
+  halted = false;
+  Reserve();
+
+  const char *startPos = snippet->GetBody();
+  instructionPointer = startPos;
+
+  GValue value(0.0);
+
+  try {
+    // Snippets are always verified
+    RunVerified(startPos + snippet->GetBodyLen());
+
+    if (stack.Size() > stackBase)
+      value = GValue(stack.Pop().GetNumber());
+  } catch (...) {
+    restore();
+    throw;
+  }
+
+  restore();
+
+  return value;
+}
 
 void Context::Run(GVarStore *eventFlags)
 {
@@ -320,18 +484,114 @@ void Context::Run(GVarStore *eventFlags)
     unsigned int len = currentBytecode->GetBodyLen();
 
     instructionPointer = startPos;
+    jumpStack.Clear();
+    Reserve();
 
-    while (instructionPointer < startPos + len) {
-      const Opcode op = static_cast<const Opcode>(*instructionPointer);
-      instructionPointer++;
+    if (currentBytecode->IsVerified())
+      RunVerified(startPos + len);
+    else
+      RunChecked(startPos, startPos + len);
 
-      operationDispatcher.Dispatch(this, *currentBytecode, op);
+    halted = false;
+  }
+}
 
-      if (halted) {
-        halted = false;
+GValue Context::CallScriptFunction(const std::string &name,
+                                  const std::vector<GValue> &args,
+                                  GVarStore *eventFlags)
+{
+  this->eventFlags = eventFlags;
+
+  auto itr = scriptFunctions.find(name);
+
+  // Look the function up once, the first linked bytecode with it wins
+  if (itr == scriptFunctions.end()) {
+    for (auto &clb : linkedBytecode) {
+      uint32_t offset;
+
+      if (clb.GetBytecode()->GetFunctionOffset(name, offset)) {
+        itr = scriptFunctions
+                  .emplace(name, ScriptFunction{clb.GetBytecode(), offset})
+                  .first;
         break;
       }
     }
+
+    if (itr == scriptFunctions.end())
+      throw Exception("no script function named %s", name.c_str());
+  }
+
+  currentBytecode = itr->second.bytecode;
+
+  const char *startPos = currentBytecode->GetBody();
+  unsigned int len = currentBytecode->GetBodyLen();
+  int stackBase = stack.Size();
+
+  for (auto &arg : args)
+    stack.Push(arg);
+
+  // The call returns to the end of the body, which ends the run
+  instructionPointer = startPos + len;
+  jumpStack.Clear();
+  Reserve();
+
+  BranchAndLink(itr->second.offset, args.size());
+
+  if (currentBytecode->IsVerified())
+    RunVerified(startPos + len);
+  else
+    RunChecked(startPos, startPos + len);
+
+  // A function which stops the script doesn't get to return a value
+  GValue result(0.0);
+
+  if (!halted && stack.Size() > stackBase)
+    result = stack.Pop();
+
+  SettleStack(stackBase);
+  halted = false;
+
+  return result;
+}
+
+void Context::Reserve()
+{
+  if (temps.size() < currentBytecode->GetTempCount())
+    temps.resize(currentBytecode->GetTempCount());
+
+  // Calls each get a frame as deep again, those grow the stack as they go
+  stack.Reserve(stack.Size() + currentBytecode->GetMaxStackDepth());
+}
+
+void Context::RunVerified(const char *endPos)
+{
+  // The verifier has made sure every instruction fits, has a handler and
+  // only jumps to other instructions
+  while (instructionPointer < endPos && !halted) {
+    instruction = ReadInstruction(instructionPointer);
+    instructionPointer += INSTRUCTION_SIZE;
+
+    operationDispatcher.DispatchVerified(this, GetOpcode(instruction));
+  }
+}
+
+void Context::RunChecked(const char *startPos, const char *endPos)
+{
+  while (instructionPointer < endPos && !halted) {
+    unsigned int remaining = endPos - instructionPointer;
+
+    if (GetInstructionSize(instructionPointer, remaining) == 0)
+      throw Exception("instruction at %u runs past the end",
+                      (unsigned int)(instructionPointer - startPos));
+
+    instruction = ReadInstruction(instructionPointer);
+    instructionPointer += INSTRUCTION_SIZE;
+
+    operationDispatcher.Dispatch(this, *currentBytecode,
+                                 GetOpcode(instruction));
+
+    if (instructionPointer < startPos || instructionPointer > endPos)
+      throw Exception("jumped outside of the bytecode body");
   }
 }
 
@@ -1,5 +1,5 @@
-#include <gs1/compiler/CompileVisitor.hpp>
 #include <gs1/vm/Device.hpp>
+#include <gs1/vm/Verifier.hpp>
 
 using namespace gs1;
 
@@ -7,52 +7,53 @@ Device::Device() {}
 
 Device::~Device() {}
 
-void observer(const Diag &d)
+static void PrintDiag(const CompileDiag &compileDiag)
 {
+  const Diag &d = compileDiag.diag;
+  int offset = d.pos.offset != -1 ? d.pos.offset : d.range.beg.offset;
+  uint32_t line = compileDiag.line;
+
   switch (d.severity) {
   case Diag::Info:
-    Log::Get().Print(LOGLEVEL_INFO, "info: %d@%d: %s\n", d.pos.line + 1,
-                     d.pos.offset, d.message.c_str());
+    Log::Get().Print(LOGLEVEL_INFO, "info: %d@%d: %s\n", line + 1, offset,
+                     d.message.c_str());
     break;
   case Diag::Warning:
-    Log::Get().Print(LOGLEVEL_WARNING, "warning: %d@%d: %s\n", d.pos.line + 1,
-                     d.pos.offset, d.message.c_str());
+    Log::Get().Print(LOGLEVEL_WARNING, "warning: %d@%d: %s\n", line + 1,
+                     offset, d.message.c_str());
     break;
   case Diag::Error:
-    Log::Get().Print(LOGLEVEL_ERROR, "error: %d@%d: %s\n", d.pos.line + 1,
-                     d.pos.offset, d.message.c_str());
+    Log::Get().Print(LOGLEVEL_ERROR, "error: %d@%d: %s\n", line + 1, offset,
+                     d.message.c_str());
     break;
   }
 }
 
 ByteBuffer Device::CompileSourceFromString(std::string str, PrototypeMap cmds,
-                                           PrototypeMap funcs)
+                                           PrototypeMap funcs,
+                                           CompileMode mode)
 {
-  MemorySource source(str.c_str());
-  DiagBuilder diag(observer);
-  CompileVisitor visitor(source);
-  Lexer lexer(diag, source);
-  Parser parser(diag, lexer, cmds, funcs);
-
-  auto tree = parser.Parse();
-  tree->Accept(&visitor);
-
-  return visitor.GetBytecode();
+  MemorySource source(str);
+  return CompileSource(source, cmds, funcs, mode);
 }
 
 ByteBuffer Device::CompileSourceFromFile(std::string path, PrototypeMap cmds,
-                                         PrototypeMap funcs)
+                                         PrototypeMap funcs, CompileMode mode)
+{
+  MappedFileSource source(path);
+  return CompileSource(source, cmds, funcs, mode);
+}
+
+ByteBuffer Device::CompileSource(ISource &source, const PrototypeMap &cmds,
+                                 const PrototypeMap &funcs, CompileMode mode)
 {
-  FileSource source(path);
-  DiagBuilder diag(observer);
-  CompileVisitor visitor(source);
-  Lexer lexer(diag, source);
-  Parser parser(diag, lexer, cmds, funcs);
+  CompilerSession session(cmds, funcs, mode);
+  session.Compile(source);
 
-  auto tree = parser.Parse();
-  tree->Accept(&visitor);
+  for (auto &d : session.GetDiags())
+    PrintDiag(d);
 
-  return visitor.GetBytecode();
+  return session.GetBytecode();
 }
 
 std::shared_ptr<Context>
@@ -69,5 +70,34 @@ std::shared_ptr<GVarStore> Device::CreateVarStore()
 std::shared_ptr<Bytecode> Device::LoadBytecode(const char *data,
                                                unsigned int length)
 {
-  return std::make_shared<Bytecode>(data, length);
-}
\ No newline at end of file
+  auto bytecode = std::make_shared<Bytecode>(data, length);
+
+  // Version 1 doesn't say how many arguments calls take, it's left to run
+  // with checks
+  if (bytecode->version > 1)
+    Verifier(*bytecode).Verify();
+
+  return bytecode;
+}
+
+std::shared_ptr<Bytecode> Device::LoadBytecode(CompilerSession &session)
+{
+  BytecodeHeader header;
+  ByteBuffer body;
+
+  session.TakeOutput(header, body);
+
+  auto bytecode = std::make_shared<Bytecode>(header, body);
+  Verifier(*bytecode).Verify();
+
+  return bytecode;
+}
+
+std::shared_ptr<Bytecode>
+Device::LoadSnippet(const std::string &expression,
+                    const std::shared_ptr<const PrototypeSet> &prototypes)
+{
+  return snippets.Get(expression, prototypes);
+}
+
+void Device::SetSnippetCacheSize(size_t size) { snippets.SetCapacity(size); }
@@ -29,23 +29,21 @@ std::string GStringFormatter::Format(Context *context, const std::string &type,
 {
   // Variable values
   if (type == "v") {
-    // TODO:
-    // These need to be properly eval'd
-    // Right now it just fetches a single number
-    GVariable *variable = context->GetVariable(param, GVARTYPE_NUMBER);
+    double number;
 
-    if (variable && variable->GetVarType() == GVARTYPE_NUMBER) {
-      Log::Get().Print(LOGLEVEL_VERBOSE, "#v %s=%f\n", param.c_str(),
-                       ((GNumberVariable *)variable)->number);
+    try {
+      number = context->Eval(param).GetNumber();
+    } catch (Exception &e) {
+      Log::Get().Print(LOGLEVEL_WARNING, "#v %s\n", e.what());
+      return "";
+    }
 
-      // TODO: Fix this
-      std::string output;
-      output.resize(16);
-      snprintf(&output[0], 16, "%.6g", ((GNumberVariable *)variable)->number);
+    Log::Get().Print(LOGLEVEL_VERBOSE, "#v %s=%f\n", param.c_str(), number);
 
-      return output;
-    } else
-      Log::Get().Print(LOGLEVEL_VERBOSE, "#v %s not found!\n", param.c_str());
+    char output[32];
+    snprintf(output, sizeof(output), "%.6g", number);
+
+    return output;
   }
   // String values
   else if (type == "s") {
@@ -78,6 +76,9 @@ std::string GStringFormatter::Format(Context *context, const std::string &type,
     Log::Get().Print(LOGLEVEL_VERBOSE, "#e %s[%d:%d] = %s\n", param.c_str(),
                      startIndex, length, str.c_str());
 
+    if (startIndex < 0 || (size_t)startIndex >= str.length() || length < 0)
+      return "";
+
     return str.substr(startIndex, length);
   }
 
@@ -4,84 +4,100 @@
 
 using namespace gs1;
 
-GVarStore::GVarStore()
-{
-  // Create each type bank
-  typeBanks[GVARTYPE_NUMBER] = new TypeBank();
-  typeBanks[GVARTYPE_STRING] = new TypeBank();
-  typeBanks[GVARTYPE_FLAG] = new TypeBank();
-  typeBanks[GVARTYPE_ARRAY] = new TypeBank();
-}
+GVarStore::GVarStore() {}
 
-GVarStore::~GVarStore()
-{
-  for (auto &typeBank : typeBanks)
-    delete typeBank.second;
-}
+GVarStore::~GVarStore() {}
 
 bool GVarStore::HasValue(const std::string &name, GVarType type)
 {
-  TypeBank *bank = typeBanks[type];
-
-  return bank->variables.find(name) != bank->variables.end();
+  return typeBanks[type].Find(name) != nullptr;
 }
 
 GVariable *GVarStore::GetVariable(const std::string &name, GVarType type)
 {
-  TypeBank *bank = typeBanks[type];
+  GVarSlot *slot = typeBanks[type].Find(name);
+
+  if (slot == nullptr)
+    return nullptr;
 
-  auto var = bank->variables.find(name);
-  if (var != bank->variables.end())
-    return var->second;
+  // Materialise numbers and flags the first time a host asks for them
+  if (slot->variable == nullptr) {
+    switch (type) {
+    case GVARTYPE_NUMBER:
+      slot->variable = new GNumberVariable(slot->value.GetNumber());
+      break;
 
-  return nullptr;
+    case GVARTYPE_FLAG:
+      slot->variable = new GFlagVariable(slot->value.GetFlag());
+      break;
+
+    default:
+      return nullptr;
+    }
+
+    slot->variable->name = name;
+  }
+
+  return slot->variable;
 }
 
 GValue GVarStore::GetValue(const std::string &name, GVarType type)
 {
-  auto var = GetVariable(name, type);
+  GVarSlot *slot = typeBanks[type].Find(name);
 
-  if (var != nullptr)
-    return GValue(var);
-  else
+  if (slot == nullptr)
     return GValue();
+
+  switch (type) {
+  case GVARTYPE_NUMBER:
+    if (slot->variable != nullptr)
+      return GValue(((GNumberVariable *)slot->variable)->number);
+
+    return slot->value;
+
+  case GVARTYPE_FLAG:
+    if (slot->variable != nullptr)
+      return GValue(((GFlagVariable *)slot->variable)->flag);
+
+    return slot->value;
+
+  default:
+    return GValue(*slot->variable);
+  }
 }
 
 void GVarStore::SetValue(const std::string &name, const GVarType type,
                          const GValue &value)
 {
-  TypeBank *bank = typeBanks[type];
-  GVariable *var = bank->variables[name];
-
-  if (var != nullptr)
-    delete var;
+  switch (type) {
+  case GVARTYPE_NUMBER: {
+    GVarSlot &slot = typeBanks[type].FindOrCreate(name);
+    slot.value = GValue(value.GetNumber());
 
-  switch (value.GetValueType()) {
-  case GVALUETYPE_NUMBER: {
-    GVariable *numberVar = new GNumberVariable(value.GetNumber());
-    numberVar->name = name;
-
-    bank->variables[name] = numberVar;
+    if (slot.variable != nullptr)
+      ((GNumberVariable *)slot.variable)->number = value.GetNumber();
     break;
   }
 
-  case GVALUETYPE_FLAG: {
-    GVariable *flagVar = new GFlagVariable(value.GetFlag());
-    flagVar->name = name;
+  case GVARTYPE_FLAG: {
+    GVarSlot &slot = typeBanks[type].FindOrCreate(name);
+    slot.value = GValue(value.GetFlag());
 
-    bank->variables[name] = flagVar;
+    if (slot.variable != nullptr)
+      ((GFlagVariable *)slot.variable)->flag = value.GetFlag();
     break;
   }
 
-  case GVALUETYPE_GVARIABLE: {
-    GVariable *copy = value.GetVariable()->Clone();
-    copy->name = name;
+  default: {
+    if (value.GetValueType() != GVALUETYPE_GVARIABLE)
+      break;
 
-    bank->variables[name] = copy;
-    break;
-  }
+    GVarSlot &slot = typeBanks[type].FindOrCreate(name);
+    delete slot.variable;
 
-  default:
+    slot.variable = value.GetVariable()->Clone();
+    slot.variable->name = name;
     break;
   }
-}
\ No newline at end of file
+  }
+}
@@ -1,3 +1,4 @@
+#include <gs1/common/Instruction.hpp>
 #include <gs1/common/Log.hpp>
 #include <gs1/vm/Context.hpp>
 
@@ -6,11 +7,16 @@ using namespace gs1;
 static bool g_initialized = false;
 static std::function<void(Context *context)> operationHandlers[OP_NUM_OPS];
 
-static inline int32_t readOffset(const char *data)
+// The number variable an increment or decrement works on, nullptr for
+// anything else, which is left as it is
+static GNumberVariable *GetNumberVariable(const GValue &value)
 {
-  char value[4] = {data[0], data[1], data[2], data[3]};
+  GVariable *variable = value.GetVariable();
 
-  return *((int32_t *)&value);
+  if (variable == nullptr || variable->GetVarType() != GVARTYPE_NUMBER)
+    return nullptr;
+
+  return (GNumberVariable *)variable;
 }
 
 OperationDispatcher::OperationDispatcher()
@@ -21,8 +27,8 @@ OperationDispatcher::OperationDispatcher()
   g_initialized = true;
 
   operationHandlers[OP_PUSH] = [&](Context *context) {
-    PackedValue &pLValue = *(PackedValue *)context->instructionPointer;
-    context->instructionPointer += sizeof(PackedValue);
+    PackedValue pLValue = ReadPackedOperand(context->instruction,
+                                            context->instructionPointer);
 
     GValue lValue = context->UnpackValue(pLValue);
     context->stack.Push(lValue);
@@ -40,7 +46,13 @@ OperationDispatcher::OperationDispatcher()
 
   operationHandlers[OP_ASSIGN] = [&](Context *context) {
     GValue rValue = context->stack.Pop();
-    std::string varName = context->stack.Pop().GetVariable()->name;
+    GValue lValue = context->stack.Pop();
+
+    // Only variables can be assigned to, "5 = 3" does nothing
+    if (lValue.GetVariable() == nullptr)
+      return;
+
+    std::string varName = lValue.GetVariable()->name;
 
     switch (rValue.GetValueType()) {
     case GVALUETYPE_NUMBER:
@@ -64,7 +76,7 @@ OperationDispatcher::OperationDispatcher()
 
         Log::Get().Print(
             LOGLEVEL_VERBOSE, "%s = Array: size %u\n", varName.c_str(),
-            (uint32_t)((GArrayVariable *)rValue.GetVariable())->values.size());
+            ((GArrayVariable *)rValue.GetVariable())->size());
         break;
 
       case GVARTYPE_NUMBER:
@@ -91,7 +103,10 @@ OperationDispatcher::OperationDispatcher()
 
     GArrayVariable *array =
         (GArrayVariable *)context->GetVariable(arrName, GVARTYPE_ARRAY);
-    array->values[(uint32_t)index.GetNumber()] = rValue.GetNumber();
+
+    // Like a write past the end, a write to a missing array is dropped
+    if (array != nullptr)
+      array->SetNumber((uint32_t)index.GetNumber(), rValue.GetNumber());
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "Array set: %s[%u] = %f\n",
                      arrName.c_str(), (uint32_t)index.GetNumber(),
@@ -104,7 +119,12 @@ OperationDispatcher::OperationDispatcher()
 
     GArrayVariable *array =
         (GArrayVariable *)context->GetVariable(arrName, GVARTYPE_ARRAY);
-    GValue value = array->values[(uint32_t)index.GetNumber()];
+
+    // Missing arrays read as zero, as elements past the end do
+    GValue value(0.0);
+
+    if (array != nullptr)
+      value = array->Get((uint32_t)index.GetNumber());
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "Array lookup: %s[%u], Push %f\n",
                      arrName.c_str(), (uint32_t)index.GetNumber(),
@@ -173,16 +193,20 @@ OperationDispatcher::OperationDispatcher()
     double lValue = context->stack.Pop().GetNumber();
 
     // Multiply the two values and push the result
-    context->stack.Push(GValue(powf(lValue, rValue)));
+    context->stack.Push(GValue(pow(lValue, rValue)));
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "%f ^ %f = %f\n", lValue, rValue,
-                     powf(lValue, rValue));
+                     pow(lValue, rValue));
   };
 
   operationHandlers[OP_INC] = [&](Context *context) {
     GValue value = context->stack.Pop();
+    GNumberVariable *variable = GetNumberVariable(value);
+
+    if (variable == nullptr)
+      return;
 
-    ((GNumberVariable *)value.GetVariable())->number += 1.0f;
+    variable->number += 1.0;
 
     // Increment the value on the varstore
     context->SetVariable(value.GetVariable()->name, GVARTYPE_NUMBER, value);
@@ -197,7 +221,12 @@ OperationDispatcher::OperationDispatcher()
     // Push the value back onto the stack
     context->stack.Push(GValue(value.GetNumber()));
 
-    ((GNumberVariable *)value.GetVariable())->number += 1.0f;
+    GNumberVariable *variable = GetNumberVariable(value);
+
+    if (variable == nullptr)
+      return;
+
+    variable->number += 1.0;
 
     // Increment the value on the varstore
     context->SetVariable(value.GetVariable()->name, GVARTYPE_NUMBER, value);
@@ -208,8 +237,12 @@ OperationDispatcher::OperationDispatcher()
 
   operationHandlers[OP_DEC] = [&](Context *context) {
     GValue value = context->stack.Pop();
+    GNumberVariable *variable = GetNumberVariable(value);
 
-    ((GNumberVariable *)value.GetVariable())->number -= 1.0f;
+    if (variable == nullptr)
+      return;
+
+    variable->number -= 1.0;
 
     // Increment the value on the varstore
     context->SetVariable(value.GetVariable()->name.c_str(), GVARTYPE_NUMBER,
@@ -225,7 +258,12 @@ OperationDispatcher::OperationDispatcher()
     // Push the value back onto the stack
     context->stack.Push(GValue(value.GetNumber()));
 
-    ((GNumberVariable *)value.GetVariable())->number -= 1.0f;
+    GNumberVariable *variable = GetNumberVariable(value);
+
+    if (variable == nullptr)
+      return;
+
+    variable->number -= 1.0;
 
     // Increment the value on the varstore
     context->SetVariable(value.GetVariable()->name.c_str(), GVARTYPE_NUMBER,
@@ -236,9 +274,11 @@ OperationDispatcher::OperationDispatcher()
   };
 
   operationHandlers[OP_CALL] = [&](Context *context) {
-    PackedValue &packedCommandName =
-        *(PackedValue *)context->instructionPointer;
-    context->instructionPointer += sizeof(PackedValue);
+    PackedValue packedCommandName = ReadPackedOperand(
+        context->instruction, context->instructionPointer);
+
+    uint32_t argCount = ReadInstruction(context->instructionPointer);
+    context->instructionPointer += INSTRUCTION_SIZE;
 
     std::string funcName =
         ((GStringVariable *)context->UnpackValue(packedCommandName)
@@ -247,13 +287,27 @@ OperationDispatcher::OperationDispatcher()
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "FUNC_CALL: %s\n", funcName.c_str());
 
-    context->CallFunction(funcName);
+    int base = context->stack.Size() - argCount;
+    bool found = context->CallFunction(funcName);
+
+    // Verified code counts on the arguments being replaced by one result,
+    // which is zero if there's no such function
+    if (context->currentBytecode->IsVerified()) {
+      if (found) {
+        context->SettleStack(base + 1, true);
+      } else {
+        context->SettleStack(base);
+        context->stack.Push(GValue(0.0));
+      }
+    }
   };
 
   operationHandlers[OP_CMD_CALL] = [&](Context *context) {
-    PackedValue &packedCommandName =
-        *(PackedValue *)context->instructionPointer;
-    context->instructionPointer += sizeof(PackedValue);
+    PackedValue packedCommandName = ReadPackedOperand(
+        context->instruction, context->instructionPointer);
+
+    uint32_t argCount = ReadInstruction(context->instructionPointer);
+    context->instructionPointer += INSTRUCTION_SIZE;
 
     std::string commandName =
         ((GStringVariable *)context->UnpackValue(packedCommandName)
@@ -262,26 +316,38 @@ OperationDispatcher::OperationDispatcher()
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "CMD_CALL: %s\n", commandName.c_str());
 
+    int base = context->stack.Size() - argCount;
+
     context->CallCommand(commandName);
+
+    // Verified code counts on the arguments being gone
+    if (context->currentBytecode->IsVerified())
+      context->SettleStack(base);
   };
 
   operationHandlers[OP_JMP] = [&](Context *context) {
     // Get byte offset
-    int32_t offset = readOffset(context->instructionPointer);
+    int32_t offset = GetJumpOffset(context->instruction);
 
-    // Jump to offset
-    context->instructionPointer += offset;
+    // Jump to offset, counted from the jump which has been read past
+    context->instructionPointer += offset - INSTRUCTION_SIZE;
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "JMP: Jumping by %d\n", offset);
   };
 
   operationHandlers[OP_JAL] = [&](Context *context) {
-    // Get byte offset
-    int32_t offset = readOffset(context->instructionPointer);
+    // Get byte offset, counted from the jump
+    int32_t offset = GetJumpOffset(context->instruction);
+    const char *target =
+        context->instructionPointer - INSTRUCTION_SIZE + offset;
+
+    // The function returns past the argument count
+    uint32_t argCount = ReadInstruction(context->instructionPointer);
+    context->instructionPointer += INSTRUCTION_SIZE;
 
     // Jump to offset and link
-    context->BranchAndLink((context->instructionPointer + offset) -
-                           context->currentBytecode->GetBody());
+    context->BranchAndLink(target - context->currentBytecode->GetBody(),
+                           argCount);
 
     Log::Get().Print(LOGLEVEL_VERBOSE, "JAL: Jump + linking by %d\n", offset);
   };
@@ -352,19 +418,17 @@ OperationDispatcher::OperationDispatcher()
     bool value = context->stack.Pop().GetFlag();
 
     // Get byte offset
-    int32_t offset = readOffset(context->instructionPointer);
+    int32_t offset = GetJumpOffset(context->instruction);
 
     // Jump to offset
     if (!value) {
       Log::Get().Print(LOGLEVEL_VERBOSE, "JEZ: 0 == 0, Jumping by %d\n",
                        offset);
 
-      context->instructionPointer += offset;
+      context->instructionPointer += offset - INSTRUCTION_SIZE;
     } else {
       Log::Get().Print(LOGLEVEL_VERBOSE, "JEZ: %d != 0, Ignoring jump by %d\n",
                        value, offset);
-
-      context->instructionPointer += sizeof(int32_t);
     }
   };
 
@@ -372,19 +436,17 @@ OperationDispatcher::OperationDispatcher()
     bool value = context->stack.Pop().GetFlag();
 
     // Get byte offset
-    int32_t offset = readOffset(context->instructionPointer);
+    int32_t offset = GetJumpOffset(context->instruction);
 
     // Jump to offset
     if (value) {
       Log::Get().Print(LOGLEVEL_VERBOSE, "JNZ: 0 != 0, Jumping by %d\n",
                        offset);
 
-      context->instructionPointer += offset;
+      context->instructionPointer += offset - INSTRUCTION_SIZE;
     } else {
       Log::Get().Print(LOGLEVEL_VERBOSE, "JNZ: %d == 0, Ignoring jump by %d\n",
                        value, offset);
-
-      context->instructionPointer += sizeof(int32_t);
     }
   };
 
@@ -403,6 +465,201 @@ OperationDispatcher::OperationDispatcher()
     context->Halt();
   };
 
+  operationHandlers[OP_POP] = [&](Context *context) {
+    // Drop a value nothing uses
+    context->stack.Pop();
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "Pop\n");
+  };
+
+  operationHandlers[OP_PUSH_NUM] = [&](Context *context) {
+    PackedValue pValue = ReadPackedOperand(context->instruction,
+                                           context->instructionPointer);
+
+    double value = context->UnpackNumber(pValue);
+    context->stack.Push(GValue(value));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "push number %f\n", value);
+  };
+
+  operationHandlers[OP_PUSH0] = [&](Context *context) {
+    context->stack.Push(GValue(0.0));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "push 0\n");
+  };
+
+  operationHandlers[OP_PUSH1] = [&](Context *context) {
+    context->stack.Push(GValue(1.0));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "push 1\n");
+  };
+
+  operationHandlers[OP_PUSHI] = [&](Context *context) {
+    int32_t value = GetImmediate(context->instruction);
+    context->stack.Push(GValue((double)value));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "push %d\n", value);
+  };
+
+  operationHandlers[OP_FORLOOP] = [&](Context *context) {
+    // Get byte offset, counted from the jump
+    int32_t offset = GetJumpOffset(context->instruction);
+    const char *target =
+        context->instructionPointer - INSTRUCTION_SIZE + offset;
+
+    // The counter's name and the bound follow the jump
+    uint32_t nameIndex = ReadInstruction(context->instructionPointer);
+    uint32_t boundIndex =
+        ReadInstruction(context->instructionPointer + INSTRUCTION_SIZE);
+    context->instructionPointer += 2 * INSTRUCTION_SIZE;
+
+    if (context->StepCounter(nameIndex, boundIndex)) {
+      Log::Get().Print(LOGLEVEL_VERBOSE, "FORLOOP: Jumping by %d\n", offset);
+
+      context->instructionPointer = target;
+    } else {
+      Log::Get().Print(LOGLEVEL_VERBOSE, "FORLOOP: Leaving loop\n");
+    }
+  };
+
+  operationHandlers[OP_STORE_TEMP] = [&](Context *context) {
+    uint32_t temp = context->instruction >> 8;
+    context->temps[temp] = context->stack.PeekNumber();
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "temp %u = %f\n", temp,
+                     context->temps[temp]);
+  };
+
+  operationHandlers[OP_PUSH_TEMP] = [&](Context *context) {
+    uint32_t temp = context->instruction >> 8;
+    context->stack.Push(GValue(context->temps[temp]));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "push temp %u: %f\n", temp,
+                     context->temps[temp]);
+  };
+
+  // The compiler only emits these for operands it knows are numbers
+  operationHandlers[OP_ADD_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Add the two numbers and push the result
+    context->stack.Push(GValue(lValue + rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f + %f = %f\n", lValue, rValue,
+                     lValue + rValue);
+  };
+
+  operationHandlers[OP_SUB_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Subtract the two numbers and push the result
+    context->stack.Push(GValue(lValue - rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f - %f = %f\n", lValue, rValue,
+                     lValue - rValue);
+  };
+
+  operationHandlers[OP_MUL_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Multiply the two numbers and push the result
+    context->stack.Push(GValue(lValue * rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f * %f = %f\n", lValue, rValue,
+                     lValue * rValue);
+  };
+
+  operationHandlers[OP_DIV_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Divide the two numbers and push the result
+    context->stack.Push(GValue(lValue / rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f / %f = %f\n", lValue, rValue,
+                     lValue / rValue);
+  };
+
+  operationHandlers[OP_MOD_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Divide the two numbers and push the remainder
+    context->stack.Push(GValue(fmod(lValue, rValue)));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f %% %f = %f\n", lValue, rValue,
+                     fmod(lValue, rValue));
+  };
+
+  operationHandlers[OP_POW_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Raise one number to the other and push the result
+    context->stack.Push(GValue(pow(lValue, rValue)));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f ^ %f = %f\n", lValue, rValue,
+                     pow(lValue, rValue));
+  };
+
+  operationHandlers[OP_EQ_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Compare the two numbers and push the result
+    context->stack.Push(GValue(lValue == rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f == %f = %d\n", lValue, rValue,
+                     lValue == rValue);
+  };
+
+  operationHandlers[OP_LT_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Compare the two numbers and push the result
+    context->stack.Push(GValue(lValue < rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f < %f = %d\n", lValue, rValue,
+                     lValue < rValue);
+  };
+
+  operationHandlers[OP_GT_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Compare the two numbers and push the result
+    context->stack.Push(GValue(lValue > rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f > %f = %d\n", lValue, rValue,
+                     lValue > rValue);
+  };
+
+  operationHandlers[OP_LTE_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Compare the two numbers and push the result
+    context->stack.Push(GValue(lValue <= rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f <= %f = %d\n", lValue, rValue,
+                     lValue <= rValue);
+  };
+
+  operationHandlers[OP_GTE_NN] = [&](Context *context) {
+    double rValue = context->stack.PopNumber();
+    double lValue = context->stack.PopNumber();
+
+    // Compare the two numbers and push the result
+    context->stack.Push(GValue(lValue >= rValue));
+
+    Log::Get().Print(LOGLEVEL_VERBOSE, "%f >= %f = %d\n", lValue, rValue,
+                     lValue >= rValue);
+  };
+
   // TODO:
   // Do logical AND and OR need operators? Not sure.
   // The short-circuit implementation seems to fix that..
@@ -419,6 +676,14 @@ OperationDispatcher::~OperationDispatcher() {}
 
 void OperationDispatcher::Dispatch(Context *context, Bytecode &bytecode,
                                    const Opcode &op)
+{
+  if (op >= OP_NUM_OPS || !operationHandlers[op])
+    throw Exception("no handler for opcode %u", op);
+
+  operationHandlers[op](context);
+}
+
+void OperationDispatcher::DispatchVerified(Context *context, const Opcode &op)
 {
   operationHandlers[op](context);
 }
@@ -0,0 +1,91 @@
+#include <gs1/compiler/CompilerSession.hpp>
+#include <gs1/vm/SnippetCache.hpp>
+#include <gs1/vm/Verifier.hpp>
+
+#include <gs1/common/Log.hpp>
+
+using namespace gs1;
+
+SnippetCache::SnippetCache(size_t capacity) : capacity(capacity) {}
+
+std::shared_ptr<Bytecode>
+SnippetCache::Get(const std::string &expression,
+                  const std::shared_ptr<const PrototypeSet> &prototypes)
+{
+  // The set is told apart by its address, which the entry keeps in use
+  const PrototypeSet *set = prototypes.get();
+  std::string key((const char *)&set, sizeof(set));
+  key += expression;
+
+  auto itr = index.find(key);
+
+  if (itr == index.end()) {
+    static const PrototypeSet noPrototypes;
+    Entry entry{key, nullptr, "", prototypes};
+
+    try {
+      entry.bytecode =
+          Compile(expression, set != nullptr ? *set : noPrototypes);
+    } catch (Exception &e) {
+      entry.error = e.what();
+    }
+
+    entries.push_front(entry);
+    itr = index.emplace(key, entries.begin()).first;
+  } else {
+    entries.splice(entries.begin(), entries, itr->second);
+  }
+
+  // Taken before trimming, which drops even this entry at capacity 0
+  std::shared_ptr<Bytecode> bytecode = itr->second->bytecode;
+  std::string error = itr->second->error;
+
+  Trim();
+
+  if (bytecode == nullptr)
+    throw Exception("%s", error.c_str());
+
+  return bytecode;
+}
+
+std::shared_ptr<Bytecode>
+SnippetCache::Compile(const std::string &expression,
+                      const PrototypeSet &prototypes)
+{
+  Log::Get().Print(LOGLEVEL_VERBOSE, "Compiling snippet: %s\n",
+                   expression.c_str());
+
+  CompilerSession session(prototypes.commands, prototypes.functions);
+
+  if (!session.CompileExpression(expression)) {
+    for (auto &diag : session.GetDiags()) {
+      if (diag.diag.severity == Diag::Error)
+        throw Exception("can't evaluate \"%s\": %s", expression.c_str(),
+                        diag.diag.message.c_str());
+    }
+  }
+
+  BytecodeHeader header;
+  ByteBuffer body;
+  session.TakeOutput(header, body);
+
+  auto bytecode = std::make_shared<Bytecode>(header, body);
+  Verifier(*bytecode).Verify();
+
+  return bytecode;
+}
+
+void SnippetCache::SetCapacity(size_t capacity)
+{
+  this->capacity = capacity;
+
+  Trim();
+}
+
+void SnippetCache::Trim()
+{
+  while (entries.size() > capacity) {
+    index.erase(entries.back().key);
+    entries.pop_back();
+  }
+}
@@ -0,0 +1,183 @@
+#include <gs1/common/Instruction.hpp>
+#include <gs1/common/Log.hpp>
+#include <gs1/vm/Verifier.hpp>
+
+#include <math.h>
+
+using namespace gs1;
+
+Verifier::Verifier(Bytecode &bytecode)
+    : bytecode(bytecode), code(bytecode.body), len(bytecode.bodyLen)
+{
+}
+
+void Verifier::Verify()
+{
+  if (len % INSTRUCTION_SIZE != 0)
+    throw Exception("bytecode body length %u isn't whole instructions", len);
+
+  bytecode.tempCount = 0;
+  boundaries.assign(len / INSTRUCTION_SIZE + 1, false);
+
+  CheckInstructions();
+  CheckStack();
+
+  bytecode.verified = true;
+
+  Log::Get().Print(LOGLEVEL_VERBOSE, "Verified %u bytes of bytecode\n", len);
+}
+
+void Verifier::CheckInstructions()
+{
+  uint32_t pos = 0;
+
+  // Jumps are checked once every instruction's start is known
+  std::vector<std::pair<uint32_t, int64_t>> jumps;
+
+  while (pos < len) {
+    unsigned int size = GetInstructionSize(code + pos, len - pos);
+
+    if (size == 0)
+      throw Exception("instruction at %u runs past the end", pos);
+
+    uint32_t word = ReadInstruction(code + pos);
+    const char *operands = code + pos + INSTRUCTION_SIZE;
+    Opcode op = GetOpcode(word);
+    int64_t pops, pushes;
+
+    if (op >= OP_NUM_OPS || !GetStackUse(op, pops, pushes))
+      throw Exception("unknown opcode %u at %u", op, pos);
+
+    switch (op) {
+    case OP_PUSH:
+      CheckPacked(pos, ReadPackedOperand(word, operands));
+      break;
+
+    case OP_STORE_TEMP:
+    case OP_PUSH_TEMP: {
+      uint32_t temp = word >> 8;
+
+      if (temp >= TEMP_COUNT_MAX)
+        throw Exception("temp %u at %u is out of range", temp, pos);
+
+      if (temp >= bytecode.tempCount)
+        bytecode.tempCount = temp + 1;
+      break;
+    }
+
+    case OP_PUSH_NUM: {
+      PackedValue name = ReadPackedOperand(word, operands);
+
+      if (name.valueType != PACKVALUE_NAMED)
+        throw Exception("number push at %u isn't of a variable", pos);
+
+      CheckPacked(pos, name);
+      break;
+    }
+
+    case OP_CALL:
+    case OP_CMD_CALL: {
+      PackedValue name = ReadPackedOperand(word, operands);
+
+      if (name.valueType != PACKVALUE_CONST_STRING)
+        throw Exception("call at %u isn't by a string constant", pos);
+
+      CheckPacked(pos, name);
+      break;
+    }
+
+    case OP_JMP:
+    case OP_JAL:
+    case OP_JEZ:
+    case OP_JNZ:
+      jumps.emplace_back(pos, (int64_t)pos + GetJumpOffset(word));
+      break;
+
+    case OP_FORLOOP:
+      if (ReadInstruction(operands) >= bytecode.stringConstants->GetSize())
+        throw Exception("loop counter at %u is out of range", pos);
+
+      if (ReadInstruction(operands + INSTRUCTION_SIZE) >=
+          bytecode.numberConstants->GetSize())
+        throw Exception("loop bound at %u is out of range", pos);
+
+      jumps.emplace_back(pos, (int64_t)pos + GetJumpOffset(word));
+      break;
+
+    default:
+      break;
+    }
+
+    boundaries[pos / INSTRUCTION_SIZE] = true;
+    pos += size;
+  }
+
+  // Running off the end stops the script, so it can be jumped to
+  boundaries[len / INSTRUCTION_SIZE] = true;
+
+  for (auto &jump : jumps)
+    CheckTarget(jump.first, jump.second);
+
+  for (auto &function : bytecode.functionOffsets) {
+    uint32_t offset = function.second;
+
+    if (offset >= len || !boundaries[offset / INSTRUCTION_SIZE])
+      throw Exception("function %s doesn't start on an instruction",
+                      function.first.c_str());
+  }
+}
+
+void Verifier::CheckStack()
+{
+  uint32_t depth, pos;
+
+  // Instructions and their operands have already been checked
+  if (!ComputeMaxStackDepth(code, len, *bytecode.numberConstants,
+                            bytecode.functionOffsets, depth, pos))
+    throw Exception("stack underflow or depth mismatch at %u", pos);
+
+  // The context reserves this much stack before running the bytecode
+  if (depth != bytecode.maxStackDepth)
+    throw Exception("max stack depth %u doesn't match the code's %u",
+                    bytecode.maxStackDepth, depth);
+}
+
+void Verifier::CheckPacked(uint32_t pos, const PackedValue &value)
+{
+  size_t tableSize;
+
+  switch (value.valueType) {
+  case PACKVALUE_CONST_NUMBER:
+  case PACKVALUE_CONST_ARRAY:
+    tableSize = bytecode.numberConstants->GetSize();
+    break;
+
+  case PACKVALUE_CONST_STRING:
+  case PACKVALUE_NAMED:
+  case PACKVALUE_NAMED_VALUE:
+    tableSize = bytecode.stringConstants->GetSize();
+    break;
+
+  default:
+    throw Exception("operand at %u has unknown type %u", pos,
+                    value.valueType);
+  }
+
+  if (value.value >= tableSize)
+    throw Exception("constant %u at %u is out of range", value.value, pos);
+
+  // Array sizes are whole counts
+  if (value.valueType == PACKVALUE_CONST_ARRAY) {
+    float size = bytecode.numberConstants->constants[value.value].val;
+
+    if (!(size >= 0 && size <= (float)UINT32_MAX) || size != floorf(size))
+      throw Exception("array at %u has bad size %f", pos, size);
+  }
+}
+
+void Verifier::CheckTarget(uint32_t pos, int64_t target)
+{
+  if (target < 0 || target > len || target % INSTRUCTION_SIZE != 0 ||
+      !boundaries[target / INSTRUCTION_SIZE])
+    throw Exception("jump at %u doesn't land on an instruction", pos);
+}
@@ -0,0 +1,3 @@
+// Assigning to something which isn't a variable does nothing
+5 = 3;
+message done;
@@ -0,0 +1,4 @@
+// Array elements are pushed as values, incrementing one does nothing
+x[0]++;
+x[0]--;
+message done;
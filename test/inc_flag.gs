@@ -0,0 +1,6 @@
+// Flags aren't counted, incrementing one leaves it set
+set f;
+f++;
+f--;
+if (f)
+  message done;